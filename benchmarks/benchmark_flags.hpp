@@ -0,0 +1,59 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace pasta {
+
+// Splits a comma separated list of flag values.
+inline std::vector<std::string> split_flag(std::string const &list) {
+  std::vector<std::string> values;
+  std::stringstream stream(list);
+  std::string value;
+  while (std::getline(stream, value, ',')) {
+    values.push_back(value);
+  }
+  return values;
+}
+
+// Parses a length with an optional suffix K, M or G (powers of two).
+inline int64_t parse_length_flag(std::string const &value) {
+  size_t end = 0;
+  int64_t length = std::stoll(value, &end);
+  switch (end < value.size() ? value[end] : ' ') {
+  case 'G':
+    return length << 30;
+  case 'M':
+    return length << 20;
+  case 'K':
+    return length << 10;
+  default:
+    return length;
+  }
+}
+
+} // namespace pasta
+
+/******************************************************************************/
@@ -0,0 +1,257 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include "benchmark_flags.hpp"
+#include "text_generators.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <omp.h>
+#include <pasta/block_tree/construction/block_tree_fp.hpp>
+#include <pasta/block_tree/construction/block_tree_lpf.hpp>
+#include <pasta/block_tree/utils/build_profiler.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Measures how the constructions scale with the number of threads, the text
+// length and the repetitiveness of the text and writes one CSV row per
+// construction. Sequential builders (fp_simple, fp_extended and lpf) are run
+// once per text, the parallel builders (lpf_dp and lpf_parallel) and the rank
+// and select support once per number of threads. Each tree is compared with
+// the first tree that the same builder built for the text.
+//
+// Flags (all optional):
+//   --lengths=10M,100M       text lengths (suffixes K, M and G)
+//   --texts=random,0.001     random text or versioned text with the edit rate
+//   --threads=1,2,4          numbers of threads, the default is all powers
+//                            of two up to the number of available threads
+//   --builders=lpf_parallel  subset of fp_simple, fp_extended, lpf, lpf_dp,
+//                            lpf_parallel
+//   --tau=4 --max_leaf_length=16
+//   --output=scaling.csv     CSV file, the default is stdout
+
+namespace {
+
+using BlockTree = pasta::BlockTree<uint8_t, int64_t>;
+
+struct Options {
+  std::vector<int64_t> lengths = {int64_t{10} << 20};
+  std::vector<std::string> texts = {"random", "0.001", "0.01"};
+  std::vector<int64_t> threads;
+  std::vector<std::string> builders = {"fp_simple", "fp_extended", "lpf",
+                                       "lpf_dp", "lpf_parallel"};
+  int64_t tau = 4;
+  int64_t max_leaf_length = 16;
+  std::string output;
+};
+
+Options parse_options(int32_t argc, char **argv) {
+  Options options;
+  for (int32_t i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    size_t eq = arg.find('=');
+    std::string name = arg.substr(0, eq);
+    std::string value = (eq == std::string::npos) ? "" : arg.substr(eq + 1);
+    if (name == "--lengths") {
+      options.lengths.clear();
+      for (auto const &length : pasta::split_flag(value)) {
+        options.lengths.push_back(pasta::parse_length_flag(length));
+      }
+    } else if (name == "--texts") {
+      options.texts = pasta::split_flag(value);
+    } else if (name == "--threads") {
+      options.threads.clear();
+      for (auto const &threads : pasta::split_flag(value)) {
+        options.threads.push_back(std::stoll(threads));
+      }
+    } else if (name == "--builders") {
+      options.builders = pasta::split_flag(value);
+    } else if (name == "--tau") {
+      options.tau = std::stoll(value);
+    } else if (name == "--max_leaf_length") {
+      options.max_leaf_length = std::stoll(value);
+    } else if (name == "--output") {
+      options.output = value;
+    } else {
+      throw std::invalid_argument("unknown flag " + arg);
+    }
+  }
+  if (options.threads.empty()) {
+    int64_t max_threads = omp_get_max_threads();
+    for (int64_t threads = 1; threads < max_threads; threads *= 2) {
+      options.threads.push_back(threads);
+    }
+    options.threads.push_back(max_threads);
+  }
+  return options;
+}
+
+// FNV-1a hash of all levels, the leaves and the rank and select support.
+uint64_t tree_hash(BlockTree &bt) {
+  uint64_t hash = 14695981039346656037ULL;
+  auto add = [&](uint64_t value) {
+    hash = (hash ^ value) * 1099511628211ULL;
+  };
+  for (size_t i = 0; i < bt.block_tree_types_.size(); i++) {
+    auto &bv = *bt.block_tree_types_[i];
+    add(bv.size());
+    for (size_t j = 0; j < bv.size(); j++) {
+      add(bv[j]);
+    }
+    for (auto ptr : *bt.block_tree_pointers_[i]) {
+      add(ptr);
+    }
+    for (auto off : *bt.block_tree_offsets_[i]) {
+      add(off);
+    }
+    add(bt.block_size_lvl_[i]);
+  }
+  for (auto leaf : bt.compressed_leaves_) {
+    add(leaf);
+  }
+  for (auto const *ranks : {&bt.c_ranks_, &bt.pointer_c_ranks_}) {
+    for (auto const &per_char : *ranks) {
+      for (auto const &lvl : per_char) {
+        for (auto rank : lvl) {
+          add(rank);
+        }
+      }
+    }
+  }
+  return hash;
+}
+
+BlockTree *build(std::string const &builder, std::vector<uint8_t> &text,
+                 Options const &options, int64_t threads) {
+  int64_t tau = options.tau;
+  int64_t leaf = options.max_leaf_length;
+  if (builder == "fp_simple") {
+    return new pasta::BlockTreeFP<uint8_t, int64_t>(text, tau, leaf, 1, 256,
+                                                    true, false);
+  } else if (builder == "fp_extended") {
+    return pasta::make_block_tree_fp<uint8_t, int64_t>(text, tau, leaf);
+  } else if (builder == "lpf") {
+    return pasta::make_block_tree_lpf<uint8_t, int64_t>(text, tau, leaf,
+                                                        false);
+  } else if (builder == "lpf_dp") {
+    return new pasta::BlockTreeLPF<uint8_t, int64_t>(text, tau, leaf, 1, false,
+                                                     true, true, threads);
+  } else if (builder == "lpf_parallel") {
+    return pasta::make_block_tree_lpf_parallel<uint8_t, int64_t>(
+        text, tau, leaf, false, threads);
+  }
+  throw std::invalid_argument("unknown builder " + builder);
+}
+
+bool is_parallel(std::string const &builder) {
+  return builder == "lpf_dp" || builder == "lpf_parallel";
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+} // namespace
+
+int32_t main(int32_t argc, char **argv) {
+  Options options = parse_options(argc, argv);
+  std::ofstream file;
+  if (!options.output.empty()) {
+    file.open(options.output);
+  }
+  std::ostream &out = options.output.empty() ? std::cout : file;
+  out << "builder,text,length,tau,max_leaf_length,threads,seconds,speedup,"
+         "efficiency,rank_seconds,rank_speedup,rank_efficiency,base_rss,"
+         "peak_rss,levels,bytes,identical"
+      << std::endl;
+
+  for (int64_t length : options.lengths) {
+    for (auto const &text_name : options.texts) {
+      std::vector<uint8_t> text =
+          (text_name == "random")
+              ? pasta::random_text(length, 16, 42)
+              : pasta::versioned_text(length, length / 64,
+                                      std::stod(text_name), 16, 42);
+      std::string name =
+          (text_name == "random") ? text_name : "versioned_" + text_name;
+      for (auto const &builder : options.builders) {
+        std::vector<int64_t> sweep = options.threads;
+        if (!is_parallel(builder)) {
+          sweep = {1};
+        }
+        uint64_t reference = 0;
+        double first_seconds = 0;
+        double first_rank_seconds = 0;
+        for (size_t t = 0; t < sweep.size(); t++) {
+          int64_t threads = sweep[t];
+          int64_t base_rss = pasta::peak_rss(true);
+          auto start = std::chrono::steady_clock::now();
+          std::unique_ptr<BlockTree> bt(build(builder, text, options, threads));
+          double seconds = seconds_since(start);
+          start = std::chrono::steady_clock::now();
+          bt->add_rank_support_omp(threads);
+          double rank_seconds = seconds_since(start);
+          int64_t rss = pasta::peak_rss();
+
+          uint64_t hash = tree_hash(*bt);
+          bool identical = (t == 0) || hash == reference;
+          for (int64_t i = 0; identical && i < length;
+               i += std::max<int64_t>(1, length / 4096)) {
+            identical = bt->access(i) == text[i];
+          }
+          if (t == 0) {
+            reference = hash;
+            first_seconds = seconds;
+            first_rank_seconds = rank_seconds;
+          }
+          // speedup and efficiency relative to the first number of threads
+          double speedup = first_seconds / seconds;
+          double rank_speedup = first_rank_seconds / rank_seconds;
+          double scale = static_cast<double>(sweep[0]) / threads;
+          out << builder << "," << name << "," << length << "," << options.tau
+              << "," << options.max_leaf_length << "," << threads << ","
+              << seconds << "," << speedup << "," << speedup * scale << ","
+              << rank_seconds << "," << rank_speedup << ","
+              << rank_speedup * scale << "," << base_rss << "," << rss << ","
+              << bt->block_tree_types_.size() << ","
+              << bt->print_space_usage() << "," << (identical ? 1 : 0)
+              << std::endl;
+          if (!identical) {
+            std::cerr << "tree of " << builder << " on " << name << " with "
+                      << threads << " threads differs" << std::endl;
+            return 1;
+          }
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+/******************************************************************************/
@@ -0,0 +1,287 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include "benchmark_flags.hpp"
+#include "text_generators.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <pasta/block_tree/construction/block_tree_lpf.hpp>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Issues a mix of access, rank and select queries from several threads
+// against one shared block tree and reports latency percentiles and the
+// throughput as CSV. Arrivals are open-loop: each thread draws exponentially
+// distributed inter-arrival times for its share of --rate and the latency of
+// a query is measured from its scheduled arrival, so queueing behind slow
+// queries is included. The service time excludes the queueing. With --rate=0
+// the queries are issued back to back.
+//
+// Positions are drawn from a Zipf distribution with exponent
+// --position_skew, whose ranks are scattered over the text, and characters
+// from a Zipf distribution with exponent --char_skew over the alphabet.
+//
+// Flags (all optional):
+//   --length=16M --text=0.001  random text or versioned text with edit rate
+//   --tau=4 --max_leaf_length=16
+//   --threads=4 --queries=1000000 (per thread) --rate=1000000 (per second)
+//   --mix=1,1,1                weights of access, rank and select
+//   --position_skew=0.99 --char_skew=0.5
+
+namespace {
+
+using BlockTree = pasta::BlockTreeLPF<uint8_t, int64_t>;
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  int64_t length = int64_t{16} << 20;
+  std::string text = "0.001";
+  int64_t tau = 4;
+  int64_t max_leaf_length = 16;
+  int64_t threads = 4;
+  int64_t queries = 1000000;
+  double rate = 1000000;
+  std::array<double, 3> mix = {1, 1, 1};
+  double position_skew = 0.99;
+  double char_skew = 0.5;
+};
+
+Options parse_options(int32_t argc, char **argv) {
+  Options options;
+  for (int32_t i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    size_t eq = arg.find('=');
+    std::string name = arg.substr(0, eq);
+    std::string value = (eq == std::string::npos) ? "" : arg.substr(eq + 1);
+    if (name == "--length") {
+      options.length = pasta::parse_length_flag(value);
+    } else if (name == "--text") {
+      options.text = value;
+    } else if (name == "--tau") {
+      options.tau = std::stoll(value);
+    } else if (name == "--max_leaf_length") {
+      options.max_leaf_length = std::stoll(value);
+    } else if (name == "--threads") {
+      options.threads = std::max<int64_t>(1, std::stoll(value));
+    } else if (name == "--queries") {
+      options.queries = std::stoll(value);
+    } else if (name == "--rate") {
+      options.rate = std::stod(value);
+    } else if (name == "--mix") {
+      auto weights = pasta::split_flag(value);
+      if (weights.size() != 3) {
+        throw std::invalid_argument("--mix needs three weights");
+      }
+      for (size_t k = 0; k < 3; k++) {
+        options.mix[k] = std::stod(weights[k]);
+      }
+    } else if (name == "--position_skew") {
+      options.position_skew = std::stod(value);
+    } else if (name == "--char_skew") {
+      options.char_skew = std::stod(value);
+    } else {
+      throw std::invalid_argument("unknown flag " + arg);
+    }
+  }
+  return options;
+}
+
+enum QueryKind { ACCESS = 0, RANK = 1, SELECT = 2 };
+
+struct Query {
+  QueryKind kind;
+  uint8_t c;
+  int64_t arg;
+  // scheduled arrival in nanoseconds after the start of the run
+  int64_t arrival;
+};
+
+struct Result {
+  QueryKind kind;
+  int64_t latency;
+  int64_t service;
+};
+
+std::vector<Query> make_queries(Options const &options,
+                                std::vector<uint8_t> const &alphabet,
+                                std::vector<int64_t> const &count,
+                                uint64_t seed) {
+  std::mt19937_64 gen(seed);
+  // rank and select are not defined for the last position
+  int64_t positions = options.length - 1;
+  pasta::ZipfDistribution position_dist(positions, options.position_skew);
+  pasta::ZipfDistribution char_dist(alphabet.size(), options.char_skew);
+  std::discrete_distribution<int32_t> kind_dist(options.mix.begin(),
+                                                options.mix.end());
+  double thread_rate = options.rate / options.threads;
+  std::exponential_distribution<double> gap_dist(
+      thread_rate > 0 ? thread_rate : 1.0);
+  // scatters the popular ranks over the text
+  auto scatter = [&](int64_t rank) {
+    uint64_t x = static_cast<uint64_t>(rank) * 0x9E3779B97F4A7C15ULL;
+    return static_cast<int64_t>((x ^ (x >> 29)) % positions);
+  };
+  std::vector<Query> queries(options.queries);
+  double arrival = 0;
+  for (auto &query : queries) {
+    if (thread_rate > 0) {
+      arrival += gap_dist(gen) * 1e9;
+    }
+    query.kind = static_cast<QueryKind>(kind_dist(gen));
+    query.c = alphabet[char_dist(gen) - 1];
+    query.arg = scatter(position_dist(gen));
+    if (query.kind == SELECT) {
+      query.arg = query.arg % count[query.c] + 1;
+    }
+    query.arrival = arrival;
+  }
+  return queries;
+}
+
+void run_queries(BlockTree &bt, std::vector<Query> const &queries,
+                 Clock::time_point start, std::vector<Result> &results,
+                 bool open_loop) {
+  results.resize(queries.size());
+  int64_t checksum = 0;
+  for (size_t k = 0; k < queries.size(); k++) {
+    auto const &query = queries[k];
+    auto arrival = start + std::chrono::nanoseconds(query.arrival);
+    auto now = Clock::now();
+    if (open_loop && now < arrival) {
+      if (arrival - now > std::chrono::microseconds(100)) {
+        std::this_thread::sleep_until(arrival - std::chrono::microseconds(50));
+      }
+      while ((now = Clock::now()) < arrival) {
+      }
+    }
+    auto issued = now;
+    switch (query.kind) {
+    case ACCESS:
+      checksum += bt.access(query.arg);
+      break;
+    case RANK:
+      checksum += bt.rank(query.c, query.arg);
+      break;
+    case SELECT:
+      checksum += bt.select(query.c, query.arg);
+      break;
+    }
+    auto done = Clock::now();
+    results[k].kind = query.kind;
+    results[k].service = (done - issued).count();
+    results[k].latency = open_loop ? (done - arrival).count()
+                                   : results[k].service;
+  }
+  // keeps the queries from being optimized away
+  if (checksum == -1) {
+    std::cerr << checksum << std::endl;
+  }
+}
+
+int64_t percentile(std::vector<int64_t> const &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t k = std::min<size_t>(sorted.size() - 1, p * sorted.size());
+  return sorted[k];
+}
+
+} // namespace
+
+int32_t main(int32_t argc, char **argv) {
+  Options options = parse_options(argc, argv);
+  std::vector<uint8_t> text =
+      (options.text == "random")
+          ? pasta::random_text(options.length, 16, 42)
+          : pasta::versioned_text(options.length, options.length / 64,
+                                  std::stod(options.text), 16, 42);
+  std::unique_ptr<BlockTree> bt(pasta::make_block_tree_lpf_parallel<uint8_t,
+                                                                    int64_t>(
+      text, options.tau, options.max_leaf_length, false, options.threads));
+  bt->add_rank_support_omp(options.threads);
+
+  std::vector<int64_t> count(256, 0);
+  for (int64_t i = 0; i + 1 < options.length; i++) {
+    count[text[i]]++;
+  }
+  std::vector<uint8_t> alphabet;
+  for (int32_t c = 0; c < 256; c++) {
+    if (count[c] > 0) {
+      alphabet.push_back(c);
+    }
+  }
+
+  std::vector<std::vector<Query>> queries(options.threads);
+  for (int64_t t = 0; t < options.threads; t++) {
+    queries[t] = make_queries(options, alphabet, count, 1000 + t);
+  }
+  std::vector<std::vector<Result>> results(options.threads);
+  bool open_loop = options.rate > 0;
+  auto start = Clock::now() + std::chrono::milliseconds(10);
+  std::vector<std::thread> workers;
+  for (int64_t t = 0; t < options.threads; t++) {
+    workers.emplace_back(run_queries, std::ref(*bt), std::cref(queries[t]),
+                         start, std::ref(results[t]), open_loop);
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  double seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::cout << "type,queries,throughput,latency_p50_ns,latency_p99_ns,"
+               "latency_p999_ns,latency_max_ns,service_p50_ns,service_p99_ns,"
+               "service_p999_ns,levels"
+            << std::endl;
+  static constexpr char const *names[] = {"access", "rank", "select", "all"};
+  for (int32_t kind = 0; kind < 4; kind++) {
+    std::vector<int64_t> latency;
+    std::vector<int64_t> service;
+    for (auto const &thread_results : results) {
+      for (auto const &result : thread_results) {
+        if (kind == 3 || result.kind == kind) {
+          latency.push_back(result.latency);
+          service.push_back(result.service);
+        }
+      }
+    }
+    std::sort(latency.begin(), latency.end());
+    std::sort(service.begin(), service.end());
+    std::cout << names[kind] << "," << latency.size() << ","
+              << latency.size() / seconds << ","
+              << percentile(latency, 0.5) << "," << percentile(latency, 0.99)
+              << "," << percentile(latency, 0.999) << ","
+              << (latency.empty() ? 0 : latency.back()) << ","
+              << percentile(service, 0.5) << "," << percentile(service, 0.99)
+              << "," << percentile(service, 0.999) << ","
+              << bt->block_tree_types_.size() << std::endl;
+  }
+  return 0;
+}
+
+/******************************************************************************/
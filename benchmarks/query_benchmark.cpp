@@ -0,0 +1,211 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include "text_generators.hpp"
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <pasta/block_tree/construction/block_tree_lpf.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+// Benchmarks access, rank and select on random and sequential query patterns
+// for block trees of synthetic texts with different tau, max_leaf_length and
+// s (either 1 or the number of LZ factors z). The text length can be set with
+// --text_length=<n>, all other flags are passed to Google Benchmark.
+
+namespace {
+
+using BlockTree = pasta::BlockTreeLPF<uint8_t, int32_t>;
+
+size_t text_length = size_t{1} << 22;
+size_t const query_count = size_t{1} << 16;
+uint32_t const sigma = 16;
+
+struct TextConfig {
+  std::string name;
+  // edit rate of the versions, random text if negative
+  double edit_rate;
+};
+
+struct TreeConfig {
+  TextConfig text;
+  int32_t tau;
+  int32_t max_leaf_length;
+  bool s_is_z;
+
+  std::string name() const {
+    return text.name + "/tau:" + std::to_string(tau) +
+           "/leaf:" + std::to_string(max_leaf_length) +
+           "/s:" + (s_is_z ? "z" : "1");
+  }
+};
+
+// Queries of one pattern, position i of the text with its symbol and the
+// number of occurrences of the symbol in text[0..i].
+struct Queries {
+  std::vector<int32_t> positions;
+  std::vector<uint8_t> symbols;
+  std::vector<int32_t> ranks;
+};
+
+// The tree of the last configuration, benchmarks are registered grouped by
+// their tree so each tree is built only once.
+struct Fixture {
+  std::string name;
+  std::vector<uint8_t> text;
+  std::unique_ptr<BlockTree> bt;
+  Queries random;
+  Queries sequential;
+};
+
+Fixture fixture;
+
+Queries make_queries(std::vector<uint8_t> const &text,
+                     std::vector<int32_t> const &occurrence, bool sequential,
+                     uint64_t seed) {
+  std::mt19937_64 gen(seed);
+  // rank and select are not defined for the last position
+  std::uniform_int_distribution<size_t> dist(0, text.size() - 2);
+  Queries queries;
+  size_t next = dist(gen);
+  for (size_t k = 0; k < query_count; k++) {
+    size_t i = sequential ? next : dist(gen);
+    next = (next + 1 == text.size() - 1) ? 0 : next + 1;
+    queries.positions.push_back(i);
+    queries.symbols.push_back(text[i]);
+    queries.ranks.push_back(occurrence[i]);
+  }
+  return queries;
+}
+
+Fixture &get_fixture(TreeConfig const &config) {
+  if (fixture.name == config.name()) {
+    return fixture;
+  }
+  fixture.bt.reset();
+  fixture.name = config.name();
+  fixture.text = (config.text.edit_rate < 0)
+                     ? pasta::random_text(text_length, sigma, 42)
+                     : pasta::versioned_text(text_length, text_length / 64,
+                                             config.text.edit_rate, sigma, 42);
+  fixture.bt.reset(pasta::make_block_tree_lpf<uint8_t, int32_t>(
+      fixture.text, config.tau, config.max_leaf_length, config.s_is_z));
+  fixture.bt->add_rank_support();
+  std::vector<int32_t> occurrence(fixture.text.size());
+  std::vector<int32_t> count(256, 0);
+  for (size_t i = 0; i < fixture.text.size(); i++) {
+    occurrence[i] = ++count[fixture.text[i]];
+  }
+  fixture.random = make_queries(fixture.text, occurrence, false, 7);
+  fixture.sequential = make_queries(fixture.text, occurrence, true, 7);
+  return fixture;
+}
+
+void set_counters(benchmark::State &state, Fixture &f) {
+  state.SetItemsProcessed(state.iterations());
+  state.counters["levels"] = f.bt->block_tree_types_.size();
+  state.counters["bytes"] = f.bt->print_space_usage();
+}
+
+void query_access(benchmark::State &state, TreeConfig config, bool sequential) {
+  auto &f = get_fixture(config);
+  auto const &queries = sequential ? f.sequential : f.random;
+  size_t k = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(f.bt->access(queries.positions[k]));
+    k = (k + 1) % query_count;
+  }
+  set_counters(state, f);
+}
+
+void query_rank(benchmark::State &state, TreeConfig config, bool sequential) {
+  auto &f = get_fixture(config);
+  auto const &queries = sequential ? f.sequential : f.random;
+  size_t k = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        f.bt->rank(queries.symbols[k], queries.positions[k]));
+    k = (k + 1) % query_count;
+  }
+  set_counters(state, f);
+}
+
+void query_select(benchmark::State &state, TreeConfig config, bool sequential) {
+  auto &f = get_fixture(config);
+  auto const &queries = sequential ? f.sequential : f.random;
+  size_t k = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        f.bt->select(queries.symbols[k], queries.ranks[k]));
+    k = (k + 1) % query_count;
+  }
+  set_counters(state, f);
+}
+
+} // namespace
+
+int32_t main(int32_t argc, char **argv) {
+  // remove our flag before Google Benchmark parses the remaining ones
+  int32_t kept = 1;
+  for (int32_t i = 1; i < argc; i++) {
+    if (std::strncmp(argv[i], "--text_length=", 14) == 0) {
+      text_length = std::stoull(argv[i] + 14);
+    } else {
+      argv[kept++] = argv[i];
+    }
+  }
+  argc = kept;
+
+  std::vector<TextConfig> const texts = {{"random", -1.0},
+                                         {"versioned_0.001", 0.001},
+                                         {"versioned_0.01", 0.01}};
+  for (auto const &text : texts) {
+    for (int32_t tau : {2, 4, 8}) {
+      for (int32_t max_leaf_length : {4, 16}) {
+        for (bool s_is_z : {false, true}) {
+          TreeConfig config{text, tau, max_leaf_length, s_is_z};
+          for (bool sequential : {false, true}) {
+            std::string suffix = config.name() +
+                                 (sequential ? "/sequential" : "/random");
+            benchmark::RegisterBenchmark(("access/" + suffix).c_str(),
+                                         query_access, config, sequential);
+            benchmark::RegisterBenchmark(("rank/" + suffix).c_str(),
+                                         query_rank, config, sequential);
+            benchmark::RegisterBenchmark(("select/" + suffix).c_str(),
+                                         query_select, config, sequential);
+          }
+        }
+      }
+    }
+  }
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
+
+/******************************************************************************/
@@ -0,0 +1,145 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace pasta {
+
+// Text of length n with symbols drawn uniformly from [0, sigma).
+inline std::vector<uint8_t> random_text(size_t n, uint32_t sigma,
+                                        uint64_t seed) {
+  std::mt19937_64 gen(seed);
+  std::uniform_int_distribution<uint32_t> dist(0, sigma - 1);
+  std::vector<uint8_t> text(n);
+  for (auto &c : text) {
+    c = dist(gen);
+  }
+  return text;
+}
+
+// Text of length n that emulates a versioned corpus: a random base string of
+// length base_length is followed by copies of the previous version in which
+// each symbol is substituted, deleted or followed by an inserted symbol with
+// probability edit_rate (all three edits are equally likely).
+inline std::vector<uint8_t> versioned_text(size_t n, size_t base_length,
+                                           double edit_rate, uint32_t sigma,
+                                           uint64_t seed) {
+  std::mt19937_64 gen(seed);
+  std::uniform_int_distribution<uint32_t> symbol(0, sigma - 1);
+  std::uniform_real_distribution<double> coin(0.0, 1.0);
+  std::uniform_int_distribution<int32_t> edit(0, 2);
+  std::vector<uint8_t> text;
+  text.reserve(n + base_length);
+  for (size_t i = 0; i < std::min(n, base_length); i++) {
+    text.push_back(symbol(gen));
+  }
+  size_t version_begin = 0;
+  while (text.size() < n) {
+    size_t version_end = text.size();
+    for (size_t i = version_begin; i < version_end && text.size() < n; i++) {
+      if (coin(gen) >= edit_rate) {
+        text.push_back(text[i]);
+        continue;
+      }
+      switch (edit(gen)) {
+      case 0:
+        text.push_back(symbol(gen));
+        break;
+      case 1:
+        break;
+      default:
+        text.push_back(text[i]);
+        text.push_back(symbol(gen));
+      }
+    }
+    version_begin = version_end;
+  }
+  text.resize(n);
+  return text;
+}
+
+// Draws k in [1, n] with probability proportional to 1 / k^exponent, an
+// exponent of 0 is uniform. Uses rejection-inversion sampling (Hörmann and
+// Derflinger), which needs constant time and space for any n.
+class ZipfDistribution {
+public:
+  ZipfDistribution(int64_t n, double exponent) : n_(n), exponent_(exponent) {
+    h_integral_x1_ = h_integral(1.5) - 1.0;
+    h_integral_n_ = h_integral(n_ + 0.5);
+    s_ = 2.0 - h_integral_inverse(h_integral(2.5) - h(2.0));
+  }
+
+  template <typename Generator>
+  int64_t operator()(Generator &gen) {
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    while (true) {
+      double u = h_integral_n_ + dist(gen) * (h_integral_x1_ - h_integral_n_);
+      double x = h_integral_inverse(u);
+      int64_t k = std::clamp<int64_t>(x + 0.5, 1, n_);
+      if (k - x <= s_ || u >= h_integral(k + 0.5) - h(k)) {
+        return k;
+      }
+    }
+  }
+
+private:
+  int64_t n_;
+  double exponent_;
+  double h_integral_x1_;
+  double h_integral_n_;
+  double s_;
+
+  double h(double x) const { return std::exp(-exponent_ * std::log(x)); }
+
+  double h_integral(double x) const {
+    double log_x = std::log(x);
+    return expm1_over((1.0 - exponent_) * log_x) * log_x;
+  }
+
+  double h_integral_inverse(double x) const {
+    double t = std::max(-1.0, x * (1.0 - exponent_));
+    return std::exp(log1p_over(t) * x);
+  }
+
+  // log(1 + x) / x and (e^x - 1) / x, stable around 0
+  static double log1p_over(double x) {
+    if (std::abs(x) > 1e-8) {
+      return std::log1p(x) / x;
+    }
+    return 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+  }
+
+  static double expm1_over(double x) {
+    if (std::abs(x) > 1e-8) {
+      return std::expm1(x) / x;
+    }
+    return 1.0 + x * 0.5 * (1.0 + x / 3.0 * (1.0 + 0.25 * x));
+  }
+};
+
+} // namespace pasta
+
+/******************************************************************************/
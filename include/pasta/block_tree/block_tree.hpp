@@ -20,7 +20,22 @@
 
 #pragma once
 
+#include "pasta/block_tree/utils/build_profiler.hpp"
+#include "pasta/block_tree/utils/prefix_sum.hpp"
+#include "pasta/block_tree/utils/query_stats.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <exception>
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
 #include <iostream>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <type_traits>
 #include <omp.h>
 #include <pasta/bit_vector/bit_vector.hpp>
 #include <pasta/bit_vector/support/find_l2_flat_with.hpp>
@@ -32,41 +47,140 @@
 #include <pasta/bit_vector/support/wide_rank.hpp>
 #include <pasta/bit_vector/support/wide_rank_select.hpp>
 #include <sdsl/int_vector.hpp>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace pasta {
 
+// Structure and space of one level of a block tree. Sizes are in bytes.
+struct BlockTreeLevelStats {
+  int64_t block_size = 0;
+  int64_t blocks = 0;
+  // internal blocks, i.e., blocks with children on the next level
+  int64_t marked = 0;
+  int64_t back_blocks = 0;
+  int64_t pointer_width = 0;
+  int64_t offset_width = 0;
+  int64_t type_bytes = 0;
+  int64_t rank_select_bytes = 0;
+  int64_t pointer_bytes = 0;
+  int64_t offset_bytes = 0;
+  int64_t c_rank_bytes = 0;
+  int64_t pointer_c_rank_bytes = 0;
+  // distance_histogram[k] is the number of back blocks whose source starts
+  // between 2^k and 2^(k+1) - 1 characters in front of the back block
+  std::vector<int64_t> distance_histogram;
+};
+
+// Structure and space of a whole block tree. Sizes are in bytes.
+struct BlockTreeStats {
+  std::vector<BlockTreeLevelStats> levels;
+  int64_t leaves = 0;
+  int64_t leaf_width = 0;
+  int64_t leaf_bytes = 0;
+  // compress_map_ and decompress_map_
+  int64_t map_bytes = 0;
+  // chars_ and chars_index_
+  int64_t alphabet_bytes = 0;
+  int64_t top_level_c_rank_bytes = 0;
+  // parameters and block sizes
+  int64_t other_bytes = 0;
+  int64_t total_bytes = 0;
+  // distance histogram of the back blocks of all levels
+  std::vector<int64_t> distance_histogram;
+};
+
 template <typename input_type, typename size_type> class BlockTree {
 public:
   bool CUT_FIRST_LEVELS = true;
-  size_type tau_;
-  size_type max_leaf_length_;
+  size_type tau_ = 0;
+  size_type max_leaf_length_ = 0;
   size_type s_ = 1;
   size_type leaf_size = 0;
   size_type amount_of_leaves = 0;
   bool rank_support = false;
-  std::vector<pasta::BitVector *> block_tree_types_;
-  std::vector<pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES> *>
+  // The rank and select structures refer to the bit vectors of the levels,
+  // which hence are kept at fixed addresses.
+  std::vector<std::unique_ptr<pasta::BitVector>> block_tree_types_;
+  std::vector<
+      std::unique_ptr<pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>>>
       block_tree_types_rs_;
-  std::vector<sdsl::int_vector<> *> block_tree_pointers_;
-  std::vector<sdsl::int_vector<> *> block_tree_offsets_;
+  std::vector<std::unique_ptr<sdsl::int_vector<>>> block_tree_pointers_;
+  std::vector<std::unique_ptr<sdsl::int_vector<>>> block_tree_offsets_;
   //    std::vector<sdsl::int_vector<>*> block_tree_encoded_;
   std::vector<int64_t> block_size_lvl_;
   std::vector<int64_t> block_per_lvl_;
   std::vector<input_type> leaves_;
 
+  // Characters of the leaves are stored as codes in compressed_leaves_. For
+  // byte alphabets, compress_map_ has an entry for each byte. For wider
+  // alphabets, compress_map_ is empty and decompress_map_ contains the
+  // characters in increasing order, i.e., a code is the position of its
+  // character in decompress_map_.
   std::vector<uint8_t> compress_map_;
-  std::vector<uint8_t> decompress_map_;
+  std::vector<input_type> decompress_map_;
   sdsl::int_vector<> compressed_leaves_;
 
   std::unordered_map<input_type, size_type> chars_index_;
   std::vector<input_type> chars_;
-  size_type u_chars_;
+  size_type u_chars_ = 0;
   std::vector<std::vector<int64_t>> top_level_c_ranks_;
   std::vector<std::vector<sdsl::int_vector<>>> c_ranks_;
   std::vector<std::vector<sdsl::int_vector<>>> pointer_c_ranks_;
 
+  // The tree owns the bit vectors, rank and select structures, pointers and
+  // offsets of its levels. It can be moved but not copied, a moved-from tree
+  // is empty.
+  BlockTree() = default;
+  BlockTree(BlockTree const &) = delete;
+  BlockTree &operator=(BlockTree const &) = delete;
+
+  BlockTree(BlockTree &&other) noexcept { swap(other); }
+
+  BlockTree &operator=(BlockTree &&other) noexcept {
+    if (this != &other) {
+      BlockTree moved(std::move(other));
+      swap(moved);
+    }
+    return *this;
+  }
+
+  // trees built by different builders or loaded with load() can be deleted
+  // through this class
+  virtual ~BlockTree() { clear_levels(); }
+
+  void swap(BlockTree &other) noexcept {
+    using std::swap;
+    swap(CUT_FIRST_LEVELS, other.CUT_FIRST_LEVELS);
+    swap(tau_, other.tau_);
+    swap(max_leaf_length_, other.max_leaf_length_);
+    swap(s_, other.s_);
+    swap(leaf_size, other.leaf_size);
+    swap(amount_of_leaves, other.amount_of_leaves);
+    swap(rank_support, other.rank_support);
+    swap(block_tree_types_, other.block_tree_types_);
+    swap(block_tree_types_rs_, other.block_tree_types_rs_);
+    swap(block_tree_pointers_, other.block_tree_pointers_);
+    swap(block_tree_offsets_, other.block_tree_offsets_);
+    swap(block_size_lvl_, other.block_size_lvl_);
+    swap(block_per_lvl_, other.block_per_lvl_);
+    swap(leaves_, other.leaves_);
+    swap(compress_map_, other.compress_map_);
+    swap(decompress_map_, other.decompress_map_);
+    swap(compressed_leaves_, other.compressed_leaves_);
+    swap(chars_index_, other.chars_index_);
+    swap(chars_, other.chars_);
+    swap(u_chars_, other.u_chars_);
+    swap(top_level_c_ranks_, other.top_level_c_ranks_);
+    swap(c_ranks_, other.c_ranks_);
+    swap(pointer_c_ranks_, other.pointer_c_ranks_);
+  }
+
+  // access, select and rank are mirrored by BlockTreeView, which runs the same
+  // traversals on the zero-copy format. Changes have to be made in both.
   int64_t access(size_type index) {
+    PASTA_BLOCK_TREE_QUERY(ACCESS);
     int64_t block_size = block_size_lvl_[0];
     int64_t blk_pointer = index / block_size_lvl_[0];
     int64_t off = index % block_size_lvl_[0];
@@ -77,7 +191,9 @@ public:
       auto &lvl_rs = *block_tree_types_rs_[i];
       auto &lvl_ptr = *block_tree_pointers_[i];
       auto &lvl_off = *block_tree_offsets_[i];
+      PASTA_BLOCK_TREE_VISIT(i, blk_pointer, off);
       if (lvl[blk_pointer] == 0) {
+        PASTA_BLOCK_TREE_HOP(i);
         size_type blk = lvl_rs.rank0(blk_pointer);
         off = off + lvl_off[blk];
         blk_pointer = lvl_ptr[blk];
@@ -91,10 +207,12 @@ public:
       off = off % block_size;
       blk_pointer = lvl_rs.rank1(blk_pointer) * tau_ + child;
     }
+    PASTA_BLOCK_TREE_SCAN(1);
     return decompress_map_[compressed_leaves_[blk_pointer * leaf_size + off]];
   };
 
   int64_t select(input_type c, size_type j) {
+    PASTA_BLOCK_TREE_QUERY(SELECT);
     auto c_index = chars_index_[c];
     auto &top_level = *block_tree_types_[0];
 
@@ -107,7 +225,7 @@ public:
     // find first level block containing the jth occurrence of c with a bin
     // search
     while (current_block != end_block) {
-
+      PASTA_BLOCK_TREE_SEARCH_STEP();
       size_type m = current_block + (end_block - current_block) / 2;
 
       size_type f = (m == 0) ? 0 : c_ranks_[c_index][0][m - 1];
@@ -130,7 +248,9 @@ public:
     j -= (current_block == 0) ? 0 : c_ranks_[c_index][0][current_block - 1];
     // we translate unmarked blocks on the top level independently as it differs
     // from the other levels
+    PASTA_BLOCK_TREE_VISIT(0, current_block, j);
     if (!top_level[current_block]) {
+      PASTA_BLOCK_TREE_HOP(0);
       int64_t blk = top_level_rs.rank0(current_block);
       current_block = top_level_ptr[blk];
       int64_t g = top_level_off[blk];
@@ -159,11 +279,14 @@ public:
       block_size /= tau_;
       int64_t k = current_block;
       while ((int64_t)c_ranks_[c_index][i][current_block] < j) {
+        PASTA_BLOCK_TREE_SEARCH_STEP();
         current_block++;
       }
       j -= (current_block == k) ? 0 : c_ranks_[c_index][i][current_block - 1];
       s += (current_block - k) * block_size;
+      PASTA_BLOCK_TREE_VISIT(i, current_block, j);
       if (!current_level[current_block]) {
+        PASTA_BLOCK_TREE_HOP(i);
         int64_t blk = current_level_rs.rank0(current_block);
         current_block = current_level_ptr[blk];
         int64_t g = current_level_off[blk];
@@ -185,12 +308,8 @@ public:
     }
 
     current_block = (*block_tree_types_rs_[i - 1]).rank1(current_block) * tau_;
-    int64_t l = 0;
-    while (j > 0) {
-      if (compressed_leaves_[current_block * leaf_size + l] == compress_map_[c])
-        j--;
-      l++;
-    }
+    int64_t l = select_leaf_code(current_block * leaf_size, j, leaf_code(c));
+    PASTA_BLOCK_TREE_SCAN(l);
     return s + l;
   }
 
@@ -267,19 +386,13 @@ public:
       }
     }
     size_type prefix_leaves = blk_pointer - child;
-    for (int j = 0; j < child * leaf_size; j++) {
-      if ((compressed_leaves_)[prefix_leaves * leaf_size + j] ==
-          compress_map_[c])
-        rank++;
-    }
-    for (int j = 0; j <= off; j++) {
-      if ((compressed_leaves_)[blk_pointer * leaf_size + j] == compress_map_[c])
-        rank++;
-    }
+    rank += count_leaf_code(prefix_leaves * leaf_size,
+                            blk_pointer * leaf_size + off + 1, leaf_code(c));
     return rank;
   }
 
   int64_t rank(input_type c, size_type index) {
+    PASTA_BLOCK_TREE_QUERY(RANK);
     pasta::BitVector &top_level = *block_tree_types_[0];
     auto &top_level_rs = *block_tree_types_rs_[0];
     auto &top_level_ptr = *block_tree_pointers_[0];
@@ -291,12 +404,14 @@ public:
     int64_t rank =
         (blk_pointer == 0) ? 0 : c_ranks_[c_index][0][blk_pointer - 1];
     int64_t child = 0;
+    PASTA_BLOCK_TREE_VISIT(0, blk_pointer, off);
     if (top_level[blk_pointer]) {
       block_size /= tau_;
       child = off / block_size;
       off = off % block_size;
       blk_pointer = top_level_rs.rank1(blk_pointer) * tau_ + child;
     } else {
+      PASTA_BLOCK_TREE_HOP(0);
       size_type blk = top_level_rs.rank0(blk_pointer);
       rank -= pointer_c_ranks_[c_index][0][blk];
       off = off + top_level_off[blk];
@@ -318,6 +433,7 @@ public:
     uint64_t i = 1;
     while (i < block_tree_types_.size()) {
       rank += (child == 0) ? 0 : c_ranks_[c_index][i][blk_pointer - 1];
+      PASTA_BLOCK_TREE_VISIT(i, blk_pointer, off);
       if ((*block_tree_types_[i])[blk_pointer]) {
         size_type rank_blk = block_tree_types_rs_[i]->rank1(blk_pointer);
         block_size /= tau_;
@@ -326,6 +442,7 @@ public:
         blk_pointer = rank_blk * tau_ + child;
         i++;
       } else {
+        PASTA_BLOCK_TREE_HOP(i);
         size_type blk = block_tree_types_rs_[i]->rank0(blk_pointer);
         rank -= pointer_c_ranks_[c_index][i][blk];
         size_type ptr_off = (*block_tree_offsets_[i])[blk];
@@ -346,31 +463,25 @@ public:
       }
     }
     size_type prefix_leaves = blk_pointer - child;
-    for (int j = 0; j < child * leaf_size; j++) {
-      if ((compressed_leaves_)[prefix_leaves * leaf_size + j] ==
-          compress_map_[c])
-        rank++;
-    }
-    for (int j = 0; j <= off; j++) {
-      if ((compressed_leaves_)[blk_pointer * leaf_size + j] == compress_map_[c])
-        rank++;
-    }
+    PASTA_BLOCK_TREE_SCAN(child * leaf_size + off + 1);
+    rank += count_leaf_code(prefix_leaves * leaf_size,
+                            blk_pointer * leaf_size + off + 1, leaf_code(c));
     return rank;
   };
 
   int64_t print_space_usage() {
     int64_t space_usage = sizeof(tau_) + sizeof(max_leaf_length_) + sizeof(s_) +
                           sizeof(leaf_size);
-    for (auto bv : block_tree_types_) {
+    for (auto const &bv : block_tree_types_) {
       space_usage += bv->size() / 8;
     }
-    for (auto rs : block_tree_types_rs_) {
+    for (auto const &rs : block_tree_types_rs_) {
       space_usage += rs->space_usage();
     }
-    for (const auto iv : block_tree_pointers_) {
+    for (auto const &iv : block_tree_pointers_) {
       space_usage += (int64_t)sdsl::size_in_bytes(*iv);
     }
-    for (const auto iv : block_tree_offsets_) {
+    for (auto const &iv : block_tree_offsets_) {
       space_usage += (int64_t)sdsl::size_in_bytes(*iv);
     }
     if (rank_support) {
@@ -395,50 +506,500 @@ public:
     // space_usage += leaves_.size() * sizeof(input_type);
     space_usage += sdsl::size_in_bytes(compressed_leaves_);
     space_usage += compress_map_.size();
+    if constexpr (sizeof(input_type) > 1) {
+      space_usage += sizeof(input_type) * decompress_map_.size();
+    }
 
     return space_usage;
   };
 
-  void compress_leaves() {
-    compress_map_.resize(256, 0);
-	decompress_map_.resize(256, 0);
-    for (size_t i = 0; i < this->leaves_.size(); ++i) {
-      compress_map_[this->leaves_[i]] = 1;
+  // Returns the number of blocks, marked blocks and back blocks as well as the
+  // space of each level and of the leaves and the alphabet. Unlike
+  // print_space_usage, all parts of the tree are accounted for. The distances
+  // of the back blocks to their sources are computed from the block starts of
+  // each level.
+  BlockTreeStats stats() const {
+    BlockTreeStats result;
+    int64_t levels = block_tree_types_.size();
+    std::vector<int64_t> starts;
+    std::vector<int64_t> next_starts;
+    for (int64_t i = 0; i < levels; i++) {
+      auto const &bv = *block_tree_types_[i];
+      auto const &rs = *block_tree_types_rs_[i];
+      auto const &pointers = *block_tree_pointers_[i];
+      auto const &offsets = *block_tree_offsets_[i];
+      BlockTreeLevelStats lvl;
+      lvl.block_size = block_size_lvl_[i];
+      lvl.blocks = bv.size();
+      lvl.marked = rs.rank1(bv.size());
+      lvl.back_blocks = pointers.size();
+      lvl.pointer_width = pointers.width();
+      lvl.offset_width = offsets.width();
+      lvl.type_bytes = (bv.size() + 63) / 64 * sizeof(uint64_t);
+      lvl.rank_select_bytes = rs.space_usage();
+      lvl.pointer_bytes = sdsl::size_in_bytes(pointers);
+      lvl.offset_bytes = sdsl::size_in_bytes(offsets);
+      // characters without rank support have no directories
+      for (auto const &per_char : c_ranks_) {
+        if (!per_char.empty()) {
+          lvl.c_rank_bytes += sdsl::size_in_bytes(per_char[i]);
+        }
+      }
+      for (auto const &per_char : pointer_c_ranks_) {
+        if (!per_char.empty()) {
+          lvl.pointer_c_rank_bytes += sdsl::size_in_bytes(per_char[i]);
+        }
+      }
+
+      if (i == 0) {
+        starts.resize(lvl.blocks);
+        for (int64_t j = 0; j < lvl.blocks; j++) {
+          starts[j] = j * lvl.block_size;
+        }
+      }
+      int64_t back_block = 0;
+      for (int64_t j = 0; j < lvl.blocks; j++) {
+        if (bv[j] == 1) {
+          continue;
+        }
+        int64_t source = starts[pointers[back_block]] + offsets[back_block];
+        int64_t bucket = std::bit_width(
+                             static_cast<uint64_t>(starts[j] - source)) -
+                         1;
+        if (bucket >= 0) {
+          auto &histogram = lvl.distance_histogram;
+          histogram.resize(std::max<int64_t>(histogram.size(), bucket + 1));
+          histogram[bucket]++;
+        }
+        back_block++;
+      }
+      if (i + 1 < levels) {
+        int64_t child_size = block_size_lvl_[i + 1];
+        int64_t next_size = block_tree_types_[i + 1]->size();
+        next_starts.resize(next_size);
+        int64_t child = 0;
+        for (int64_t j = 0; j < lvl.blocks && child < next_size; j++) {
+          if (bv[j] == 1) {
+            for (int64_t k = 0; k < tau_ && child < next_size; k++) {
+              next_starts[child++] = starts[j] + k * child_size;
+            }
+          }
+        }
+        starts.swap(next_starts);
+      }
+
+      auto &histogram = result.distance_histogram;
+      histogram.resize(
+          std::max(histogram.size(), lvl.distance_histogram.size()));
+      for (uint64_t k = 0; k < lvl.distance_histogram.size(); k++) {
+        histogram[k] += lvl.distance_histogram[k];
+      }
+      result.total_bytes += lvl.type_bytes + lvl.rank_select_bytes +
+                            lvl.pointer_bytes + lvl.offset_bytes +
+                            lvl.c_rank_bytes + lvl.pointer_c_rank_bytes;
+      result.levels.push_back(std::move(lvl));
     }
-    for (size_t i = 0, cur_val = 0; i < this->compress_map_.size(); ++i) {
-      size_t tmp = compress_map_[i];
-      compress_map_[i] = cur_val;
-	  decompress_map_[cur_val] = i;
-      cur_val += tmp;
+
+    result.leaves = amount_of_leaves;
+    result.leaf_width = compressed_leaves_.width();
+    result.leaf_bytes = sdsl::size_in_bytes(compressed_leaves_);
+    result.map_bytes = compress_map_.capacity() +
+                       sizeof(input_type) * decompress_map_.capacity();
+    result.alphabet_bytes =
+        sizeof(input_type) * chars_.capacity() +
+        (sizeof(std::pair<input_type const, size_type>) + 2 * sizeof(void *)) *
+            chars_index_.size() +
+        sizeof(void *) * chars_index_.bucket_count();
+    for (auto const &ranks : top_level_c_ranks_) {
+      result.top_level_c_rank_bytes += sizeof(int64_t) * ranks.capacity();
+    }
+    result.other_bytes = sizeof(tau_) + sizeof(max_leaf_length_) +
+                         sizeof(s_) + sizeof(leaf_size) +
+                         sizeof(int64_t) * (block_size_lvl_.capacity() +
+                                            block_per_lvl_.capacity());
+    result.total_bytes += result.leaf_bytes + result.map_bytes +
+                          result.alphabet_bytes +
+                          result.top_level_c_rank_bytes + result.other_bytes;
+    return result;
+  }
+
+  // Checks every back pointer against the text: the source must consist of
+  // marked blocks and contain the same characters as the back block. Returns
+  // the number of back blocks violating this, checked is set to the number of
+  // back blocks looked at. A level that does not match the text at all counts
+  // as a single violation.
+  template <typename text_type>
+  int64_t verify_pointers(text_type const &text, int64_t &checked) {
+    int64_t broken = 0;
+    int64_t n = text.size();
+    int64_t block_size = block_size_lvl_[0];
+    checked = 0;
+    // text positions of the blocks on the current level
+    std::vector<int64_t> starts;
+    for (int64_t i = 0; i < n; i += block_size) {
+      starts.push_back(i);
+    }
+    for (uint64_t i = 0; i < block_tree_types_.size(); i++) {
+      auto &lvl = *block_tree_types_[i];
+      auto &lvl_rs = *block_tree_types_rs_[i];
+      auto &lvl_ptr = *block_tree_pointers_[i];
+      auto &lvl_off = *block_tree_offsets_[i];
+      if (lvl.size() != starts.size()) {
+        return broken + 1;
+      }
+      int64_t lvl_size = lvl.size();
+#pragma omp parallel for default(none)                                         \
+    shared(text, starts, lvl, lvl_rs, lvl_ptr, lvl_off, n, block_size,       \
+               lvl_size) reduction(+ : broken, checked)
+      for (int64_t j = 0; j < lvl_size; j++) {
+        if (lvl[j]) {
+          continue;
+        }
+        checked++;
+        int64_t blk = lvl_rs.rank0(j);
+        int64_t ptr = lvl_ptr[blk];
+        int64_t off = lvl_off[blk];
+        int64_t length = std::min(block_size, n - starts[j]);
+        bool valid = ptr >= 0 && ptr < lvl_size && lvl[ptr] &&
+                     off < block_size && starts[ptr] + off + length <= n;
+        if (valid && off > 0) {
+          valid = ptr + 1 < lvl_size && lvl[ptr + 1] &&
+                  starts[ptr] + block_size == starts[ptr + 1];
+        }
+        if (!valid || !std::equal(text.begin() + starts[j],
+                                  text.begin() + starts[j] + length,
+                                  text.begin() + starts[ptr] + off)) {
+          broken++;
+        }
+      }
+      std::vector<int64_t> next_starts;
+      int64_t child_size = block_size / tau_;
+      for (int64_t j = 0; j < lvl_size; j++) {
+        if (lvl[j]) {
+          for (int64_t k = 0; k < tau_ && starts[j] + k * child_size < n;
+               k++) {
+            next_starts.push_back(starts[j] + k * child_size);
+          }
+        }
+      }
+      starts.swap(next_starts);
+      block_size = child_size;
+    }
+    return broken;
+  }
+
+  // Appends levels[k] of the marked tree as a level of sizes[k] blocks without
+  // its pruned blocks, i.e., the blocks whose pointer is pruned. A pointer is
+  // mapped to the position of its target on the new level, which is the number
+  // of blocks in front of the target that have not been pruned. The levels are
+  // compacted in parallel.
+  template <typename level_vector>
+  int32_t append_compacted_levels(
+      std::vector<pasta::BitVector *> const &marked_tree,
+      std::vector<level_vector> const &pointer,
+      std::vector<level_vector> const &offset,
+      std::vector<int64_t> const &levels, std::vector<int64_t> const &sizes,
+      std::vector<int64_t> const &block_size_lvl, size_type pruned,
+      int32_t threads) {
+    int64_t count = levels.size();
+    std::vector<pasta::BitVector *> types(count);
+    std::vector<pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES> *> ranks(
+        count);
+    std::vector<sdsl::int_vector<> *> pointers(count);
+    std::vector<sdsl::int_vector<> *> offsets(count);
+    omp_set_num_threads(threads);
+#pragma omp parallel for default(none) schedule(dynamic, 1)                    \
+    shared(marked_tree, pointer, offset, levels, sizes, pruned, count, types,  \
+               ranks, pointers, offsets)
+    for (int64_t k = 0; k < count; k++) {
+      auto &marked = *marked_tree[levels[k]];
+      auto const &lvl_ptr = pointer[levels[k]];
+      auto const &lvl_off = offset[levels[k]];
+      int64_t size = marked.size();
+      pasta::BitVector kept(size, 0);
+      int64_t unmarked = 0;
+      for (int64_t j = 0; j < size; j++) {
+        if (lvl_ptr[j] != pruned) {
+          kept[j] = 1;
+          unmarked += !marked[j];
+        }
+      }
+      pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES> kept_rs(kept);
+      auto *bv = new pasta::BitVector(sizes[k], 0);
+      auto *p = new sdsl::int_vector<>(unmarked, 0);
+      auto *o = new sdsl::int_vector<>(unmarked, 0);
+      int64_t c = 0;
+      int64_t c_u = 0;
+      for (int64_t j = 0; j < size; j++) {
+        if (kept[j]) {
+          (*bv)[c] = (bool)marked[j];
+          if (!marked[j]) {
+            (*p)[c_u] = kept_rs.rank1(lvl_ptr[j]);
+            (*o)[c_u] = lvl_off[j];
+            c_u++;
+          }
+          c++;
+        }
+      }
+      sdsl::util::bit_compress(*p);
+      sdsl::util::bit_compress(*o);
+      types[k] = bv;
+      ranks[k] = new pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>(*bv);
+      pointers[k] = p;
+      offsets[k] = o;
+    }
+    for (int64_t k = 0; k < count; k++) {
+      block_tree_types_.emplace_back(types[k]);
+      block_tree_types_rs_.emplace_back(ranks[k]);
+      block_tree_pointers_.emplace_back(pointers[k]);
+      block_tree_offsets_.emplace_back(offsets[k]);
+      block_size_lvl_.push_back(block_size_lvl[levels[k]]);
+    }
+    return 0;
+  }
+
+  // Code of character c in compressed_leaves_.
+  uint64_t leaf_code(input_type c) const {
+    if constexpr (sizeof(input_type) == 1) {
+      return compress_map_[static_cast<uint8_t>(c)];
+    } else {
+      return std::lower_bound(decompress_map_.begin(), decompress_map_.end(),
+                              c) -
+             decompress_map_.begin();
+    }
+  }
+
+  // Number of occurrences of code in compressed_leaves_[begin, end). Leaves
+  // with one or two bits per character, e.g., bit vectors or DNA, are counted
+  // a word at a time.
+  uint64_t count_leaf_code(uint64_t begin, uint64_t end, uint64_t code) const {
+    if (begin >= end) {
+      return 0;
+    }
+    uint64_t result = 0;
+    uint64_t const width = compressed_leaves_.width();
+    if (width > 2) {
+      for (uint64_t k = begin; k < end; k++) {
+        result += compressed_leaves_[k] == code;
+      }
+      return result;
+    }
+    uint64_t const per_word = 64 / width;
+    uint64_t const *data = compressed_leaves_.data();
+    uint64_t first = begin / per_word;
+    uint64_t last = (end - 1) / per_word;
+    for (uint64_t k = first; k <= last; k++) {
+      uint64_t matches = match_codes(data[k], code, width);
+      if (k == first) {
+        matches &= ~0ULL << (width * (begin % per_word));
+      }
+      if (k == last && end % per_word != 0) {
+        matches &= (1ULL << (width * (end % per_word))) - 1;
+      }
+      result += std::popcount(matches);
+    }
+    return result;
+  }
+
+  // Length of the shortest prefix of the leaves starting at begin that
+  // contains j occurrences of code.
+  uint64_t select_leaf_code(uint64_t begin, uint64_t j, uint64_t code) const {
+    if (j == 0) {
+      return 0;
+    }
+    uint64_t const width = compressed_leaves_.width();
+    if (width > 2) {
+      uint64_t k = begin;
+      while (j > 0) {
+        j -= compressed_leaves_[k++] == code;
+      }
+      return k - begin;
+    }
+    uint64_t const per_word = 64 / width;
+    uint64_t const *data = compressed_leaves_.data();
+    uint64_t k = begin / per_word;
+    uint64_t matches = match_codes(data[k], code, width) &
+                       (~0ULL << (width * (begin % per_word)));
+    for (uint64_t count; (count = std::popcount(matches)) < j;) {
+      j -= count;
+      matches = match_codes(data[++k], code, width);
+    }
+    return per_word * k + select_in_word(matches, j) / width + 1 - begin;
+  }
+
+  // Sets the lowest bit of each code of the given width (one or two bits) in
+  // word that is equal to code.
+  static uint64_t match_codes(uint64_t word, uint64_t code, uint64_t width) {
+    if (width == 1) {
+      return (code == 0) ? ~word : word;
+    }
+    uint64_t x = word ^ (code * 0x5555555555555555ULL);
+    return ~(x | (x >> 1)) & 0x5555555555555555ULL;
+  }
+
+  // Position of the j-th set bit of word, which has at least j set bits.
+  static uint64_t select_in_word(uint64_t word, uint64_t j) {
+#if defined(__BMI2__)
+    return std::countr_zero(_pdep_u64(1ULL << (j - 1), word));
+#else
+    for (; j > 1; j--) {
+      word &= word - 1;
+    }
+    return std::countr_zero(word);
+#endif
+  }
+
+  void compress_leaves() {
+    if constexpr (sizeof(input_type) == 1) {
+      compress_map_.resize(256, 0);
+      decompress_map_.resize(256, 0);
+      for (size_t i = 0; i < this->leaves_.size(); ++i) {
+        compress_map_[this->leaves_[i]] = 1;
+      }
+      for (size_t i = 0, cur_val = 0; i < this->compress_map_.size(); ++i) {
+        size_t tmp = compress_map_[i];
+        compress_map_[i] = cur_val;
+        decompress_map_[cur_val] = i;
+        cur_val += tmp;
+      }
+    } else {
+      decompress_map_ = leaves_;
+      std::sort(decompress_map_.begin(), decompress_map_.end());
+      decompress_map_.erase(
+          std::unique(decompress_map_.begin(), decompress_map_.end()),
+          decompress_map_.end());
     }
 
     compressed_leaves_.resize(this->leaves_.size());
     for (size_t i = 0; i < this->leaves_.size(); ++i) {
-      compressed_leaves_[i] = compress_map_[this->leaves_[i]];
+      compressed_leaves_[i] = leaf_code(this->leaves_[i]);
     }
     sdsl::util::bit_compress(this->compressed_leaves_);
     leaves_.resize(0);
     leaves_.shrink_to_fit();
   }
 
-  int32_t add_rank_support() {
+  // Stores the leaves, i.e., the children of the marked blocks of the last
+  // level, in compressed_leaves_. starts contains the text positions of the
+  // blocks of the last level. The position of a leaf block follows from the
+  // number of marked blocks in front of it, hence the codes are written in
+  // parallel directly into compressed_leaves_. Each thread writes whole words
+  // since the chunks of codes begin at multiples of 64.
+  template <typename text_type, typename start_vector>
+  int32_t compress_leaves(text_type const &text,
+                          pasta::BitVector const &last_level,
+                          start_vector const &starts, int32_t threads) {
+    int64_t n = text.size();
+    int64_t blocks = last_level.size();
+    int64_t length = leaf_size * tau_;
+    // position of the first character of each block among all leaves
+    std::vector<int64_t> leaf_starts(blocks + 1, 0);
+    omp_set_num_threads(threads);
+#pragma omp parallel for default(none)                                         \
+    shared(last_level, starts, leaf_starts, n, blocks, length)
+    for (int64_t i = 0; i < blocks; i++) {
+      if (last_level[i] == 1) {
+        leaf_starts[i] = std::min(length, n - starts[i]);
+      }
+    }
+    int64_t total = exclusive_prefix_sum(leaf_starts, threads);
+    amount_of_leaves = 0;
+    for (int64_t i = 0; i < blocks; i++) {
+      amount_of_leaves += (last_level[i] == 1) ? tau_ : 0;
+    }
+
+    size_t codes = 0;
+    if constexpr (sizeof(input_type) == 1) {
+      std::vector<uint8_t> used(256, 0);
+      omp_set_num_threads(threads);
+#pragma omp parallel default(none)                                             \
+    shared(text, last_level, starts, leaf_starts, used, blocks)
+      {
+        std::vector<uint8_t> local_used(256, 0);
+#pragma omp for
+        for (int64_t i = 0; i < blocks; i++) {
+          int64_t begin = starts[i];
+          int64_t end = begin + leaf_starts[i + 1] - leaf_starts[i];
+          for (int64_t j = begin; j < end; j++) {
+            local_used[static_cast<uint8_t>(text[j])] = 1;
+          }
+        }
+#pragma omp critical
+        for (size_t c = 0; c < used.size(); c++) {
+          used[c] |= local_used[c];
+        }
+      }
+      compress_map_.assign(256, 0);
+      decompress_map_.assign(256, 0);
+      for (size_t c = 0; c < used.size(); c++) {
+        compress_map_[c] = codes;
+        decompress_map_[codes] = c;
+        codes += used[c];
+      }
+    } else {
+      // each character of the text occurs in a leaf, since all blocks refer
+      // to leaves in the end
+      decompress_map_ = chars_;
+      std::sort(decompress_map_.begin(), decompress_map_.end());
+      codes = decompress_map_.size();
+    }
+
+    uint8_t width = (codes <= 1) ? 1 : sdsl::bits::hi(codes - 1) + 1;
+    compressed_leaves_ = sdsl::int_vector<>(total, 0, width);
+    int64_t chunk_size = 64 * 1024;
+    int64_t chunks = (total + chunk_size - 1) / chunk_size;
+    omp_set_num_threads(threads);
+#pragma omp parallel for default(none)                                         \
+    shared(text, starts, leaf_starts, total, chunk_size, chunks)
+    for (int64_t c = 0; c < chunks; c++) {
+      int64_t begin = c * chunk_size;
+      int64_t end = std::min(total, begin + chunk_size);
+      // last block that begins at or before the first code of the chunk
+      int64_t i = std::upper_bound(leaf_starts.begin(), leaf_starts.end(),
+                                   begin) -
+                  leaf_starts.begin() - 1;
+      for (int64_t k = begin; k < end; i++) {
+        int64_t block_end = std::min(end, leaf_starts[i + 1]);
+        for (int64_t j = starts[i] + (k - leaf_starts[i]); k < block_end;
+             j++, k++) {
+          compressed_leaves_[k] = leaf_code(text[j]);
+        }
+      }
+    }
+    leaves_.clear();
+    leaves_.shrink_to_fit();
+    return 0;
+  }
+
+  int32_t add_rank_support() { return add_rank_support(chars_); }
+
+  // Adds rank and select support for the given characters of the text only,
+  // e.g., only for the ones of a bit vector. Queries for other characters are
+  // not supported. Returns 0 on success and -1 if a character does not occur
+  // in the text, in which case the tree is not changed.
+  int32_t add_rank_support(std::vector<input_type> const &chars) {
+    for (auto c : chars) {
+      if (chars_index_.find(c) == chars_index_.end()) {
+        return -1;
+      }
+    }
+    ProfilePhase phase("add_rank_support");
     rank_support = true;
     c_ranks_.resize(chars_.size(), std::vector<sdsl::int_vector<0>>());
     pointer_c_ranks_.resize(chars_.size(), std::vector<sdsl::int_vector<0>>());
-    for (uint64_t i = 0; i < c_ranks_.size(); i++) {
-      c_ranks_[i].resize(block_tree_types_.size(), sdsl::int_vector<0>());
-      for (uint64_t j = 0; j < c_ranks_[i].size(); j++) {
-        c_ranks_[i][j].resize(block_tree_types_[j]->size());
+    for (auto c : chars) {
+      auto &ranks = c_ranks_[chars_index_[c]];
+      ranks.resize(block_tree_types_.size(), sdsl::int_vector<0>());
+      for (uint64_t j = 0; j < ranks.size(); j++) {
+        ranks[j].resize(block_tree_types_[j]->size());
       }
-    }
-    for (uint64_t i = 0; i < pointer_c_ranks_.size(); i++) {
-      pointer_c_ranks_[i].resize(block_tree_pointers_.size(),
-                                 sdsl::int_vector<0>());
-      for (uint64_t j = 0; j < pointer_c_ranks_[i].size(); j++) {
-        pointer_c_ranks_[i][j].resize(block_tree_pointers_[j]->size());
+      auto &pointer_ranks = pointer_c_ranks_[chars_index_[c]];
+      pointer_ranks.resize(block_tree_pointers_.size(), sdsl::int_vector<0>());
+      for (uint64_t j = 0; j < pointer_ranks.size(); j++) {
+        pointer_ranks[j].resize(block_tree_pointers_[j]->size());
       }
     }
-    for (auto c : chars_) {
+    for (auto c : chars) {
       for (uint64_t i = 0; i < block_tree_types_[0]->size(); i++) {
         rank_block(c, 0, i);
       }
@@ -474,6 +1035,7 @@ public:
   }
 
   int32_t add_rank_support_omp(int32_t threads) {
+    ProfilePhase phase("add_rank_support", -1, threads);
     rank_support = true;
     c_ranks_.resize(chars_.size(), std::vector<sdsl::int_vector<0>>());
     pointer_c_ranks_.resize(chars_.size(), std::vector<sdsl::int_vector<0>>());
@@ -528,6 +1090,112 @@ public:
     return 0;
   }
 
+  // Version of the binary format written by serialize().
+  static constexpr uint32_t SERIALIZATION_VERSION = 1;
+
+  // Writes the tree in a binary format that load() reads. The rank and select
+  // support of the levels is not written but rebuilt by load(). Returns 0 on
+  // success and -1 if the stream failed.
+  int32_t serialize(std::ostream &out) const {
+    write_value(out, SERIALIZATION_MAGIC);
+    write_value(out, SERIALIZATION_VERSION);
+    write_value(out, static_cast<uint32_t>(sizeof(input_type)));
+    write_value(out, static_cast<uint32_t>(sizeof(size_type)));
+    write_value(out, CUT_FIRST_LEVELS);
+    write_value(out, tau_);
+    write_value(out, max_leaf_length_);
+    write_value(out, s_);
+    write_value(out, leaf_size);
+    write_value(out, amount_of_leaves);
+    write_value(out, rank_support);
+    write_vector(out, block_size_lvl_);
+    write_vector(out, block_per_lvl_);
+    write_vector(out, compress_map_);
+    write_vector(out, decompress_map_);
+    write_vector(out, chars_);
+    write_value(out, static_cast<uint64_t>(block_tree_types_.size()));
+    for (uint64_t i = 0; i < block_tree_types_.size(); i++) {
+      auto const &bv = *block_tree_types_[i];
+      uint64_t const words = (bv.size() + 63) / 64;
+      write_value(out, static_cast<uint64_t>(bv.size()));
+      write_value(out, words);
+      out.write(reinterpret_cast<char const *>(bv.data().data()),
+                words * sizeof(uint64_t));
+      block_tree_pointers_[i]->serialize(out);
+      block_tree_offsets_[i]->serialize(out);
+    }
+    compressed_leaves_.serialize(out);
+    write_value(out, static_cast<uint64_t>(top_level_c_ranks_.size()));
+    for (auto const &ranks : top_level_c_ranks_) {
+      write_vector(out, ranks);
+    }
+    for (auto const *ranks : {&c_ranks_, &pointer_c_ranks_}) {
+      write_value(out, static_cast<uint64_t>(ranks->size()));
+      for (auto const &per_char : *ranks) {
+        write_value(out, static_cast<uint64_t>(per_char.size()));
+        for (auto const &lvl : per_char) {
+          lvl.serialize(out);
+        }
+      }
+    }
+    return out.good() ? 0 : -1;
+  }
+
+  // Replaces this tree by a tree written with serialize(). The rank and select
+  // support of the levels is rebuilt with the given number of threads. Returns
+  // 0 on success and -1 if the stream failed, is corrupt or does not contain a
+  // tree with the same input_type, size_type and format version, in which case
+  // the tree is empty.
+  int32_t load(std::istream &in, int32_t threads = 1) {
+    int32_t result = -1;
+    try {
+      result = load_levels(in);
+    } catch (std::exception const &) {
+      // lengths inside the int vectors are not checked before they allocate
+      result = -1;
+    }
+    if (result != 0) {
+      clear_levels();
+      clear_alphabet();
+      return -1;
+    }
+    for (uint64_t i = 0; i < chars_.size(); i++) {
+      chars_index_[chars_[i]] = i;
+    }
+    u_chars_ = chars_.size();
+    // the rank and select support of the levels is independent of each other
+    block_tree_types_rs_.resize(block_tree_types_.size());
+    auto &types = block_tree_types_;
+    auto &types_rs = block_tree_types_rs_;
+    int64_t level_count = types.size();
+    omp_set_num_threads(std::max<int32_t>(1, threads));
+#pragma omp parallel for default(none) shared(types, types_rs, level_count)
+    for (int64_t i = 0; i < level_count; i++) {
+      types_rs[i] =
+          std::make_unique<pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>>(
+              *types[i]);
+    }
+    return 0;
+  }
+
+  // Deletes all levels and the leaves, the alphabet and the rank directories
+  // are kept.
+  void clear_levels() {
+    // the rank and select structures refer to the bit vectors
+    this->block_tree_types_rs_.clear();
+    this->block_tree_types_.clear();
+    this->block_tree_pointers_.clear();
+    this->block_tree_offsets_.clear();
+    this->block_size_lvl_.clear();
+    this->block_per_lvl_.clear();
+    this->leaves_.clear();
+    this->compress_map_.clear();
+    this->decompress_map_.clear();
+    this->compressed_leaves_ = sdsl::int_vector<>();
+    this->leaf_size = 0;
+    this->amount_of_leaves = 0;
+  }
+
   inline size_type leading_zeros(int32_t val) {
     return __builtin_clz(static_cast<unsigned int>(val) | 1);
   }
@@ -639,19 +1307,14 @@ public:
     }
     //        size_type x = leaves_.size() - leaf_index * this->tau_;
     //        i = std::min(i, x);
-    size_type result = 0;
-    for (size_type ind = 0; ind < i; ind++) {
-      if (compressed_leaves_[leaf_index * leaf_size + ind] ==
-          compress_map_[c]) {
-        result++;
-      }
-    }
-    return result;
+    uint64_t begin = leaf_index * leaf_size;
+    return count_leaf_code(begin, begin + i, leaf_code(c));
   }
 
-  size_type map_unique_chars(std::vector<input_type> &text) {
+  template <typename text_type>
+  size_type map_unique_chars(text_type const &text) {
     this->u_chars_ = 0;
-    input_type i = 0;
+    size_type i = 0;
     for (auto a : text) {
       if (chars_index_.find(a) == chars_index_.end()) {
         chars_index_[a] = i;
@@ -661,10 +1324,10 @@ public:
     }
     this->u_chars_ = i;
     return 0;
-  };
-  size_type
-  find_next_smallest_index_binary_search(size_type i,
-                                         std::vector<int64_t> &pVector) {
+  }
+  template <typename start_vector>
+  size_type find_next_smallest_index_binary_search(size_type i,
+                                                   start_vector &pVector) {
     int64_t l = 0;
     int64_t r = pVector.size();
     while (l < r) {
@@ -676,7 +1339,7 @@ public:
       }
     }
     return r - 1;
-  };
+  }
   int64_t
   find_next_smallest_index_linear_scan(size_type i,
                                        std::vector<size_type> &pVector) {
@@ -707,6 +1370,137 @@ public:
     }
     return blk_pointer;
   };
+
+private:
+  // Reads everything written by serialize() except the rank and select support
+  // of the levels. Returns 0 on success and -1 otherwise.
+  int32_t load_levels(std::istream &in) {
+    clear_levels();
+    clear_alphabet();
+    uint64_t magic = 0;
+    uint32_t version = 0;
+    uint32_t input_bytes = 0;
+    uint32_t size_bytes = 0;
+    read_value(in, magic);
+    read_value(in, version);
+    read_value(in, input_bytes);
+    read_value(in, size_bytes);
+    if (!in.good() || magic != SERIALIZATION_MAGIC ||
+        version != SERIALIZATION_VERSION || input_bytes != sizeof(input_type) ||
+        size_bytes != sizeof(size_type)) {
+      return -1;
+    }
+    read_value(in, CUT_FIRST_LEVELS);
+    read_value(in, tau_);
+    read_value(in, max_leaf_length_);
+    read_value(in, s_);
+    read_value(in, leaf_size);
+    read_value(in, amount_of_leaves);
+    read_value(in, rank_support);
+    read_vector(in, block_size_lvl_);
+    read_vector(in, block_per_lvl_);
+    read_vector(in, compress_map_);
+    read_vector(in, decompress_map_);
+    read_vector(in, chars_);
+    // every level starts with the sizes of its bit vector
+    uint64_t const levels = read_length(in, 2 * sizeof(uint64_t));
+    for (uint64_t i = 0; i < levels && in.good(); i++) {
+      uint64_t size = 0;
+      read_value(in, size);
+      uint64_t const words = read_length(in, sizeof(uint64_t));
+      if (!in.good() || words != size / 64 + (size % 64 != 0)) {
+        return -1;
+      }
+      auto *bv = new pasta::BitVector(size);
+      block_tree_types_.emplace_back(bv);
+      in.read(reinterpret_cast<char *>(bv->data().data()),
+              words * sizeof(uint64_t));
+      block_tree_pointers_.emplace_back(new sdsl::int_vector<>());
+      block_tree_pointers_.back()->load(in);
+      block_tree_offsets_.emplace_back(new sdsl::int_vector<>());
+      block_tree_offsets_.back()->load(in);
+    }
+    compressed_leaves_.load(in);
+    top_level_c_ranks_.resize(read_length(in, sizeof(uint64_t)));
+    for (auto &ranks : top_level_c_ranks_) {
+      read_vector(in, ranks);
+    }
+    for (auto *ranks : {&c_ranks_, &pointer_c_ranks_}) {
+      ranks->resize(read_length(in, sizeof(uint64_t)));
+      for (auto &per_char : *ranks) {
+        per_char.resize(read_length(in, sizeof(uint64_t)));
+        for (auto &lvl : per_char) {
+          lvl.load(in);
+        }
+      }
+    }
+    return in.good() ? 0 : -1;
+  }
+
+  // Deletes the alphabet and the rank directories.
+  void clear_alphabet() {
+    chars_.clear();
+    chars_index_.clear();
+    u_chars_ = 0;
+    top_level_c_ranks_.clear();
+    c_ranks_.clear();
+    pointer_c_ranks_.clear();
+  }
+
+  // "PBTREE" followed by two zero bytes
+  static constexpr uint64_t SERIALIZATION_MAGIC = 0x0000454552544250ULL;
+  // sanity limit for the lengths read from streams that cannot seek
+  static constexpr uint64_t MAX_UNSEEKABLE_BYTES = uint64_t{1} << 40;
+
+  template <typename T> static void write_value(std::ostream &out, T value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    out.write(reinterpret_cast<char const *>(&value), sizeof(T));
+  }
+
+  template <typename T>
+  static void write_vector(std::ostream &out, std::vector<T> const &values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    write_value(out, static_cast<uint64_t>(values.size()));
+    out.write(reinterpret_cast<char const *>(values.data()),
+              values.size() * sizeof(T));
+  }
+
+  template <typename T> static void read_value(std::istream &in, T &value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    in.read(reinterpret_cast<char *>(&value), sizeof(T));
+  }
+
+  // Bytes left in the stream. Streams that cannot seek are limited to
+  // MAX_UNSEEKABLE_BYTES.
+  static uint64_t remaining_bytes(std::istream &in) {
+    auto const pos = in.tellg();
+    if (pos < 0) {
+      in.clear(in.rdstate() & ~std::ios::failbit);
+      return MAX_UNSEEKABLE_BYTES;
+    }
+    in.seekg(0, std::ios::end);
+    auto const end = in.tellg();
+    in.seekg(pos);
+    return end > pos ? static_cast<uint64_t>(end - pos) : 0;
+  }
+
+  // Reads the length of a sequence of elements that take at least
+  // element_bytes bytes each. Returns 0 and fails the stream if they do not
+  // fit into the rest of the stream.
+  static uint64_t read_length(std::istream &in, uint64_t element_bytes) {
+    uint64_t length = 0;
+    read_value(in, length);
+    if (in.good() && length > remaining_bytes(in) / element_bytes) {
+      in.setstate(std::ios::failbit);
+    }
+    return in.good() ? length : 0;
+  }
+
+  template <typename T>
+  static void read_vector(std::istream &in, std::vector<T> &values) {
+    values.resize(read_length(in, sizeof(T)));
+    in.read(reinterpret_cast<char *>(values.data()), values.size() * sizeof(T));
+  }
 };
 
 } // namespace pasta
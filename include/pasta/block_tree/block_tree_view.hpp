@@ -0,0 +1,767 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include "pasta/block_tree/block_tree.hpp"
+#include "pasta/block_tree/utils/placement.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace pasta {
+
+// Zero-copy block tree format. A file consists of a 64 byte header, a
+// directory with the file offset of each section and the sections, each of
+// which starts at a multiple of 64 bytes. All references are offsets, hence
+// the file can be mapped anywhere and shared by all processes that map it.
+//
+// Sections (in directory order):
+//   block sizes of the levels (int64_t each)
+//   compress map (256 bytes), decompress map (256 bytes) and the index of each
+//   character in the rank directories (256 int32_t, -1 if it does not occur)
+//   for each level: bits, pointers and offsets
+//   leaves
+//   if the tree has rank support: c_ranks and pointer_c_ranks of each
+//   character and level (character major)
+//
+// A bit section has a 64 byte header (number of bits, words and samples)
+// followed by the words and the number of ones in front of each 512 bits. A
+// packed section has a 64 byte header (number of values and their width)
+// followed by the values with width bits each.
+struct BlockTreeViewHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t input_bytes;
+  uint32_t size_bytes;
+  uint32_t rank_support;
+  int64_t tau;
+  int64_t leaf_size;
+  uint64_t levels;
+  uint64_t chars;
+  uint64_t file_bytes;
+};
+static_assert(sizeof(BlockTreeViewHeader) == 64);
+
+// "PBTVIEW" followed by a zero byte
+constexpr uint64_t BLOCK_TREE_VIEW_MAGIC = 0x0057454956544250ULL;
+constexpr uint32_t BLOCK_TREE_VIEW_VERSION = 1;
+
+// Bits of a level with the samples for rank queries.
+class BitView {
+public:
+  uint64_t const *words_ = nullptr;
+  uint64_t const *samples_ = nullptr;
+  uint64_t size_ = 0;
+
+  bool operator[](uint64_t i) const { return (words_[i >> 6] >> (i & 63)) & 1; }
+
+  uint64_t size() const { return size_; }
+
+  // number of ones in [0, i)
+  uint64_t rank1(uint64_t i) const {
+    uint64_t rank = samples_[i >> 9];
+    for (uint64_t w = (i >> 9) << 3; w < (i >> 6); w++) {
+      rank += std::popcount(words_[w]);
+    }
+    if ((i & 63) != 0) {
+      rank += std::popcount(words_[i >> 6] & ((1ULL << (i & 63)) - 1));
+    }
+    return rank;
+  }
+
+  uint64_t rank0(uint64_t i) const { return i - rank1(i); }
+};
+
+// Values with width bits each.
+class PackedView {
+public:
+  uint64_t const *words_ = nullptr;
+  uint64_t size_ = 0;
+  uint64_t width_ = 0;
+
+  uint64_t operator[](uint64_t i) const {
+    if (width_ == 0) {
+      return 0;
+    }
+    uint64_t bit = i * width_;
+    uint64_t shift = bit & 63;
+    uint64_t value = words_[bit >> 6] >> shift;
+    if (shift + width_ > 64) {
+      value |= words_[(bit >> 6) + 1] << (64 - shift);
+    }
+    return (width_ == 64) ? value : value & ((1ULL << width_) - 1);
+  }
+
+  uint64_t size() const { return size_; }
+};
+
+// Writes a block tree in the zero-copy format. Returns 0 on success and -1 if
+// the stream failed.
+template <typename input_type, typename size_type>
+int32_t write_block_tree_view(BlockTree<input_type, size_type> const &bt,
+                              std::ostream &out) {
+  static_assert(sizeof(input_type) == 1,
+                "the zero-copy format supports byte alphabets");
+  auto align = [](uint64_t bytes) { return (bytes + 63) / 64 * 64; };
+  auto bit_bytes = [&](uint64_t size) {
+    uint64_t words = (size + 63) / 64;
+    return 64 + align(words * 8 + (words / 8 + 1) * 8);
+  };
+  auto packed_width = [](auto const &iv) {
+    uint64_t max = 0;
+    for (uint64_t i = 0; i < iv.size(); i++) {
+      max = std::max<uint64_t>(max, iv[i]);
+    }
+    return static_cast<uint64_t>(std::bit_width(max));
+  };
+  auto packed_bytes = [&](uint64_t size, uint64_t width) {
+    return 64 + align((size * width + 63) / 64 * 8 + 8);
+  };
+
+  uint64_t levels = bt.block_tree_types_.size();
+  // the view supports rank and select only if the tree does for all characters
+  bool rank_support =
+      bt.rank_support &&
+      std::none_of(bt.c_ranks_.begin(), bt.c_ranks_.end(),
+                   [](auto const &ranks) { return ranks.empty(); });
+  uint64_t chars = rank_support ? bt.c_ranks_.size() : 0;
+  // sizes of all sections in directory order
+  std::vector<uint64_t> sizes;
+  std::vector<uint64_t> widths;
+  sizes.push_back(align(levels * 8));
+  sizes.push_back(align(256 + 256 + 256 * 4));
+  auto add_packed = [&](auto const &iv) {
+    widths.push_back(packed_width(iv));
+    sizes.push_back(packed_bytes(iv.size(), widths.back()));
+  };
+  for (uint64_t i = 0; i < levels; i++) {
+    sizes.push_back(bit_bytes(bt.block_tree_types_[i]->size()));
+    add_packed(*bt.block_tree_pointers_[i]);
+    add_packed(*bt.block_tree_offsets_[i]);
+  }
+  add_packed(bt.compressed_leaves_);
+  for (auto const *ranks : {&bt.c_ranks_, &bt.pointer_c_ranks_}) {
+    for (uint64_t c = 0; c < chars; c++) {
+      for (uint64_t i = 0; i < levels; i++) {
+        add_packed((*ranks)[c][i]);
+      }
+    }
+  }
+
+  BlockTreeViewHeader header{};
+  header.magic = BLOCK_TREE_VIEW_MAGIC;
+  header.version = BLOCK_TREE_VIEW_VERSION;
+  header.input_bytes = sizeof(input_type);
+  header.size_bytes = sizeof(size_type);
+  header.rank_support = rank_support;
+  header.tau = bt.tau_;
+  header.leaf_size = bt.leaf_size;
+  header.levels = levels;
+  header.chars = chars;
+  std::vector<uint64_t> directory(sizes.size());
+  uint64_t offset = 64 + align(sizes.size() * 8);
+  for (uint64_t k = 0; k < sizes.size(); k++) {
+    directory[k] = offset;
+    offset += sizes[k];
+  }
+  header.file_bytes = offset;
+
+  uint64_t written = 0;
+  auto write = [&](void const *data, uint64_t bytes) {
+    out.write(static_cast<char const *>(data), bytes);
+    written += bytes;
+  };
+  auto pad = [&]() {
+    static char const zeros[64] = {};
+    write(zeros, align(written) - written);
+  };
+  auto write_packed = [&](auto const &iv, uint64_t width) {
+    uint64_t section[8] = {iv.size(), width};
+    write(section, sizeof(section));
+    uint64_t word = 0;
+    uint64_t used = 0;
+    for (uint64_t i = 0; i < iv.size(); i++) {
+      uint64_t value = iv[i];
+      word |= (used < 64) ? value << used : 0;
+      used += width;
+      if (used >= 64) {
+        write(&word, 8);
+        used -= 64;
+        word = (used > 0) ? value >> (width - used) : 0;
+      }
+    }
+    if (used > 0) {
+      write(&word, 8);
+    }
+    // one more word since values are read with two words at the end
+    uint64_t zero = 0;
+    write(&zero, 8);
+    pad();
+  };
+
+  write(&header, sizeof(header));
+  write(directory.data(), directory.size() * 8);
+  pad();
+  write(bt.block_size_lvl_.data(), levels * 8);
+  pad();
+  std::vector<uint8_t> compress_map(256, 0);
+  std::vector<uint8_t> decompress_map(256, 0);
+  std::copy_n(bt.compress_map_.begin(),
+              std::min<size_t>(256, bt.compress_map_.size()),
+              compress_map.begin());
+  std::copy_n(bt.decompress_map_.begin(),
+              std::min<size_t>(256, bt.decompress_map_.size()),
+              decompress_map.begin());
+  std::vector<int32_t> char_index(256, -1);
+  for (auto [c, index] : bt.chars_index_) {
+    char_index[static_cast<uint8_t>(c)] = index;
+  }
+  write(compress_map.data(), 256);
+  write(decompress_map.data(), 256);
+  write(char_index.data(), 256 * 4);
+  pad();
+  size_t next_width = 0;
+  for (uint64_t i = 0; i < levels; i++) {
+    auto words = bt.block_tree_types_[i]->data();
+    uint64_t size = bt.block_tree_types_[i]->size();
+    uint64_t word_count = (size + 63) / 64;
+    uint64_t section[8] = {size, word_count, word_count / 8 + 1};
+    write(section, sizeof(section));
+    std::vector<uint64_t> level_words(word_count, 0);
+    std::copy_n(words.begin(), std::min<uint64_t>(word_count, words.size()),
+                level_words.begin());
+    if (size % 64 != 0) {
+      level_words.back() &= (1ULL << (size % 64)) - 1;
+    }
+    write(level_words.data(), word_count * 8);
+    uint64_t ones = 0;
+    for (uint64_t w = 0; w < word_count; w++) {
+      if (w % 8 == 0) {
+        write(&ones, 8);
+      }
+      ones += std::popcount(level_words[w]);
+    }
+    if (word_count % 8 == 0) {
+      write(&ones, 8);
+    }
+    pad();
+    write_packed(*bt.block_tree_pointers_[i], widths[next_width++]);
+    write_packed(*bt.block_tree_offsets_[i], widths[next_width++]);
+  }
+  write_packed(bt.compressed_leaves_, widths[next_width++]);
+  for (auto const *ranks : {&bt.c_ranks_, &bt.pointer_c_ranks_}) {
+    for (uint64_t c = 0; c < chars; c++) {
+      for (uint64_t i = 0; i < levels; i++) {
+        write_packed((*ranks)[c][i], widths[next_width++]);
+      }
+    }
+  }
+  return (out.good() && written == header.file_bytes) ? 0 : -1;
+}
+
+// Read-only block tree that answers queries directly on the zero-copy format,
+// either in a memory mapped file or in a buffer that outlives the view. The
+// queries duplicate those of BlockTree without the query statistics, since
+// the levels of BlockTree are not stored in views of the sections.
+template <typename input_type> class BlockTreeView {
+public:
+  BlockTreeView() = default;
+  BlockTreeView(BlockTreeView const &) = delete;
+  BlockTreeView &operator=(BlockTreeView const &) = delete;
+
+  ~BlockTreeView() { close(); }
+
+  // Maps the file read-only and shared. Returns 0 on success and -1 if the
+  // file cannot be mapped or is not a valid block tree.
+  int32_t open(std::string const &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      return -1;
+    }
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      return -1;
+    }
+    memory_ = PlacedMemory{data, static_cast<uint64_t>(st.st_size)};
+    if (attach(data, st.st_size) != 0) {
+      close();
+      return -1;
+    }
+    return 0;
+  }
+
+  // Reads the file into private memory that is backed by the given pages and
+  // placed on the NUMA nodes (node is only used if the mode is REPLICATE).
+  // Returns 0 on success and -1 if the file cannot be read or is not a valid
+  // block tree.
+  int32_t load(std::string const &path,
+               PageMode pages = PageMode::TRANSPARENT_HUGE,
+               NumaMode numa = NumaMode::LOCAL,
+               int32_t node = 0) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      return -1;
+    }
+    uint64_t bytes = st.st_size;
+    memory_ = allocate_placed(bytes, pages, numa, node);
+    auto *data = static_cast<char *>(memory_.data);
+    uint64_t read_bytes = 0;
+    while (data != nullptr && read_bytes < bytes) {
+      ssize_t n = pread(fd, data + read_bytes,
+                        std::min<uint64_t>(bytes - read_bytes, 1ULL << 30),
+                        read_bytes);
+      if (n <= 0) {
+        break;
+      }
+      read_bytes += n;
+    }
+    ::close(fd);
+    if (read_bytes != bytes || attach(data, bytes) != 0) {
+      close();
+      return -1;
+    }
+    mprotect(memory_.data, memory_.bytes, PROT_READ);
+    return 0;
+  }
+
+  // Uses a buffer with the zero-copy format that is aligned to 64 bits.
+  // Returns 0 on success and -1 if it is not a valid block tree. The header,
+  // the directory and the size of each section are checked against the buffer,
+  // the values within the sections are not.
+  int32_t attach(void const *data, uint64_t bytes) {
+    clear_sections();
+    if (attach_sections(static_cast<char const *>(data), bytes) != 0) {
+      clear_sections();
+      return -1;
+    }
+    return 0;
+  }
+
+  void close() {
+    free_placed(memory_);
+    clear_sections();
+  }
+
+  bool rank_support() const { return header_.rank_support != 0; }
+
+  // Pages that back the tree if it was loaded, SMALL otherwise.
+  PageMode pages() const { return memory_.pages; }
+
+  int64_t access(int64_t index) const {
+    int64_t block_size = block_size_lvl_[0];
+    int64_t blk_pointer = index / block_size;
+    int64_t off = index % block_size;
+    int64_t child;
+    for (uint64_t i = 0; i < levels_.size(); i++) {
+      auto const &lvl = levels_[i];
+      if (!lvl[blk_pointer]) {
+        int64_t blk = lvl.rank0(blk_pointer);
+        off = off + offsets_[i][blk];
+        blk_pointer = pointers_[i][blk];
+        if (off >= block_size) {
+          blk_pointer++;
+          off -= block_size;
+        }
+      }
+      block_size /= tau_;
+      child = off / block_size;
+      off = off % block_size;
+      blk_pointer = lvl.rank1(blk_pointer) * tau_ + child;
+    }
+    return decompress_map_[leaves_[blk_pointer * leaf_size_ + off]];
+  }
+
+  int64_t select(input_type c, int64_t j) const {
+    int64_t c_index = char_index_[static_cast<uint8_t>(c)];
+    if (c_index < 0) {
+      return -1;
+    }
+    auto const &top_level = levels_[0];
+    auto const &top_ranks = c_rank(c_index, 0);
+    int64_t current_block = (j - 1) / block_size_lvl_[0];
+    int64_t end_block = top_ranks.size() - 1;
+    int64_t block_size = block_size_lvl_[0];
+    while (current_block != end_block) {
+      int64_t m = current_block + (end_block - current_block) / 2;
+      int64_t f = (m == 0) ? 0 : top_ranks[m - 1];
+      if (f < j) {
+        if (end_block - current_block == 1) {
+          if (static_cast<int64_t>(top_ranks[m]) < j) {
+            current_block = m + 1;
+          }
+          break;
+        }
+        current_block = m;
+      } else {
+        end_block = m - 1;
+      }
+    }
+
+    int64_t s = current_block * block_size - 1;
+    j -= (current_block == 0) ? 0 : top_ranks[current_block - 1];
+    if (!top_level[current_block]) {
+      int64_t blk = top_level.rank0(current_block);
+      current_block = pointers_[0][blk];
+      int64_t g = offsets_[0][blk];
+      int64_t rank_d = (current_block == 0)
+                           ? top_ranks[0]
+                           : top_ranks[current_block] -
+                                 top_ranks[current_block - 1];
+      rank_d -= pointer_c_rank(c_index, 0)[blk];
+      if (rank_d < j) {
+        j -= rank_d;
+        s += (block_size - g);
+        current_block++;
+      } else {
+        j += pointer_c_rank(c_index, 0)[blk];
+        s -= g;
+      }
+    }
+    uint64_t i = 1;
+    while (i < levels_.size()) {
+      auto const &current_level = levels_[i];
+      auto const &ranks = c_rank(c_index, i);
+      current_block = levels_[i - 1].rank1(current_block) * tau_;
+      block_size /= tau_;
+      int64_t k = current_block;
+      while (static_cast<int64_t>(ranks[current_block]) < j) {
+        current_block++;
+      }
+      j -= (current_block == k) ? 0 : ranks[current_block - 1];
+      s += (current_block - k) * block_size;
+      if (!current_level[current_block]) {
+        int64_t blk = current_level.rank0(current_block);
+        current_block = pointers_[i][blk];
+        int64_t g = offsets_[i][blk];
+        int64_t rank_d = (current_block % tau_ == 0)
+                             ? ranks[current_block]
+                             : ranks[current_block] - ranks[current_block - 1];
+        rank_d -= pointer_c_rank(c_index, i)[blk];
+        if (rank_d < j) {
+          j -= rank_d;
+          s += (block_size - g);
+          current_block++;
+        } else {
+          j += pointer_c_rank(c_index, i)[blk];
+          s -= g;
+        }
+      }
+      i++;
+    }
+
+    current_block = levels_[i - 1].rank1(current_block) * tau_;
+    int64_t l = 0;
+    uint64_t code = compress_map_[static_cast<uint8_t>(c)];
+    while (j > 0) {
+      if (leaves_[current_block * leaf_size_ + l] == code) {
+        j--;
+      }
+      l++;
+    }
+    return s + l;
+  }
+
+  int64_t rank(input_type c, int64_t index) const {
+    int64_t c_index = char_index_[static_cast<uint8_t>(c)];
+    if (c_index < 0) {
+      return 0;
+    }
+    auto const &top_level = levels_[0];
+    auto const &top_ranks = c_rank(c_index, 0);
+    int64_t block_size = block_size_lvl_[0];
+    int64_t blk_pointer = index / block_size;
+    int64_t off = index % block_size;
+    int64_t rank = (blk_pointer == 0) ? 0 : top_ranks[blk_pointer - 1];
+    int64_t child = 0;
+    if (top_level[blk_pointer]) {
+      block_size /= tau_;
+      child = off / block_size;
+      off = off % block_size;
+      blk_pointer = top_level.rank1(blk_pointer) * tau_ + child;
+    } else {
+      int64_t blk = top_level.rank0(blk_pointer);
+      rank -= pointer_c_rank(c_index, 0)[blk];
+      off = off + offsets_[0][blk];
+      blk_pointer = pointers_[0][blk];
+      child = blk_pointer;
+      if (off >= block_size) {
+        rank += (child == 0) ? top_ranks[blk_pointer]
+                             : top_ranks[blk_pointer] -
+                                   top_ranks[blk_pointer - 1];
+        blk_pointer++;
+        off = off - block_size;
+      }
+      block_size = block_size / tau_;
+      child = off / block_size;
+      off = off % block_size;
+      blk_pointer = top_level.rank1(blk_pointer) * tau_ + child;
+    }
+    uint64_t i = 1;
+    while (i < levels_.size()) {
+      auto const &ranks = c_rank(c_index, i);
+      rank += (child == 0) ? 0 : ranks[blk_pointer - 1];
+      if (levels_[i][blk_pointer]) {
+        int64_t rank_blk = levels_[i].rank1(blk_pointer);
+        block_size /= tau_;
+        child = off / block_size;
+        off = off % block_size;
+        blk_pointer = rank_blk * tau_ + child;
+        i++;
+      } else {
+        int64_t blk = levels_[i].rank0(blk_pointer);
+        rank -= pointer_c_rank(c_index, i)[blk];
+        off = off + offsets_[i][blk];
+        blk_pointer = pointers_[i][blk];
+        child = blk_pointer % tau_;
+        if (off >= block_size) {
+          rank += (child == 0) ? ranks[blk_pointer]
+                               : ranks[blk_pointer] - ranks[blk_pointer - 1];
+          blk_pointer++;
+          child = blk_pointer % tau_;
+          off = off - block_size;
+        }
+        rank -= (child == 0) ? 0 : ranks[blk_pointer - 1];
+      }
+    }
+    int64_t prefix_leaves = blk_pointer - child;
+    uint64_t code = compress_map_[static_cast<uint8_t>(c)];
+    for (int64_t j = 0; j < child * leaf_size_; j++) {
+      if (leaves_[prefix_leaves * leaf_size_ + j] == code) {
+        rank++;
+      }
+    }
+    for (int64_t j = 0; j <= off; j++) {
+      if (leaves_[blk_pointer * leaf_size_ + j] == code) {
+        rank++;
+      }
+    }
+    return rank;
+  }
+
+private:
+  int32_t attach_sections(char const *base, uint64_t bytes) {
+    if (reinterpret_cast<uintptr_t>(base) % 8 != 0 ||
+        bytes < sizeof(BlockTreeViewHeader)) {
+      return -1;
+    }
+    std::memcpy(&header_, base, sizeof(header_));
+    uint64_t const levels = header_.levels;
+    uint64_t const chars = header_.chars;
+    uint64_t const end = header_.file_bytes;
+    if (header_.magic != BLOCK_TREE_VIEW_MAGIC ||
+        header_.version != BLOCK_TREE_VIEW_VERSION ||
+        header_.input_bytes != sizeof(input_type) ||
+        (header_.size_bytes != 4 && header_.size_bytes != 8) ||
+        end > bytes || end % 64 != 0 || header_.tau < 2 ||
+        header_.leaf_size < 1 || levels > end / 64 || chars > 256 ||
+        (header_.rank_support == 0 && chars > 0)) {
+      return -1;
+    }
+    uint64_t const sections = 3 + 3 * levels + 2 * chars * levels;
+    uint64_t const first_section = 64 + (sections * 8 + 63) / 64 * 64;
+    if (first_section > end) {
+      return -1;
+    }
+    auto const *directory = reinterpret_cast<uint64_t const *>(base + 64);
+    size_t k = 0;
+    // the next section if it starts within the buffer and has room for
+    // header_bytes bytes, nullptr otherwise
+    auto section = [&](uint64_t header_bytes) -> uint64_t const * {
+      uint64_t offset = directory[k++];
+      if (offset < first_section || offset % 64 != 0 || offset > end ||
+          header_bytes > end - offset) {
+        return nullptr;
+      }
+      return reinterpret_cast<uint64_t const *>(base + offset);
+    };
+    // whether the section has room for words words after its 64 byte header
+    auto fits = [&](uint64_t const *words, uint64_t count) {
+      uint64_t left = end - (reinterpret_cast<char const *>(words) - base) - 64;
+      return count <= left / 8;
+    };
+    bool valid = true;
+    auto packed = [&](uint64_t max_width) {
+      uint64_t const *words = section(64);
+      if (words == nullptr || words[1] > max_width ||
+          (words[1] > 0 && words[0] > (end * 8) / words[1]) ||
+          !fits(words, (words[0] * words[1] + 63) / 64 + 1)) {
+        valid = false;
+        return PackedView{};
+      }
+      return PackedView{words + 8, words[0], words[1]};
+    };
+    block_size_lvl_ = reinterpret_cast<int64_t const *>(section(levels * 8));
+    auto const *maps = reinterpret_cast<uint8_t const *>(section(256 * 6));
+    if (block_size_lvl_ == nullptr || maps == nullptr) {
+      return -1;
+    }
+    compress_map_ = maps;
+    decompress_map_ = maps + 256;
+    char_index_ = reinterpret_cast<int32_t const *>(maps + 512);
+    for (uint64_t c = 0; c < 256; c++) {
+      if (char_index_[c] >= static_cast<int64_t>(chars)) {
+        return -1;
+      }
+    }
+    levels_.resize(levels);
+    pointers_.resize(levels);
+    offsets_.resize(levels);
+    for (uint64_t i = 0; i < levels && valid; i++) {
+      uint64_t const *bits = section(64);
+      if (bits == nullptr || bits[1] != bits[0] / 64 + (bits[0] % 64 != 0) ||
+          bits[2] != bits[1] / 8 + 1 || !fits(bits, bits[1] + bits[2])) {
+        return -1;
+      }
+      levels_[i] = BitView{bits + 8, bits + 8 + bits[1], bits[0]};
+      pointers_[i] = packed(64);
+      offsets_[i] = packed(64);
+    }
+    // leaves hold the codes of the decompress map
+    leaves_ = packed(8);
+    c_ranks_.resize(chars * levels);
+    pointer_c_ranks_.resize(chars * levels);
+    for (auto *ranks : {&c_ranks_, &pointer_c_ranks_}) {
+      for (auto &lvl : *ranks) {
+        lvl = packed(64);
+      }
+    }
+    if (!valid) {
+      return -1;
+    }
+    tau_ = header_.tau;
+    leaf_size_ = header_.leaf_size;
+    return 0;
+  }
+
+  void clear_sections() {
+    header_ = BlockTreeViewHeader{};
+    levels_.clear();
+    pointers_.clear();
+    offsets_.clear();
+    leaves_ = PackedView{};
+    c_ranks_.clear();
+    pointer_c_ranks_.clear();
+  }
+
+  BlockTreeViewHeader header_{};
+  PlacedMemory memory_;
+  int64_t tau_ = 0;
+  int64_t leaf_size_ = 0;
+  int64_t const *block_size_lvl_ = nullptr;
+  uint8_t const *compress_map_ = nullptr;
+  uint8_t const *decompress_map_ = nullptr;
+  int32_t const *char_index_ = nullptr;
+  std::vector<BitView> levels_;
+  std::vector<PackedView> pointers_;
+  std::vector<PackedView> offsets_;
+  PackedView leaves_;
+  // c_ranks_ and pointer_c_ranks_ of character c and level i at
+  // c * levels + i
+  std::vector<PackedView> c_ranks_;
+  std::vector<PackedView> pointer_c_ranks_;
+
+  PackedView const &c_rank(int64_t c_index, uint64_t i) const {
+    return c_ranks_[c_index * header_.levels + i];
+  }
+
+  PackedView const &pointer_c_rank(int64_t c_index, uint64_t i) const {
+    return pointer_c_ranks_[c_index * header_.levels + i];
+  }
+};
+
+// Block tree views for multi-socket systems. Either one view interleaved on
+// all NUMA nodes (or placed by first touch), or a replica on each node, so
+// that worker threads can query the replica on their own node.
+template <typename input_type> class BlockTreeViewReplicas {
+public:
+  // Loads the file once or once per node. Returns 0 on success and -1 if a
+  // replica cannot be loaded.
+  int32_t load(std::string const &path,
+               PageMode pages = PageMode::TRANSPARENT_HUGE,
+               NumaMode numa = NumaMode::REPLICATE) {
+    close();
+    std::vector<int32_t> nodes = (numa == NumaMode::REPLICATE)
+                                     ? numa_nodes()
+                                     : std::vector<int32_t>{0};
+    replica_of_node_.assign(*std::max_element(nodes.begin(), nodes.end()) + 1,
+                            0);
+    for (int32_t node : nodes) {
+      replica_of_node_[node] = replicas_.size();
+      replicas_.push_back(std::make_unique<BlockTreeView<input_type>>());
+      if (replicas_.back()->load(path, pages, numa, node) != 0) {
+        close();
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  void close() {
+    replicas_.clear();
+    replica_of_node_.clear();
+  }
+
+  size_t size() const { return replicas_.size(); }
+
+  // Replica on the given node (the first replica if there is none).
+  BlockTreeView<input_type> const &replica(int32_t node) const {
+    bool known =
+        node >= 0 && static_cast<size_t>(node) < replica_of_node_.size();
+    return *replicas_[known ? replica_of_node_[node] : 0];
+  }
+
+  // Replica on the node of the calling thread. This requires a system call,
+  // pinned threads should keep the reference.
+  BlockTreeView<input_type> const &local() const {
+    return replica(current_numa_node());
+  }
+
+private:
+  std::vector<std::unique_ptr<BlockTreeView<input_type>>> replicas_;
+  std::vector<size_t> replica_of_node_;
+};
+
+} // namespace pasta
+
+/******************************************************************************/
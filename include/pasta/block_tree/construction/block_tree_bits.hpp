@@ -0,0 +1,151 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include "pasta/block_tree/construction/block_tree_fp.hpp"
+#include "pasta/block_tree/utils/text_iterator.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <pasta/bit_vector/bit_vector.hpp>
+#include <span>
+#include <vector>
+
+namespace pasta {
+
+// The bits of a pasta::BitVector as a text of the characters 0 and 1, which
+// can be used to build a block tree without unpacking the bits.
+class BitVectorText {
+public:
+  using ConstIterator = TextIterator<BitVectorText, uint8_t>;
+
+  explicit BitVectorText(pasta::BitVector const &bits)
+      : words_(bits.data()), size_(bits.size()){};
+
+  uint8_t operator[](uint64_t index) const {
+    return (words_[index / 64] >> (index % 64)) & 1ULL;
+  }
+
+  uint64_t size() const { return size_; }
+  ConstIterator begin() const { return ConstIterator(this, 0); }
+  ConstIterator end() const { return ConstIterator(this, size_); }
+
+private:
+  std::span<uint64_t const> words_;
+  uint64_t size_;
+};
+
+// Block tree of a bit vector, e.g., of a highly repetitive bitmap, with rank
+// and select queries like pasta's rank and select support. The leaves are
+// stored with one bit per bit and only the ones have rank directories. Ranks
+// of zeros follow from the ranks of ones.
+template <typename size_type> class BlockTreeBits {
+public:
+  using Tree = BlockTreeFP<uint8_t, size_type, BitVectorText>;
+
+  BlockTreeBits(pasta::BitVector const &bits, size_type tau,
+                size_type max_leaf_length,
+                FingerprintMode fingerprint_mode = FingerprintMode::VERIFY)
+      : tree_(BitVectorText(bits), tau, max_leaf_length, 1, 256, true, true,
+              fingerprint_mode),
+        size_(bits.size()) {
+    has_ones_ = tree_.chars_index_.contains(1);
+    if (has_ones_) {
+      tree_.add_rank_support(std::vector<uint8_t>{1});
+    }
+  };
+
+  bool access(size_t index) { return tree_.access(index) == 1; }
+
+  // Number of ones in [0, index).
+  size_t rank1(size_t index) {
+    return (index == 0 || !has_ones_) ? 0 : tree_.rank(1, index - 1);
+  }
+
+  // Number of zeros in [0, index).
+  size_t rank0(size_t index) { return index - rank1(index); }
+
+  // Position of the rank-th one, size() if the bit vector has no ones.
+  size_t select1(size_t rank) {
+    return has_ones_ ? tree_.select(1, rank) : size_;
+  }
+
+  // Position of the rank-th zero. The top level block that contains it is
+  // found with the rank directory of the ones, the position in the block with
+  // a binary search on rank0.
+  size_t select0(size_t rank) {
+    if (!has_ones_) {
+      return rank - 1;
+    }
+    auto const &ones = tree_.c_ranks_[tree_.chars_index_[1]][0];
+    int64_t block_size = tree_.block_size_lvl_[0];
+    // zeros in the top level blocks up to block b
+    auto zeros = [&](int64_t b) {
+      return std::min<int64_t>((b + 1) * block_size, size_) -
+             static_cast<int64_t>(ones[b]);
+    };
+    int64_t left = 0;
+    int64_t right = ones.size() - 1;
+    while (left < right) {
+      int64_t middle = left + (right - left) / 2;
+      if (zeros(middle) < static_cast<int64_t>(rank)) {
+        left = middle + 1;
+      } else {
+        right = middle;
+      }
+    }
+    int64_t begin = left * block_size;
+    int64_t end = std::min<int64_t>(begin + block_size, size_) - 1;
+    while (begin < end) {
+      int64_t middle = begin + (end - begin) / 2;
+      if (rank0(middle + 1) < rank) {
+        begin = middle + 1;
+      } else {
+        end = middle;
+      }
+    }
+    return begin;
+  }
+
+  size_t size() const { return size_; }
+
+  int64_t print_space_usage() { return tree_.print_space_usage(); }
+
+  Tree &tree() { return tree_; }
+
+private:
+  Tree tree_;
+  size_t size_;
+  bool has_ones_ = false;
+};
+
+template <typename size_type>
+auto *make_block_tree_bits(
+    pasta::BitVector const &bits, size_type const tau,
+    size_type const max_leaf_length,
+    FingerprintMode const fingerprint_mode = FingerprintMode::VERIFY) {
+  return new BlockTreeBits<size_type>(bits, tau, max_leaf_length,
+                                      fingerprint_mode);
+}
+
+} // namespace pasta
+
+/******************************************************************************/
@@ -0,0 +1,196 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include "pasta/block_tree/block_tree.hpp"
+#include "pasta/block_tree/construction/block_tree_fp.hpp"
+#include "pasta/block_tree/construction/block_tree_lpf.hpp"
+#include "pasta/block_tree/utils/build_profiler.hpp"
+#include "pasta/block_tree/utils/memory_budget.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <variant>
+#include <vector>
+
+namespace pasta {
+
+// Block tree whose position type is chosen at runtime.
+template <typename input_type>
+using AnyBlockTree =
+    std::variant<std::unique_ptr<BlockTree<input_type, int32_t>>,
+                 std::unique_ptr<BlockTree<input_type, int64_t>>>;
+
+// Largest text for which the construction buffers can use 40-bit positions.
+constexpr int64_t MAX_INT40_TEXT_LENGTH = int64_t{1} << 39;
+
+// Builds the tree described by plan and stores its measured peak in plan. The
+// factories get the memory budget, so they pack the temporaries of the levels
+// exactly if the plan does.
+template <typename input_type, typename size_type>
+std::unique_ptr<BlockTree<input_type, size_type>>
+make_planned_block_tree(std::vector<input_type> &text, size_type tau,
+                        size_type max_leaf_length, bool set_s_to_z,
+                        size_t threads, int64_t memory_budget,
+                        ConstructionReport &plan) {
+  using Tree = BlockTree<input_type, size_type>;
+  if (plan.strategy == ConstructionStrategy::FP) {
+    auto *tree = make_block_tree_fp<input_type, size_type>(
+        text, tau, max_leaf_length, FingerprintMode::VERIFY, memory_budget);
+    plan.observed_peak = tree->peak_memory();
+    return std::unique_ptr<Tree>(tree);
+  }
+  if (plan.strategy == ConstructionStrategy::LPF) {
+    auto *tree = make_block_tree_lpf<input_type, size_type>(
+        text, tau, max_leaf_length, set_s_to_z, memory_budget);
+    plan.observed_peak = tree->peak_memory();
+    return std::unique_ptr<Tree>(tree);
+  }
+  if constexpr (sizeof(size_type) == 8) {
+    if (plan.lpf_entry_bytes == 5) {
+      auto *tree = make_block_tree_lpf_parallel_packed<input_type>(
+          text, tau, max_leaf_length, set_s_to_z, threads);
+      plan.observed_peak = tree->peak_memory();
+      return std::unique_ptr<Tree>(tree);
+    }
+  }
+  auto *tree = make_block_tree_lpf_parallel<input_type, size_type>(
+      text, tau, max_leaf_length, set_s_to_z, threads, memory_budget);
+  plan.observed_peak = tree->peak_memory();
+  return std::unique_ptr<Tree>(tree);
+}
+
+// Chooses how make_block_tree builds a tree for a text of n characters with
+// the given number of threads. The LPF construction with LPF arrays of the
+// tree's position type is used, sequentially if there is only one thread and
+// with 40-bit LPF arrays if the text has 2^31 characters or more.
+//
+// If memory_budget > 0, the first construction that is predicted to need at
+// most memory_budget bytes besides the text is used instead: the sequential
+// LPF construction (only with one thread) and the parallel one with LPF arrays
+// of the tree's position type, each first with plain and then with bit packed
+// temporaries, the one with 40-bit LPF arrays and finally the FP construction
+// (which always uses s = 1). If nothing fits, the leanest one with packed
+// temporaries is used.
+template <typename input_type>
+ConstructionReport plan_block_tree_construction(int64_t n, int64_t tau,
+                                                int64_t max_leaf_length,
+                                                int64_t memory_budget = 0,
+                                                size_t threads = 1) {
+  bool narrow = n <= std::numeric_limits<int32_t>::max();
+  int64_t width = narrow ? 4 : 8;
+  std::vector<ConstructionReport> plans;
+  auto add_plan = [&](ConstructionStrategy strategy, int64_t entry_bytes,
+                      bool packed) {
+    ConstructionReport plan;
+    plan.strategy = strategy;
+    plan.lpf_entry_bytes = entry_bytes;
+    plan.packed_temporaries = packed;
+    if (strategy == ConstructionStrategy::FP) {
+      plan.predicted_peak = predict_level_memory(
+          n, tau, max_leaf_length, packed,
+          BlockTreeFP<input_type, int64_t>::HASH_ENTRY_BYTES);
+    } else {
+      plan.predicted_peak = predict_lpf_construction_memory(
+          n, tau, max_leaf_length, entry_bytes, packed,
+          strategy == ConstructionStrategy::LPF_PARALLEL);
+    }
+    plans.push_back(plan);
+  };
+  bool sequential = threads <= 1;
+  if (sequential) {
+    add_plan(ConstructionStrategy::LPF, width, false);
+    add_plan(ConstructionStrategy::LPF, width, true);
+  }
+  add_plan(ConstructionStrategy::LPF_PARALLEL, width, false);
+  add_plan(ConstructionStrategy::LPF_PARALLEL, width, true);
+  bool int40 = !narrow && n < MAX_INT40_TEXT_LENGTH;
+  if (int40) {
+    add_plan(ConstructionStrategy::LPF_PARALLEL, 5, true);
+  }
+  add_plan(ConstructionStrategy::FP, 0, false);
+  add_plan(ConstructionStrategy::FP, 0, true);
+
+  ConstructionReport chosen = int40 ? plans[sequential ? 4 : 2] : plans[0];
+  if (memory_budget > 0) {
+    // if nothing fits, the factories pack the temporaries
+    chosen.predicted_peak = std::numeric_limits<int64_t>::max();
+    for (auto const &plan : plans) {
+      if (plan.packed_temporaries &&
+          plan.predicted_peak < chosen.predicted_peak) {
+        chosen = plan;
+      }
+    }
+    for (auto const &plan : plans) {
+      if (plan.predicted_peak <= memory_budget) {
+        chosen = plan;
+        break;
+      }
+    }
+  }
+  chosen.fits = memory_budget <= 0 || chosen.predicted_peak <= memory_budget;
+  return chosen;
+}
+
+// Builds a tree with the construction chosen by plan_block_tree_construction
+// and the narrowest position type that fits the text. Texts with less than
+// 2^31 characters use 32-bit positions. For larger texts, the tree uses 64-bit
+// positions while the LPF array, the previous occurrences and the block
+// starts are stored with 40 bits each and the pointers, offsets and counters
+// of the levels are bit packed until the tree is pruned. The choice and the
+// predicted and observed peaks are stored in report.
+template <typename input_type>
+AnyBlockTree<input_type> make_block_tree(std::vector<input_type> &text,
+                                         int64_t tau, int64_t max_leaf_length,
+                                         bool set_s_to_z, size_t threads = 1,
+                                         int64_t memory_budget = 0,
+                                         ConstructionReport *report = nullptr) {
+  int64_t n = text.size();
+  bool narrow = n <= std::numeric_limits<int32_t>::max();
+  ConstructionReport chosen = plan_block_tree_construction<input_type>(
+      n, tau, max_leaf_length, memory_budget, threads);
+
+  int64_t rss = (report != nullptr) ? peak_rss() : -1;
+  AnyBlockTree<input_type> tree;
+  if (narrow) {
+    tree = make_planned_block_tree<input_type, int32_t>(
+        text, tau, max_leaf_length, set_s_to_z, threads, memory_budget,
+        chosen);
+  } else {
+    tree = make_planned_block_tree<input_type, int64_t>(
+        text, tau, max_leaf_length, set_s_to_z, threads, memory_budget,
+        chosen);
+  }
+  if (report != nullptr) {
+    int64_t peak = peak_rss();
+    if (rss >= 0 && peak >= 0) {
+      chosen.observed_rss = std::max<int64_t>(0, peak - rss);
+    }
+    *report = chosen;
+  }
+  return tree;
+}
+
+} // namespace pasta
+
+/******************************************************************************/
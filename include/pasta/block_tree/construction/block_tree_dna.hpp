@@ -0,0 +1,113 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include "pasta/block_tree/construction/block_tree_fp.hpp"
+#include "pasta/block_tree/utils/dna_text.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace pasta {
+
+// Block tree of a DNA text. The tree is built with fingerprints on the packed
+// text, which is never unpacked, and contains the text with all runs of
+// characters other than A, C, G and T replaced by A. Hence, its leaves are
+// stored with two bits per character. The runs are kept beside the tree and
+// queries are corrected for them.
+template <typename size_type> class BlockTreeDna {
+public:
+  using Tree = BlockTreeFP<uint8_t, size_type, PackedDnaText>;
+
+  BlockTreeDna(PackedDnaText const &text, size_type tau,
+               size_type max_leaf_length,
+               FingerprintMode fingerprint_mode = FingerprintMode::VERIFY)
+      : tree_(text, tau, max_leaf_length, 1, 256, true, true,
+              fingerprint_mode),
+        runs_(text.runs()){};
+
+  int32_t add_rank_support() { return tree_.add_rank_support(); }
+
+  int64_t access(size_type index) {
+    auto const *run = runs_.find(index);
+    return (run == nullptr) ? tree_.access(index) : run->c;
+  }
+
+  // Number of occurrences of c in [0, index].
+  int64_t rank(uint8_t c, size_type index) {
+    if (PackedDnaText::code_of(c) < 0) {
+      return runs_.rank(c, int64_t{index} + 1);
+    }
+    if (!tree_.chars_index_.contains(c)) {
+      return 0;
+    }
+    int64_t result = tree_.rank(c, index);
+    return (c == 'A') ? result - runs_.rank(int64_t{index} + 1) : result;
+  }
+
+  // Position of the j-th occurrence of c.
+  int64_t select(uint8_t c, size_type j) {
+    if (PackedDnaText::code_of(c) < 0) {
+      return runs_.select(c, j);
+    }
+    if (c != 'A') {
+      return tree_.select(c, j);
+    }
+    // The j-th A of the text lies behind the last run with less than j As of
+    // the text in front of it. The tree stores all run positions in front of
+    // it as A, so it is the A of the tree with j plus their number.
+    auto const &runs = runs_.runs();
+    auto it = std::partition_point(
+        runs.begin(), runs.end(), [&](DnaRuns::Run const &run) {
+          int64_t as = (run.begin == 0) ? 0 : tree_.rank(c, run.begin - 1);
+          return as - run.before < j;
+        });
+    int64_t skipped = 0;
+    if (it != runs.begin()) {
+      skipped = (it - 1)->before + (it - 1)->length;
+    }
+    return tree_.select(c, j + skipped);
+  }
+
+  int64_t print_space_usage() {
+    return tree_.print_space_usage() + runs_.space_usage();
+  }
+
+  Tree &tree() { return tree_; }
+  DnaRuns const &runs() const { return runs_; }
+
+private:
+  Tree tree_;
+  DnaRuns runs_;
+};
+
+template <typename size_type>
+auto *make_block_tree_dna(
+    PackedDnaText const &text, size_type const tau,
+    size_type const max_leaf_length,
+    FingerprintMode const fingerprint_mode = FingerprintMode::VERIFY) {
+  return new BlockTreeDna<size_type>(text, tau, max_leaf_length,
+                                     fingerprint_mode);
+}
+
+} // namespace pasta
+
+/******************************************************************************/
@@ -23,89 +23,73 @@
 #include "pasta/block_tree/block_tree.hpp"
 #include "pasta/block_tree/utils/MersenneHash.hpp"
 #include "pasta/block_tree/utils/MersenneRabinKarp.hpp"
+#include "pasta/block_tree/utils/build_profiler.hpp"
+#include "pasta/block_tree/utils/memory_budget.hpp"
+#include "pasta/block_tree/utils/packed_int_vector.hpp"
+#include "pasta/block_tree/utils/pruning.hpp"
 
 __extension__ typedef unsigned __int128 uint128_t;
 
 namespace pasta {
 
-template <typename input_type, typename size_type>
+// How equal Karp-Rabin fingerprints are treated during construction. VERIFY
+// compares the underlying substrings on every fingerprint hit. TRUST and
+// TRUST_DOUBLE skip this comparison and rely on one or two independent 61-bit
+// fingerprints instead; the finished tree is then checked against the text and
+// rebuilt with VERIFY if a collision produced a wrong back pointer. Only the
+// extended pruning trusts fingerprints.
+enum class FingerprintMode { VERIFY, TRUST, TRUST_DOUBLE };
+
+// Result of checking the back pointers of a tree built with trusted
+// fingerprints.
+struct FingerprintStats {
+  int64_t checked_pointers = 0;
+  int64_t collisions = 0;
+  int64_t rebuilds = 0;
+};
+
+// The text can be any container of characters with size(), operator[] and
+// iterators, e.g., a PackedDnaText, it is only accessed during construction.
+template <typename input_type, typename size_type,
+          typename text_type = std::vector<input_type>>
 class BlockTreeFP : public BlockTree<input_type, size_type> {
 public:
+  using KarpRabin = MersenneRabinKarp<input_type, size_type, text_type>;
+  using Fingerprint = MersenneHash<input_type, text_type>;
+  static constexpr uint64_t TRUSTED_PRIME = 2305843009213693951ULL;
   size_type const_size = 0;
   size_type sigma_ = 0;
-  bool prune_block(
-      std::vector<std::vector<size_type>> &counter,
-      std::vector<std::vector<size_type>> &pointer,
-      std::vector<std::vector<size_type>> &offset,
-      std::vector<pasta::BitVector *> &marked_tree,
-      std::vector<pasta::BitVector *> &pruned_tree, size_type i, size_type j,
-      std::vector<pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>> &ranks) {
-    // string leaf children can always be pruned
-    // fully padded children don't exist and can be ignored/ sanity check
-    // assumes short circuit evaluation as compiler behaviour
-    if (static_cast<uint64_t>(i) >= marked_tree.size() ||
-        static_cast<uint64_t>(j) >= marked_tree[i]->size()) {
-      return false;
-    }
+  FingerprintMode fingerprint_mode_ = FingerprintMode::VERIFY;
+  FingerprintStats fingerprint_stats_;
+  // whether the pointers, offsets and counters of the levels are bit packed
+  // until the tree is pruned (only used by the extended pruning)
+  bool packed_temporaries_ = false;
+  // largest number of bytes held by the per-level temporaries and the
+  // fingerprint maps at the same time, measured from their sizes (only used by
+  // the extended pruning)
+  int64_t level_memory_ = 0;
+  // bytes of an entry of the fingerprint maps assumed by the prediction: the
+  // node with the key, the vector of blocks, the next pointer and the cached
+  // hash and the heap allocation of the vector
+  static constexpr int64_t HASH_ENTRY_BYTES =
+      sizeof(Fingerprint) + sizeof(std::vector<size_type>) +
+      2 * sizeof(void *) + 32;
+  // blocks (or pairs of blocks) of a level by their fingerprints
+  using FingerprintMap =
+      std::unordered_map<Fingerprint, std::vector<size_type>>;
 
-    bool marked_children = false;
-    // we already incremented counters for unmarked blocks during a previous
-    // step and now only need to consider marked blocks
-    if ((*marked_tree[i])[j] == 1) {
-      // inverse postorder dfs
-      // prune_block returns true if a marked block stays marked false otherwise
-      size_type rank_blk = ranks[i].rank1(j);
-      for (size_type k = this->tau_ - 1; k >= 0; k--) {
-        marked_children |=
-            prune_block(counter, pointer, offset, marked_tree, pruned_tree,
-                        i + 1, rank_blk * this->tau_ + k, ranks);
-      }
-      // conditions to be pruned are no marked children, no pointers pointing to
-      // me and a former occurrence in S
-      if (!marked_children && counter[i][j] == 0 &&
-          pointer[i][j] != NO_FORMER_OCC) {
-
-        (*marked_tree[i])[j] = 0;
-        counter[i][pointer[i][j]]++;
-        if (offset[i][j] > 0) {
-          counter[i][pointer[i][j] + 1]++;
-        }
-        if (static_cast<uint64_t>(i + 1) < counter.size()) {
-          // remove all of its children by decrementing counters and marking
-          // them as PRUNED
-          for (size_type k = this->tau_ - 1; k >= 0; k--) {
-            if (static_cast<uint64_t>(rank_blk * this->tau_) + k <
-                counter[i + 1].size()) {
-              auto ptr_child = pointer[i + 1][rank_blk * this->tau_ + k];
-              counter[i + 1][ptr_child]--;
-              if (offset[i + 1][rank_blk * this->tau_ + k] > 0) {
-                counter[i + 1][ptr_child + 1]--;
-              }
-              pointer[i + 1][rank_blk * this->tau_ + k] = PRUNED;
-            }
-          }
-        }
-      }
-    }
-    return marked_children || counter[i][j] > 0 ||
-           pointer[i][j] == NO_FORMER_OCC;
-  };
+  // Largest number of bytes held by the buffers of the construction at the
+  // same time, measured from their sizes. The text and the tree are excluded.
+  int64_t peak_memory() const { return level_memory_; }
 
-  int32_t pruning_extended(std::vector<std::vector<size_type>> &counter,
-                           std::vector<std::vector<size_type>> &pointer,
-                           std::vector<std::vector<size_type>> &offset,
-                           std::vector<pasta::BitVector *> &marked_tree,
-                           std::vector<pasta::BitVector *> &pruned_tree) {
-    std::vector<pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>> ranks;
-    for (auto bv : marked_tree) {
-      ranks.push_back(pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>(*bv));
-    }
-    auto &top_lvl = *marked_tree[0];
-    for (size_type j = top_lvl.size() - 1; j >= 0; j--) {
-      prune_block(counter, pointer, offset, marked_tree, pruned_tree, 0, j,
-                  ranks);
-    }
-    return 0;
+  template <typename level_vector>
+  int32_t pruning_extended(
+      std::vector<level_vector> &counter, std::vector<level_vector> &pointer,
+      std::vector<level_vector> &offset,
+      std::vector<pasta::BitVector *> &marked_tree,
+      [[maybe_unused]] std::vector<pasta::BitVector *> &pruned_tree) {
+    return prune_extended<size_type>(counter, pointer, offset, marked_tree,
+                                     this->tau_, PRUNED, NO_FORMER_OCC, 1);
   }
 
   int32_t pruning_simple(std::vector<pasta::BitVector *> &first_pass_bv,
@@ -126,9 +110,13 @@ public:
       if (static_cast<uint64_t>(i) != first_pass_bv.size() - 1) {
         for (uint64_t j = 0; j < bv->size(); j++) {
           if ((*first_pass_bv[i])[j] == 1) {
-            for (size_type k = 0; k < this->tau_; k++) {
-              if ((*bv_pass_2[bv_pass_2.size() -
-                              1])[marked_counter * this->tau_ + k] == 1) {
+            // the children of the last block may be cut off by the text end
+            auto &children = *bv_pass_2[bv_pass_2.size() - 1];
+            uint64_t first = marked_counter * this->tau_;
+            uint64_t end =
+                std::min<uint64_t>(first + this->tau_, children.size());
+            for (uint64_t k = first; k < end; k++) {
+              if (children[k] == 1) {
                 (*bv)[j] = 1;
               }
             }
@@ -183,16 +171,19 @@ public:
     return 0;
   }
 
-  int32_t init_extended(std::vector<input_type> &text) {
-    static constexpr uint128_t kPrime = 2305843009213693951ULL;
+  template <typename level_vector = std::vector<size_type>>
+  int32_t init_extended(text_type const &text) {
     int64_t added_padding = 0;
     int64_t tree_max_height = 0;
     int64_t max_blk_size = 0;
-    std::vector<std::vector<int64_t>> blk_lvl;
-    std::vector<std::vector<size_type>> pass1_pointer;
-    std::vector<std::vector<size_type>> pass1_offset;
+    // start of the last block of each level and the starts of all blocks of
+    // the last level, other block starts are only kept for the current level
+    std::vector<int64_t> last_block_start;
+    std::vector<int64_t> last_lvl_inx;
+    std::vector<level_vector> pass1_pointer;
+    std::vector<level_vector> pass1_offset;
     std::vector<pasta::BitVector *> bv_marked;
-    std::vector<std::vector<size_type>> counter;
+    std::vector<level_vector> counter;
     std::vector<size_type> pass2_ones;
     std::vector<int64_t> block_size_lvl_temp;
     this->calculate_padding(added_padding, text.size(), tree_max_height,
@@ -206,7 +197,7 @@ public:
     }
     if (block_size <= this->max_leaf_length_) {
       auto *bv = new pasta::BitVector(block_text_inx.size(), 1);
-      this->block_tree_types_rs_.push_back(
+      this->block_tree_types_rs_.emplace_back(
           new pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>(*bv));
       auto p0 = new sdsl::int_vector<>(0, 0);
       auto o0 = new sdsl::int_vector<>(0, 0);
@@ -214,9 +205,9 @@ public:
       auto &off0 = *o0;
       sdsl::util::bit_compress(ptr0);
       sdsl::util::bit_compress(off0);
-      this->block_tree_types_.push_back(bv);
-      this->block_tree_pointers_.push_back(p0);
-      this->block_tree_offsets_.push_back(o0);
+      this->block_tree_types_.emplace_back(bv);
+      this->block_tree_pointers_.emplace_back(p0);
+      this->block_tree_offsets_.emplace_back(o0);
       this->block_size_lvl_.push_back(block_size);
       this->leaf_size = block_size / this->tau_;
       this->leaves_ = std::vector<input_type>(text.begin(), text.end());
@@ -224,6 +215,9 @@ public:
       return 0;
     }
     while (block_size > this->max_leaf_length_) {
+      ProfilePhase phase("level", block_size_lvl_temp.size());
+      phase.set_estimated_bytes((3 * sizeof(size_type) + 1) *
+                                block_text_inx.size());
       block_size_lvl_temp.push_back(block_size);
       auto *bv = new pasta::BitVector(block_text_inx.size(), false);
       auto left = pasta::BitVector(block_text_inx.size(), false);
@@ -234,17 +228,12 @@ public:
                                 block_size) != text.size()
               ? 1
               : 0;
-      std::unordered_map<MersenneHash<uint8_t>, std::vector<size_type>> pairs(
-          0);
-      std::unordered_map<MersenneHash<uint8_t>, std::vector<size_type>> blocks =
-          std::unordered_map<MersenneHash<uint8_t>, std::vector<size_type>>();
+      FingerprintMap pairs(0);
+      FingerprintMap blocks = FingerprintMap();
       for (uint64_t i = 0; i < block_text_inx.size() - last_block_padded; i++) {
         auto index = block_text_inx[i];
-        MersenneRabinKarp<input_type, size_type> rk_block =
-            MersenneRabinKarp<input_type, size_type>(text, sigma_, index,
-                                                     block_size, kPrime);
-        MersenneHash<input_type> mh_block =
-            MersenneHash<input_type>(text, rk_block.hash_, index, block_size);
+        KarpRabin rk_block = rolling_hash(text, index, block_size);
+        Fingerprint mh_block = fingerprint(text, rk_block, index, block_size);
         blocks[mh_block].push_back(i);
       }
       std::vector<size_type> pointers(block_text_inx.size(), -1);
@@ -262,15 +251,20 @@ public:
             }
           }
         }
-        std::vector<size_type> p(block_text_inx.size(), -1);
-        std::vector<size_type> o(block_text_inx.size(), 0);
-        std::vector<size_type> c(block_text_inx.size(), 0);
-        blk_lvl.push_back(block_text_inx);
-        block_text_inx = new_blocks;
+        int64_t lvl_size = block_text_inx.size();
+        std::vector<size_type> p(lvl_size, -1);
+        std::vector<size_type> o(lvl_size, 0);
+        std::vector<size_type> c(lvl_size, 0);
+        last_block_start.push_back(block_text_inx.back());
+        last_lvl_inx = std::move(block_text_inx);
+        block_text_inx = std::move(new_blocks);
         bv_marked.push_back(bv);
-        pass1_pointer.push_back(p);
-        pass1_offset.push_back(o);
-        counter.push_back(c);
+        pass1_pointer.push_back(
+            to_level_vector<level_vector>(std::move(p), PRUNED, lvl_size));
+        pass1_offset.push_back(to_level_vector<level_vector>(
+            std::move(o), 0, block_size_lvl_temp.back()));
+        counter.push_back(
+            to_level_vector<level_vector>(std::move(c), 0, 2 * lvl_size));
         continue;
       }
       for (uint64_t i = 0; i < block_text_inx.size() - 1; i++) {
@@ -278,21 +272,22 @@ public:
             static_cast<uint64_t>(block_text_inx[i] + pair_size) <=
                 text.size()) {
           auto index = block_text_inx[i];
-          MersenneRabinKarp<input_type, size_type> rk_pair =
-              MersenneRabinKarp<input_type, size_type>(text, sigma_, index,
-                                                       pair_size, kPrime);
-          MersenneHash<input_type> mh_pair =
-              MersenneHash<input_type>(text, rk_pair.hash_, index, pair_size);
+          KarpRabin rk_pair = rolling_hash(text, index, pair_size);
+          Fingerprint mh_pair = fingerprint(text, rk_pair, index, pair_size);
           pairs[mh_pair].push_back(i);
         }
       }
+      // the fingerprint maps are largest once the pairs are added
+      int64_t level_bytes =
+          pruning_space_usage(counter, pass1_pointer, pass1_offset, bv_marked) +
+          allocated_bytes(*bv, left, right, pointers, offsets, counters,
+                          last_lvl_inx, block_text_inx);
+      level_memory_ = std::max<int64_t>(
+          level_memory_, level_bytes + allocated_bytes(blocks, pairs));
       // find pairs
-      MersenneRabinKarp<input_type, size_type> rk_pair_sw =
-          MersenneRabinKarp<input_type, size_type>(text, sigma_, 0, pair_size,
-                                                   kPrime);
+      KarpRabin rk_pair_sw = rolling_hash(text, 0, pair_size);
       for (uint64_t i = 0; i < text.size() - pair_size; i++) {
-        MersenneHash<input_type> mh_sw =
-            MersenneHash<input_type>(text, rk_pair_sw.hash_, i, pair_size);
+        Fingerprint mh_sw = fingerprint(text, rk_pair_sw, i, pair_size);
         if (pairs.find(mh_sw) != pairs.end()) {
           for (auto b : pairs[mh_sw]) {
             if (i != static_cast<uint64_t>(block_text_inx[b])) {
@@ -329,9 +324,11 @@ public:
           }
         }
       }
-      MersenneRabinKarp<input_type, size_type> rk_first_occ =
-          MersenneRabinKarp<input_type, size_type>(
-              text, sigma_, block_text_inx[0], block_size, kPrime);
+      level_memory_ = std::max<int64_t>(
+          level_memory_,
+          level_bytes + allocated_bytes(blocks, pairs, new_blocks));
+      KarpRabin rk_first_occ =
+          rolling_hash(text, block_text_inx[0], block_size);
       for (int64_t i = 0; static_cast<uint64_t>(i) < block_text_inx.size() - 1;
            i++) {
         bool followed =
@@ -347,8 +344,8 @@ public:
                                 static_cast<uint64_t>(block_text_inx[i] + j +
                                                       block_size) < text.size();
                  j++) {
-              MersenneHash<input_type> mh_first_occ = MersenneHash<input_type>(
-                  text, rk_first_occ.hash_, block_text_inx[i] + j, block_size);
+              Fingerprint mh_first_occ = fingerprint(
+                  text, rk_first_occ, block_text_inx[i] + j, block_size);
               if (blocks.find(mh_first_occ) != blocks.end()) {
                 for (auto b : blocks[mh_first_occ]) {
                   // b cant be i and if j>0 then b cant follow on i (j>0) -> b >
@@ -369,8 +366,8 @@ public:
               rk_first_occ.next();
             }
           } else {
-            MersenneHash<input_type> mh_first_occ = MersenneHash<input_type>(
-                text, rk_first_occ.hash_, block_text_inx[i], block_size);
+            Fingerprint mh_first_occ = fingerprint(
+                text, rk_first_occ, block_text_inx[i], block_size);
             if (blocks.find(mh_first_occ) != blocks.end()) {
               for (auto b : blocks[mh_first_occ]) {
                 if (b != i) {
@@ -383,19 +380,44 @@ public:
           }
         }
       }
-      pass1_pointer.push_back(pointers);
-      pass1_offset.push_back(offsets);
-      counter.push_back(counters);
+      if (fingerprint_mode_ != FingerprintMode::VERIFY &&
+          keep_former_occurrences(*bv, pointers, offsets) > 0) {
+        // blocks without a former occurrence are marked now, add their
+        // children in text order
+        new_blocks.clear();
+        for (uint64_t i = 0; i < block_text_inx.size(); i++) {
+          for (size_type j = 0; (*bv)[i] == 1 && j < this->tau_; j++) {
+            if (static_cast<uint64_t>(block_text_inx[i] +
+                                      (j * new_block_size)) < text.size()) {
+              new_blocks.push_back(block_text_inx[i] + (j * new_block_size));
+            }
+          }
+        }
+      }
+      int64_t lvl_size = block_text_inx.size();
       const_size += pointers.size() * sizeof(size_type) * 2;
-      blk_lvl.push_back(block_text_inx);
-      block_text_inx = new_blocks;
+      pass1_pointer.push_back(
+          to_level_vector<level_vector>(std::move(pointers), PRUNED, lvl_size));
+      pass1_offset.push_back(to_level_vector<level_vector>(
+          std::move(offsets), 0, block_size_lvl_temp.back()));
+      counter.push_back(
+          to_level_vector<level_vector>(std::move(counters), 0, 2 * lvl_size));
+      last_block_start.push_back(block_text_inx.back());
+      last_lvl_inx = std::move(block_text_inx);
+      block_text_inx = std::move(new_blocks);
       block_size = new_block_size;
       bv_marked.push_back(bv);
     }
     this->leaf_size = block_size;
     block_size *= this->tau_;
+    level_memory_ = std::max<int64_t>(
+        level_memory_,
+        pruning_space_usage(counter, pass1_pointer, pass1_offset, bv_marked) +
+            allocated_bytes(block_text_inx, last_lvl_inx));
+    ProfilePhase phase("prune");
     pruning_extended(counter, pass1_pointer, pass1_offset, bv_marked,
                      bv_marked);
+    phase.next("compact");
 
     std::vector<size_type> ones_per_lvl(bv_marked.size(), 0);
     // count 1s in each lvl;
@@ -413,8 +435,8 @@ public:
         top_level.size() != static_cast<uint64_t>(ones_per_lvl[0]) ||
         bv_marked.size() == 1;
     if (found_back_block || !this->CUT_FIRST_LEVELS) {
-      this->block_tree_types_.push_back(&top_level);
-      this->block_tree_types_rs_.push_back(
+      this->block_tree_types_.emplace_back(&top_level);
+      this->block_tree_types_rs_.emplace_back(
           new pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>(top_level));
       auto p0 = new sdsl::int_vector<>(top_level.size() - ones_per_lvl[0], 0);
       auto o0 = new sdsl::int_vector<>(top_level.size() - ones_per_lvl[0], 0);
@@ -430,16 +452,18 @@ public:
       }
       sdsl::util::bit_compress(ptr0);
       sdsl::util::bit_compress(off0);
-      this->block_tree_pointers_.push_back(p0);
-      this->block_tree_offsets_.push_back(o0);
+      this->block_tree_pointers_.emplace_back(p0);
+      this->block_tree_offsets_.emplace_back(o0);
       this->block_size_lvl_.push_back(block_size_lvl_temp[0]);
     } else {
       delete bv_marked[0];
     }
+    // levels of the final tree and their sizes
+    std::vector<int64_t> levels;
+    std::vector<int64_t> level_sizes;
     for (uint64_t i = 1; i < bv_marked.size(); i++) {
-
       size_type new_size = (ones_per_lvl[i - 1] - is_padded) * this->tau_;
-      auto last_block_parent = blk_lvl[i - 1][blk_lvl[i - 1].size() - 1];
+      auto last_block_parent = last_block_start[i - 1];
       auto lvl_block_size = block_size_lvl_temp[i];
       if (is_padded) {
         for (uint64_t j = 0; j < static_cast<uint64_t>(this->tau_); j++) {
@@ -448,65 +472,28 @@ public:
           }
         }
       }
-      found_back_block |= new_size != ones_per_lvl[i];
+      // the last level is kept even if no level has back blocks
+      found_back_block |=
+          new_size != ones_per_lvl[i] || i + 1 == bv_marked.size();
       if (found_back_block || !this->CUT_FIRST_LEVELS) {
-        auto bit_vector = new pasta::BitVector(new_size, 0);
-        auto &bv_ref = *bit_vector;
-        auto p = new sdsl::int_vector<>(bv_ref.size() - ones_per_lvl[i], 0);
-        auto o = new sdsl::int_vector<>(bv_ref.size() - ones_per_lvl[i], 0);
-        auto &ptr = *p;
-        auto &off = *o;
-        std::unordered_map<size_type, size_type> blocks_skipped;
-        auto &lvl_pass1 = *bv_marked[i];
-        size_type c = 0;
-        size_type c_u = 0;
-        for (uint64_t j = 0; j < lvl_pass1.size(); j++) {
-          blocks_skipped[j] = j - c;
-          if (pass1_pointer[i][j] != -2) {
-            bv_ref[c] = (bool)lvl_pass1[j];
-            if (!lvl_pass1[j]) {
-              ptr[c_u] =
-                  pass1_pointer[i][j] - blocks_skipped[pass1_pointer[i][j]];
-              off[c_u] = pass1_offset[i][j];
-              c_u++;
-            }
-            c++;
-          }
-        }
-        this->block_tree_types_.push_back(&bv_ref);
-        this->block_tree_types_rs_.push_back(
-            new pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>(bv_ref));
-        sdsl::util::bit_compress(ptr);
-        sdsl::util::bit_compress(off);
-        this->block_tree_pointers_.push_back(p);
-        this->block_tree_offsets_.push_back(o);
-        this->block_size_lvl_.push_back(block_size_lvl_temp[i]);
-      } else {
-        delete bv_marked[i];
+        levels.push_back(i);
+        level_sizes.push_back(new_size);
       }
     }
+    this->append_compacted_levels(bv_marked, pass1_pointer, pass1_offset,
+                                  levels, level_sizes, block_size_lvl_temp,
+                                  PRUNED, 1);
 
-    int64_t leaf_count = 0;
-    auto &last_level = (*bv_marked[bv_marked.size() - 1]);
-    for (uint64_t i = 0; i < last_level.size(); i++) {
-      if (last_level[i] == 1) {
-        leaf_count += this->tau_;
-        for (uint64_t j = 0;
-             j < static_cast<uint64_t>(this->leaf_size * this->tau_); j++) {
-          if (static_cast<uint64_t>(blk_lvl[blk_lvl.size() - 1][i] + j) <
-              text.size()) {
-            this->leaves_.push_back(text[blk_lvl[blk_lvl.size() - 1][i] + j]);
-          }
-        }
-      }
+    phase.next("compress_leaves");
+    this->compress_leaves(text, *bv_marked.back(), last_lvl_inx, 1);
+    // the final levels are copies, the marked tree is not needed anymore
+    for (uint64_t i = 1; i < bv_marked.size(); i++) {
+      delete bv_marked[i];
     }
-    this->amount_of_leaves = leaf_count;
-    this->compress_leaves();
     return 0;
   }
 
-  int32_t init_simple(std::vector<input_type> &text) {
-    static constexpr uint128_t kPrime = 2305843009213693951ULL;
+  int32_t init_simple(text_type const &text) {
     int64_t added_padding = 0;
     int64_t tree_max_height = 0;
     int64_t max_blk_size = 0;
@@ -531,7 +518,7 @@ public:
     }
     if (block_size <= this->max_leaf_length_) {
       auto *bv = new pasta::BitVector(block_text_inx.size(), 1);
-      this->block_tree_types_rs_.push_back(
+      this->block_tree_types_rs_.emplace_back(
           new pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>(*bv));
       auto p0 = new sdsl::int_vector<>(0, 0);
       auto o0 = new sdsl::int_vector<>(0, 0);
@@ -539,9 +526,9 @@ public:
       auto &off0 = *o0;
       sdsl::util::bit_compress(ptr0);
       sdsl::util::bit_compress(off0);
-      this->block_tree_types_.push_back(bv);
-      this->block_tree_pointers_.push_back(p0);
-      this->block_tree_offsets_.push_back(o0);
+      this->block_tree_types_.emplace_back(bv);
+      this->block_tree_pointers_.emplace_back(p0);
+      this->block_tree_offsets_.emplace_back(o0);
       this->block_size_lvl_.push_back(block_size);
       this->leaf_size = block_size / this->tau_;
       this->leaves_ = std::vector<input_type>(text.begin(), text.end());
@@ -550,6 +537,9 @@ public:
     }
     bool found_back_block = this->max_leaf_length_ * this->tau_ >= block_size;
     while (block_size > this->max_leaf_length_) {
+      ProfilePhase phase("level", block_size_lvl_temp.size());
+      phase.set_estimated_bytes((2 * sizeof(size_type) + 1) *
+                                block_text_inx.size());
       block_size_lvl_temp.push_back(block_size);
       auto *bv = new pasta::BitVector(block_text_inx.size(), false);
       auto left = pasta::BitVector(block_text_inx.size(), false);
@@ -560,17 +550,12 @@ public:
                                 block_size) != text.size()
               ? 1
               : 0;
-      std::unordered_map<MersenneHash<uint8_t>, std::vector<size_type>> pairs(
-          0);
-      std::unordered_map<MersenneHash<uint8_t>, std::vector<size_type>> blocks =
-          std::unordered_map<MersenneHash<uint8_t>, std::vector<size_type>>();
+      FingerprintMap pairs(0);
+      FingerprintMap blocks = FingerprintMap();
       for (uint64_t i = 0; i < block_text_inx.size() - last_block_padded; i++) {
         auto index = block_text_inx[i];
-        MersenneRabinKarp<input_type, size_type> rk_block =
-            MersenneRabinKarp<input_type, size_type>(text, sigma_, index,
-                                                     block_size, kPrime);
-        MersenneHash<input_type> mh_block =
-            MersenneHash<input_type>(text, rk_block.hash_, index, block_size);
+        KarpRabin rk_block = rolling_hash(text, index, block_size);
+        Fingerprint mh_block = fingerprint(text, rk_block, index, block_size);
         blocks[mh_block].push_back(i);
       }
       std::vector<size_type> pointers(block_text_inx.size(), -1);
@@ -601,21 +586,15 @@ public:
             static_cast<uint64_t>(block_text_inx[i] + pair_size) <=
                 text.size()) {
           auto index = block_text_inx[i];
-          MersenneRabinKarp<input_type, size_type> rk_pair =
-              MersenneRabinKarp<input_type, size_type>(text, sigma_, index,
-                                                       pair_size, kPrime);
-          MersenneHash<input_type> mh_pair =
-              MersenneHash<input_type>(text, rk_pair.hash_, index, pair_size);
+          KarpRabin rk_pair = rolling_hash(text, index, pair_size);
+          Fingerprint mh_pair = fingerprint(text, rk_pair, index, pair_size);
           pairs[mh_pair].push_back(i);
         }
       }
       // find pairs
-      MersenneRabinKarp<input_type, size_type> rk_pair_sw =
-          MersenneRabinKarp<input_type, size_type>(text, sigma_, 0, pair_size,
-                                                   kPrime);
+      KarpRabin rk_pair_sw = rolling_hash(text, 0, pair_size);
       for (uint64_t i = 0; i < text.size() - pair_size; i++) {
-        MersenneHash<input_type> mh_sw =
-            MersenneHash<input_type>(text, rk_pair_sw.hash_, i, pair_size);
+        Fingerprint mh_sw = fingerprint(text, rk_pair_sw, i, pair_size);
         if (pairs.find(mh_sw) != pairs.end()) {
           for (auto b : pairs[mh_sw]) {
             if (i != static_cast<uint64_t>(block_text_inx[b])) {
@@ -653,9 +632,8 @@ public:
         }
       }
       for (uint64_t i = 0; i < block_text_inx.size() - 1; i++) {
-        MersenneRabinKarp<input_type, size_type> rk_first_occ =
-            MersenneRabinKarp<input_type, size_type>(
-                text, sigma_, block_text_inx[i], block_size, kPrime);
+        KarpRabin rk_first_occ =
+            rolling_hash(text, block_text_inx[i], block_size);
         bool followed =
             (i < block_text_inx.size() - 1) &&
             block_text_inx[i] + block_size == block_text_inx[i + 1] &&
@@ -666,8 +644,8 @@ public:
                  j < static_cast<uint64_t>(block_size) &&
                  block_text_inx[i] + j + block_size < text.size();
                  j++) {
-              MersenneHash<input_type> mh_first_occ = MersenneHash<input_type>(
-                  text, rk_first_occ.hash_, block_text_inx[i] + j, block_size);
+              Fingerprint mh_first_occ = fingerprint(
+                  text, rk_first_occ, block_text_inx[i] + j, block_size);
               if (blocks.find(mh_first_occ) != blocks.end()) {
                 for (auto b : blocks[mh_first_occ]) {
                   if (static_cast<uint64_t>(b) != i) {
@@ -680,8 +658,8 @@ public:
               rk_first_occ.next();
             }
           } else {
-            MersenneHash<input_type> mh_first_occ = MersenneHash<input_type>(
-                text, rk_first_occ.hash_, block_text_inx[i], block_size);
+            Fingerprint mh_first_occ = fingerprint(
+                text, rk_first_occ, block_text_inx[i], block_size);
             if (blocks.find(mh_first_occ) != blocks.end()) {
               for (auto b : blocks[mh_first_occ]) {
                 if (static_cast<uint64_t>(b) != i) {
@@ -704,14 +682,20 @@ public:
     }
     this->leaf_size = block_size;
     block_size *= this->tau_;
+    ProfilePhase phase("prune");
     pruning_simple(bv_pass_1, blk_lvl, bv_pass_2, pass1_pointer, pass1_offset,
                    pass2_pointer, pass2_offset, pass2_max_pointer,
                    pass2_max_offset, pass2_ones, block_size);
+    phase.next("compact");
     auto size = pass2_pointer[pass2_pointer.size() - 1].size();
     found_back_block |= size != 0;
-    if (found_back_block || !this->CUT_FIRST_LEVELS) {
-      this->block_tree_types_.push_back(bv_pass_2[bv_pass_2.size() - 1]);
-      this->block_tree_types_rs_.push_back(
+    // the marked levels of the second pass are read while the levels below
+    // are compacted, hence they are only deleted afterwards, except for the
+    // top level if it is kept
+    bool keep_top_level = found_back_block || !this->CUT_FIRST_LEVELS;
+    if (keep_top_level) {
+      this->block_tree_types_.emplace_back(bv_pass_2[bv_pass_2.size() - 1]);
+      this->block_tree_types_rs_.emplace_back(
           new pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>(
               *bv_pass_2[bv_pass_2.size() - 1]));
 
@@ -730,11 +714,9 @@ public:
         (*p1)[i] = pass2_pointer[pass2_pointer.size() - 1][size - 1 - i];
         (*o1)[i] = pass2_offset[pass2_offset.size() - 1][size - 1 - i];
       }
-      this->block_tree_pointers_.push_back(p1);
-      this->block_tree_offsets_.push_back(o1);
+      this->block_tree_pointers_.emplace_back(p1);
+      this->block_tree_offsets_.emplace_back(o1);
       this->block_size_lvl_.push_back(block_size_lvl_temp[0]);
-    } else {
-      delete bv_pass_2[bv_pass_2.size() - 1];
     }
 
     size_type level = 0;
@@ -756,37 +738,60 @@ public:
           }
         }
       }
-      found_back_block |= new_size != pass2_ones[i];
+      // the last level is kept even if no level has back blocks
+      found_back_block |= new_size != pass2_ones[i] || i == 0;
       if (found_back_block || !this->CUT_FIRST_LEVELS) {
         auto *bit_vector = new pasta::BitVector(new_size, 0);
-        auto pointer = std::vector<size_type>();
-        auto offset = std::vector<size_type>();
-        size_type pointer_saved = 0;
-        size_type pointer_skipped = 0;
-        std::unordered_map<size_type, size_type> blocks_skipped;
+        auto &parents = *bv_pass_1[pass1_i - 1];
+        auto &kept_parents = *bv_pass_2[i + 1];
+        auto &lvl = *bv_pass_2[i];
+        // a block is kept if its parent is kept, its new position is the
+        // number of kept blocks in front of it
+        pasta::BitVector kept(lvl.size(), 0);
+        size_type pointer_count = 0;
         size_type skip = 0;
         size_type replace = 0;
-        for (uint64_t j = 0; j < bv_pass_1[pass1_i - 1]->size(); j++) {
-          if ((*bv_pass_1[pass1_i - 1])[j] == 1) {
-            if ((*bv_pass_2[i + 1])[j] == 1) {
+        for (uint64_t j = 0; j < parents.size(); j++) {
+          if (parents[j] == 0) {
+            skip++;
+          } else if (kept_parents[j] == 1) {
+            for (size_type k = 0;
+                 k < this->tau_ && replace * this->tau_ + k < new_size; k++) {
+              kept[(j - skip) * this->tau_ + k] = 1;
+              pointer_count += lvl[(j - skip) * this->tau_ + k] == 0;
+            }
+            replace++;
+          }
+        }
+        pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES> kept_rs(kept);
+        auto p = new sdsl::int_vector<>(
+            pointer_count, 0,
+            (8 * sizeof(size_type)) -
+                this->leading_zeros(pass2_max_pointer[i]));
+        auto o = new sdsl::int_vector<>(
+            pointer_count, 0,
+            (8 * sizeof(size_type)) - this->leading_zeros(pass2_max_offset[i]));
+        size_type pointer_saved = 0;
+        size_type pointer_skipped = 0;
+        skip = 0;
+        replace = 0;
+        for (uint64_t j = 0; j < parents.size(); j++) {
+          if (parents[j] == 1) {
+            if (kept_parents[j] == 1) {
               for (size_type k = 0;
                    k < this->tau_ && replace * this->tau_ + k < new_size; k++) {
-                bool x = (*bv_pass_2[i])[(j - skip) * this->tau_ + k];
+                bool x = lvl[(j - skip) * this->tau_ + k];
                 auto skipper = pointer_skipped + pointer_saved;
                 (*bit_vector)[replace * this->tau_ + k] = x;
                 if (x == 0) {
                   size_type z =
                       pass2_pointer[i][pass2_pointer[i].size() - 1 - skipper];
-                  size_type y = blocks_skipped[z];
-                  pointer.push_back(y);
-                  offset.push_back(
-                      pass2_offset[i][pass2_offset[i].size() - 1 - skipper]);
+                  (*p)[pointer_saved] = kept_rs.rank1(z);
+                  (*o)[pointer_saved] =
+                      pass2_offset[i][pass2_offset[i].size() - 1 - skipper];
                   pointer_saved++;
                 }
-                blocks_skipped[(j - skip) * this->tau_ + k] =
-                    replace * this->tau_ + k;
               }
-
               replace++;
             } else {
               pointer_skipped += this->tau_;
@@ -795,75 +800,81 @@ public:
             skip++;
           }
         }
-        auto p = new sdsl::int_vector<>(
-            pointer.size(), 0,
-            (8 * sizeof(size_type)) -
-                this->leading_zeros(pass2_max_pointer[i]));
-        auto o = new sdsl::int_vector<>(
-            pointer.size(), 0,
-            (8 * sizeof(size_type)) - this->leading_zeros(pass2_max_offset[i]));
-        for (uint64_t j = 0; j < pointer.size(); j++) {
-          (*p)[j] = pointer[j];
-          (*o)[j] = offset[j];
-        }
         this->block_size_lvl_.push_back(block_size_lvl_temp[level]);
-        this->block_tree_pointers_.push_back(p);
-        this->block_tree_offsets_.push_back(o);
-        this->block_tree_types_.push_back(bit_vector);
-        this->block_tree_types_rs_.push_back(
+        this->block_tree_pointers_.emplace_back(p);
+        this->block_tree_offsets_.emplace_back(o);
+        this->block_tree_types_.emplace_back(bit_vector);
+        this->block_tree_types_rs_.emplace_back(
             new pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>(
                 *bit_vector));
       }
     }
 
-    int64_t leaf_count = 0;
-    for (uint64_t i = 0; i < bv_pass_2[0]->size(); i++) {
-      if ((*bv_pass_2[0])[i] == 1) {
-        leaf_count += this->tau_;
-        for (int j = 0; j < this->leaf_size * this->tau_; j++) {
-          if (static_cast<uint64_t>(blk_lvl[blk_lvl.size() - 1][i] + j) <
-              text.size()) {
-            this->leaves_.push_back(text[blk_lvl[blk_lvl.size() - 1][i] + j]);
-          }
-        }
-      }
-    }
-    this->amount_of_leaves = leaf_count;
-    this->compress_leaves();
+    phase.next("compress_leaves");
+    this->compress_leaves(text, *bv_pass_2[0], blk_lvl.back(), 1);
     for (auto bv : bv_pass_1) {
       delete bv;
     }
+    bv_pass_2.resize(bv_pass_2.size() - (keep_top_level ? 1 : 0));
+    for (auto bv : bv_pass_2) {
+      delete bv;
+    }
     return 0;
   };
 
-  BlockTreeFP(std::vector<input_type> &text, size_type tau,
+  BlockTreeFP(text_type const &text, size_type tau,
               size_type max_leaf_length, size_type s, size_type sigma,
-              bool cut_first_levels, bool extended_prune) {
+              bool cut_first_levels, bool extended_prune,
+              FingerprintMode fingerprint_mode = FingerprintMode::VERIFY,
+              bool packed_temporaries = false)
+      : BlockTreeFP(text, tau, max_leaf_length, s, sigma, cut_first_levels,
+                    extended_prune, fingerprint_mode, packed_temporaries,
+                    TRUSTED_PRIME) {}
+
+protected:
+  // modulus of trusted fingerprints, the Mersenne prime 2^61-1 unless a test
+  // forces collisions with a smaller one
+  uint64_t trusted_prime_ = TRUSTED_PRIME;
+
+  // Lets tests trust fingerprints modulo a small prime to force collisions.
+  BlockTreeFP(text_type const &text, size_type tau,
+              size_type max_leaf_length, size_type s, size_type sigma,
+              bool cut_first_levels, bool extended_prune,
+              FingerprintMode fingerprint_mode, bool packed_temporaries,
+              uint64_t trusted_prime) {
     sigma_ = sigma;
+    // the simple pruning cannot handle the pointers of colliding fingerprints
+    fingerprint_mode_ =
+        extended_prune ? fingerprint_mode : FingerprintMode::VERIFY;
+    trusted_prime_ = trusted_prime;
+    packed_temporaries_ = packed_temporaries;
     this->CUT_FIRST_LEVELS = cut_first_levels;
     this->map_unique_chars(text);
     this->tau_ = tau;
     this->max_leaf_length_ = max_leaf_length;
     this->s_ = s;
-    if (extended_prune) {
-      init_extended(text);
-    } else {
-      init_simple(text);
-    }
-  };
-
-  ~BlockTreeFP() {
-    for (auto &bt_t : this->block_tree_types_) {
-      delete bt_t;
-    }
-    for (auto &bt_rs : this->block_tree_types_rs_) {
-      delete bt_rs;
-    }
-    for (auto &bt_p : this->block_tree_pointers_) {
-      delete bt_p;
-    }
-    for (auto &bt_o : this->block_tree_offsets_) {
-      delete bt_o;
+    auto build = [&]() {
+      if (!extended_prune) {
+        init_simple(text);
+      } else if (packed_temporaries_) {
+        init_extended<PackedIntVector>(text);
+      } else {
+        init_extended(text);
+      }
+    };
+    build();
+    if (fingerprint_mode_ != FingerprintMode::VERIFY) {
+      fingerprint_stats_.collisions =
+          this->verify_pointers(text, fingerprint_stats_.checked_pointers);
+      if (fingerprint_stats_.collisions > 0) {
+        // a collision produced a wrong pointer, fall back to verified hashing
+        this->clear_levels();
+        level_memory_ = 0;
+        const_size = 0;
+        fingerprint_mode_ = FingerprintMode::VERIFY;
+        fingerprint_stats_.rebuilds++;
+        build();
+      }
     }
   };
 
@@ -872,13 +883,72 @@ private:
   const int PRUNED = -2;
   // magic number to indicate that a block has no occurrences to its left side
   const int NO_FORMER_OCC = -1;
+  static constexpr uint128_t kPrime = 2305843009213693951ULL;
+  // Bases used when fingerprints are trusted. sigma_ is usually 256, a power of
+  // two, for which exchanging two characters 61 positions apart does not change
+  // the fingerprint modulo 2^61-1. This is fine when hits are verified but
+  // leads to frequent collisions otherwise.
+  static constexpr uint64_t kFirstBase = 1962591571374372421ULL;
+  static constexpr uint64_t kSecondBase = 1795099123316223491ULL;
+
+  // A collision of trusted fingerprints can leave an unmarked block without a
+  // pointer or let a block point to itself or to a later block, which the
+  // pruning cannot handle. Such pointers are removed and their blocks marked,
+  // so that the tree can be built and then checked against the text. Returns
+  // the number of blocks that are marked.
+  int64_t keep_former_occurrences(pasta::BitVector &bv,
+                                  std::vector<size_type> &pointers,
+                                  std::vector<size_type> const &offsets) {
+    int64_t marked = 0;
+    for (int64_t b = 0; b < static_cast<int64_t>(pointers.size()); b++) {
+      bool former = pointers[b] >= 0 && pointers[b] + (offsets[b] > 0) < b;
+      if (!former) {
+        pointers[b] = NO_FORMER_OCC;
+        if (bv[b] == 0) {
+          bv[b] = 1;
+          marked++;
+        }
+      }
+    }
+    return marked;
+  }
+
+  KarpRabin rolling_hash(text_type const &text, uint64_t init,
+                         uint64_t length) {
+    if (fingerprint_mode_ == FingerprintMode::VERIFY) {
+      // characters of wider alphabets can exceed sigma_, which would make
+      // shifted characters collide
+      uint64_t base = (sizeof(input_type) == 1) ? sigma_ : kFirstBase;
+      return KarpRabin(text, base, init, length, kPrime);
+    }
+    uint64_t second_base =
+        (fingerprint_mode_ == FingerprintMode::TRUST_DOUBLE) ? kSecondBase : 0;
+    return KarpRabin(text, kFirstBase, init, length, trusted_prime_,
+                     second_base);
+  }
+
+  Fingerprint fingerprint(text_type const &text, KarpRabin const &rk,
+                          uint64_t start, uint64_t length) {
+    return Fingerprint(text, rk.hash_, start, length, rk.hash2_,
+                       fingerprint_mode_ == FingerprintMode::VERIFY);
+  }
 };
 
+// If memory_budget > 0 and the construction is predicted to need more than
+// memory_budget bytes besides the text, the pointers, offsets and counters of
+// the levels are bit packed.
 template <typename input_type, typename size_type>
-auto *make_block_tree_fp(std::vector<input_type> &input, size_type const tau,
-                         size_type const max_leaf_length) {
-  return new BlockTreeFP<input_type, size_type>(input, tau, max_leaf_length, 1,
-                                                256, true, true);
+auto *make_block_tree_fp(
+    std::vector<input_type> &input, size_type const tau,
+    size_type const max_leaf_length,
+    FingerprintMode const fingerprint_mode = FingerprintMode::VERIFY,
+    int64_t const memory_budget = 0) {
+  using Tree = BlockTreeFP<input_type, size_type>;
+  bool packed = memory_budget > 0 &&
+                predict_level_memory(input.size(), tau, max_leaf_length, false,
+                                     Tree::HASH_ENTRY_BYTES) > memory_budget;
+  return new Tree(input, tau, max_leaf_length, 1, 256, true, true,
+                  fingerprint_mode, packed);
 }
 
 } // namespace pasta
@@ -21,16 +21,41 @@
 #pragma once
 
 #include "pasta/block_tree/block_tree.hpp"
+#include "pasta/block_tree/utils/build_profiler.hpp"
+#include "pasta/block_tree/utils/int40_vector.hpp"
 #include "pasta/block_tree/utils/lpf_array.hpp"
+#include "pasta/block_tree/utils/memory_budget.hpp"
+#include "pasta/block_tree/utils/packed_int_vector.hpp"
+#include "pasta/block_tree/utils/prefix_sum.hpp"
+#include "pasta/block_tree/utils/pruning.hpp"
+
+#include <type_traits>
 
 namespace pasta {
 
 template <typename input_type, typename size_type>
 class BlockTreeLPF : public BlockTree<input_type, size_type> {
 public:
+  // number of threads used for the construction of the levels
+  int32_t threads_ = 1;
+  // bytes used by the phases of the parallel LPF array construction
+  LpfMemoryUsage lpf_memory_;
+  // largest number of bytes held by the per-level temporaries at the same time
+  int64_t level_memory_ = 0;
+  // bytes of the LPF array and the previous occurrences while the levels are
+  // built
+  int64_t lpf_array_memory_ = 0;
+
+  // Largest number of bytes held by the buffers of the construction at the
+  // same time, measured from their sizes. The text and the tree are excluded.
+  int64_t peak_memory() const {
+    return std::max(lpf_memory_.peak(), lpf_array_memory_ + level_memory_);
+  }
+
   BlockTreeLPF(std::vector<input_type> &text, size_type tau,
                size_type max_leaf_length, size_type s, bool mark,
                bool cut_first_level, bool dp, size_t const threads) {
+    threads_ = std::max<int32_t>(1, threads);
     this->CUT_FIRST_LEVELS = cut_first_level;
     this->map_unique_chars(text);
     this->tau_ = tau;
@@ -41,97 +66,38 @@ public:
     if (threads == 0) {
       lpf_array_stack(text, lpf, lpf_ptr);
     } else {
-      lpf_array_ansv(text, lpf, lpf_ptr, threads);
+      lpf_array_ansv(text, lpf, lpf_ptr, threads, &lpf_memory_);
     }
     if (dp)
       init_dp(text, lpf, lpf_ptr, mark);
     else
       init(text, lpf, lpf_ptr, mark);
   };
-  bool prune_block(
-      std::vector<std::vector<size_type>> &counter,
-      std::vector<std::vector<size_type>> &pointer,
-      std::vector<std::vector<size_type>> &offset,
+  template <typename level_vector>
+  int32_t pruning_extended(
+      std::vector<level_vector> &counter, std::vector<level_vector> &pointer,
+      std::vector<level_vector> &offset,
       std::vector<pasta::BitVector *> &marked_tree,
-      std::vector<pasta::BitVector *> &pruned_tree, size_type i, size_type j,
-      std::vector<pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>> &ranks) {
-    // string leaf children can always be pruned
-    // fully padded children don't exist and can be ignored/ sanity check
-    // assumes short circuit evaluation as compiler behaviour
-    if (static_cast<uint64_t>(i) >= marked_tree.size() ||
-        static_cast<uint64_t>(j) >= marked_tree[i]->size()) {
-      return false;
-    }
-
-    bool marked_children = false;
-    // we already incremented counters for unmarked blocks during a previous
-    // step and now only need to consider marked blocks
-    if ((*marked_tree[i])[j] == 1) {
-      // inverse postorder dfs
-      // prune_block returns true if a marked block stays marked false otherwise
-      size_type rank_blk = ranks[i].rank1(j);
-      for (size_type k = this->tau_ - 1; k >= 0; k--) {
-        marked_children |=
-            prune_block(counter, pointer, offset, marked_tree, pruned_tree,
-                        i + 1, rank_blk * this->tau_ + k, ranks);
-      }
-      // conditions to be pruned are no marked children, no pointers pointing to
-      // me and a former occurrence in S
-      if (!marked_children && counter[i][j] == 0 &&
-          pointer[i][j] != NO_FORMER_OCC) {
-
-        (*marked_tree[i])[j] = 0;
-        counter[i][pointer[i][j]]++;
-        if (offset[i][j] > 0) {
-          counter[i][pointer[i][j] + 1]++;
-        }
-        if (static_cast<uint64_t>(i + 1) < counter.size()) {
-          // remove all of its children by decrementing counters and marking
-          // them as PRUNED
-          for (size_type k = this->tau_ - 1; k >= 0; k--) {
-            if (static_cast<uint64_t>(rank_blk * this->tau_ + k) <
-                counter[i + 1].size()) {
-              auto ptr_child = pointer[i + 1][rank_blk * this->tau_ + k];
-              counter[i + 1][ptr_child]--;
-              if (offset[i + 1][rank_blk * this->tau_ + k] > 0) {
-                counter[i + 1][ptr_child + 1]--;
-              }
-              pointer[i + 1][rank_blk * this->tau_ + k] = PRUNED;
-            }
-          }
-        }
-      }
-    }
-    return marked_children || counter[i][j] > 0 ||
-           pointer[i][j] == NO_FORMER_OCC;
-  }
-  int32_t pruning_extended(std::vector<std::vector<size_type>> &counter,
-                           std::vector<std::vector<size_type>> &pointer,
-                           std::vector<std::vector<size_type>> &offset,
-                           std::vector<pasta::BitVector *> &marked_tree,
-                           std::vector<pasta::BitVector *> &pruned_tree) {
-    std::vector<pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>> ranks;
-    for (auto bv : marked_tree) {
-      ranks.emplace_back(*bv);
-    }
-    auto &top_lvl = *marked_tree[0];
-    for (size_type j = top_lvl.size() - 1; j >= 0; j--) {
-      prune_block(counter, pointer, offset, marked_tree, pruned_tree, 0, j,
-                  ranks);
-    }
-
-    return 0;
+      [[maybe_unused]] std::vector<pasta::BitVector *> &pruned_tree) {
+    return prune_extended<size_type>(counter, pointer, offset, marked_tree,
+                                     this->tau_, PRUNED, NO_FORMER_OCC, threads_);
   }
-  int32_t init_dp(std::vector<input_type> &text, std::vector<size_type> &lpf,
-                  std::vector<size_type> &prevOcc, bool mark) {
+  template <typename lpf_vector,
+            typename level_vector = std::vector<size_type>,
+            typename start_vector = std::vector<int64_t>>
+  int32_t init_dp(std::vector<input_type> &text, lpf_vector &lpf,
+                  lpf_vector &prevOcc, bool mark) {
     // bv_marked contains all the marked
     std::vector<pasta::BitVector *> bv_marked;
     std::vector<pasta::BitVector *> bv_pruned;
-    std::vector<std::vector<size_type>> counter;
-    std::vector<std::vector<size_type>> pass2_pointer;
-    std::vector<std::vector<size_type>> pass2_offset;
+    std::vector<level_vector> counter;
+    std::vector<level_vector> pass2_pointer;
+    std::vector<level_vector> pass2_offset;
     std::vector<int64_t> pass2_ones;
-    std::vector<std::vector<int64_t>> blk_lvl;
+    // start of the last block of each level and the starts of all blocks of
+    // the last level, other block starts are only kept for the current level
+    std::vector<int64_t> last_block_start;
+    start_vector last_lvl_inx;
     std::vector<int64_t> block_size_lvl_temp;
     int64_t added_padding = 0;
     int64_t tree_max_height = 0;
@@ -140,13 +106,14 @@ public:
                             max_blk_size);
     int64_t is_padded = (added_padding > 0) ? 1 : 0;
     int64_t block_size = max_blk_size;
-    std::vector<int64_t> block_text_inx;
+    lpf_array_memory_ = allocated_bytes(lpf, prevOcc);
+    start_vector block_text_inx;
     for (uint64_t i = 0; i < text.size(); i += block_size) {
       block_text_inx.push_back(i);
     }
     if (block_size <= this->max_leaf_length_) {
       auto *bv = new pasta::BitVector(block_text_inx.size(), 1);
-      this->block_tree_types_rs_.push_back(
+      this->block_tree_types_rs_.emplace_back(
           new pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>(*bv));
       auto p0 = new sdsl::int_vector<>(0, 0);
       auto o0 = new sdsl::int_vector<>(0, 0);
@@ -154,24 +121,27 @@ public:
       auto &off0 = *o0;
       sdsl::util::bit_compress(ptr0);
       sdsl::util::bit_compress(off0);
-      this->block_tree_types_.push_back(bv);
-      this->block_tree_pointers_.push_back(p0);
-      this->block_tree_offsets_.push_back(o0);
+      this->block_tree_types_.emplace_back(bv);
+      this->block_tree_pointers_.emplace_back(p0);
+      this->block_tree_offsets_.emplace_back(o0);
       this->block_size_lvl_.push_back(block_size);
       this->leaf_size = block_size / this->tau_;
       this->leaves_ = std::vector<input_type>(text.begin(), text.end());
       this->compress_leaves();
       return 0;
     }
-    for (uint64_t i = 0; i < prevOcc.size(); i++) {
-      size_type p = prevOcc[i];
-      if (lpf[i] >= block_size && (lpf[p] >= block_size || lpf[i] <= lpf[p])) {
-        prevOcc[i] = prevOcc[p];
-      }
-    }
+    omp_set_num_threads(threads_);
+    follow_prev_occ(prevOcc, block_text_inx, block_size,
+                    [&](int64_t i, int64_t p) {
+                      return lpf[i] >= block_size &&
+                             (lpf[p] >= block_size || lpf[i] <= lpf[p]);
+                    });
     // Firstly we build the theory structure or even just generate an all
     // internal blocks tree
     while (block_size > this->max_leaf_length_) {
+      ProfilePhase phase("level", bv_marked.size(), threads_);
+      phase.set_estimated_bytes((3 * sizeof(size_type) + 1) *
+                                block_text_inx.size());
       // if marking enabled we initialize everything to 0 and mark else is
       // init_simple to 1
       auto lvl_bv = new pasta::BitVector(block_text_inx.size(), !mark);
@@ -183,7 +153,11 @@ public:
       auto offsets = std::vector<size_type>(block_text_inx.size(), -1);
       auto counter_lvl = std::vector<size_type>(block_text_inx.size(), 0);
 
-      for (uint64_t z = 0; z < block_text_inx.size(); z++) {
+      int64_t lvl_size = block_text_inx.size();
+#pragma omp parallel for default(none)                                         \
+    shared(block_text_inx, lpf, prevOcc, bv, block_size, pointers, offsets,    \
+               counter_lvl, lvl_size)
+      for (int64_t z = 0; z < lvl_size; z++) {
         size_type first_ind = block_text_inx[z];
         size_type ind = first_ind;
         if (lpf[ind] >= block_size) {
@@ -193,8 +167,10 @@ public:
                 ptr, block_text_inx);
             size_type current_offset = ptr % block_size;
             if (!bv[z]) {
+#pragma omp atomic
               counter_lvl[b]++;
               if (current_offset > 0) {
+#pragma omp atomic
                 counter_lvl[b + 1]++;
               }
             }
@@ -204,35 +180,43 @@ public:
         }
       }
       block_size_lvl_temp.push_back(block_size);
-      blk_lvl.push_back(block_text_inx);
+      last_block_start.push_back(block_text_inx.back());
       block_size = block_size / this->tau_;
-      for (uint64_t b = 0; b < block_text_inx.size(); b++) {
-        for (size_type j = 0;
-             j < block_size * this->tau_ &&
-             static_cast<uint64_t>(block_text_inx[b] + j) < lpf.size();
-             j++) {
-          size_type i = block_text_inx[b] + j;
-          size_type p = prevOcc[i];
-          if ((lpf[i] >= block_size && lpf[p] >= block_size) ||
-              ((p != -1) && lpf[i] <= lpf[p])) {
-            prevOcc[i] = prevOcc[p];
-          }
-        }
-      }
-      std::vector<int64_t> block_text_inx_new;
+      follow_prev_occ(prevOcc, block_text_inx, block_size * this->tau_,
+                      [&](int64_t i, int64_t p) {
+                        return (lpf[i] >= block_size && lpf[p] >= block_size) ||
+                               lpf[i] <= lpf[p];
+                      });
+      start_vector block_text_inx_new;
       generate_next_level(block_text_inx, block_text_inx_new, bv, text.size(),
                           block_size);
-      block_text_inx = block_text_inx_new;
-      counter.push_back(counter_lvl);
-      pass2_pointer.push_back(pointers);
-      pass2_offset.push_back(offsets);
+      // all buffers of the level are alive once the next starts are known
+      level_memory_ = std::max<int64_t>(
+          level_memory_,
+          pruning_space_usage(counter, pass2_pointer, pass2_offset, bv_marked) +
+              allocated_bytes(bv, pointers, offsets, counter_lvl, last_lvl_inx,
+                              block_text_inx, block_text_inx_new));
+      last_lvl_inx = std::move(block_text_inx);
+      block_text_inx = std::move(block_text_inx_new);
+      counter.push_back(to_level_vector<level_vector>(std::move(counter_lvl),
+                                                      0, 2 * lvl_size));
+      pass2_pointer.push_back(
+          to_level_vector<level_vector>(std::move(pointers), PRUNED, lvl_size));
+      pass2_offset.push_back(to_level_vector<level_vector>(
+          std::move(offsets), -1, block_size_lvl_temp.back()));
       bv_marked.push_back(&bv);
     }
 
     this->leaf_size = block_size;
     block_size *= this->tau_;
+    level_memory_ = std::max<int64_t>(
+        level_memory_,
+        pruning_space_usage(counter, pass2_pointer, pass2_offset, bv_marked) +
+            allocated_bytes(block_text_inx, last_lvl_inx));
+    ProfilePhase phase("prune", -1, threads_);
     pruning_extended(counter, pass2_pointer, pass2_offset, bv_marked,
                      bv_marked);
+    phase.next("compact");
     std::vector<size_type> ones_per_lvl(bv_marked.size(), 0);
     // count 1s in each lvl;
     for (uint64_t i = 0; i < bv_marked.size(); i++) {
@@ -246,10 +230,11 @@ public:
 
     auto &top_level = *bv_marked[0];
     bool found_back_block =
-        top_level.size() != static_cast<uint64_t>(ones_per_lvl[0]);
+        top_level.size() != static_cast<uint64_t>(ones_per_lvl[0]) ||
+        bv_marked.size() == 1;
     if (found_back_block || !this->CUT_FIRST_LEVELS) {
-      this->block_tree_types_.push_back(&top_level);
-      this->block_tree_types_rs_.push_back(
+      this->block_tree_types_.emplace_back(&top_level);
+      this->block_tree_types_rs_.emplace_back(
           new pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>(top_level));
       auto p0 = new sdsl::int_vector<>(top_level.size() - ones_per_lvl[0], 0);
       auto o0 = new sdsl::int_vector<>(top_level.size() - ones_per_lvl[0], 0);
@@ -265,13 +250,18 @@ public:
       }
       sdsl::util::bit_compress(ptr0);
       sdsl::util::bit_compress(off0);
-      this->block_tree_pointers_.push_back(p0);
-      this->block_tree_offsets_.push_back(o0);
+      this->block_tree_pointers_.emplace_back(p0);
+      this->block_tree_offsets_.emplace_back(o0);
       this->block_size_lvl_.push_back(block_size_lvl_temp[0]);
+    } else {
+      delete bv_marked[0];
     }
+    // levels of the final tree and their sizes
+    std::vector<int64_t> levels;
+    std::vector<int64_t> level_sizes;
     for (uint64_t i = 1; i < bv_marked.size(); i++) {
       size_type new_size = (ones_per_lvl[i - 1] - is_padded) * this->tau_;
-      auto last_block_parent = blk_lvl[i - 1][blk_lvl[i - 1].size() - 1];
+      auto last_block_parent = last_block_start[i - 1];
       auto lvl_block_size = block_size_lvl_temp[i];
       if (is_padded) {
         for (size_type j = 0; j < this->tau_; j++) {
@@ -281,70 +271,44 @@ public:
           }
         }
       }
-      found_back_block |= new_size != ones_per_lvl[i];
+      // the last level is kept even if no level has back blocks
+      found_back_block |=
+          new_size != ones_per_lvl[i] || i + 1 == bv_marked.size();
       if (found_back_block || !this->CUT_FIRST_LEVELS) {
-        auto bit_vector = new pasta::BitVector(new_size, 0);
-        auto &bv_ref = *bit_vector;
-        auto p = new sdsl::int_vector<>(bv_ref.size() - ones_per_lvl[i], 0);
-        auto o = new sdsl::int_vector<>(bv_ref.size() - ones_per_lvl[i], 0);
-        auto &ptr = *p;
-        auto &off = *o;
-        std::unordered_map<size_type, size_type> blocks_skipped;
-        auto &lvl_pass1 = *bv_marked[i];
-        size_type c = 0;
-        size_type c_u = 0;
-        for (uint64_t j = 0; j < lvl_pass1.size(); j++) {
-          blocks_skipped[j] = j - c;
-          if (pass2_pointer[i][j] != -2) {
-            bv_ref[c] = (bool)lvl_pass1[j];
-            if (!lvl_pass1[j]) {
-              ptr[c_u] =
-                  pass2_pointer[i][j] - blocks_skipped[pass2_pointer[i][j]];
-              off[c_u] = pass2_offset[i][j];
-              c_u++;
-            }
-            c++;
-          }
-        }
-        this->block_tree_types_.push_back(&bv_ref);
-        this->block_tree_types_rs_.push_back(
-            new pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>(bv_ref));
-        sdsl::util::bit_compress(ptr);
-        sdsl::util::bit_compress(off);
-        this->block_tree_pointers_.push_back(p);
-        this->block_tree_offsets_.push_back(o);
-        this->block_size_lvl_.push_back(block_size_lvl_temp[i]);
+        levels.push_back(i);
+        level_sizes.push_back(new_size);
       }
     }
-    int64_t leaf_count = 0;
-    auto &last_level = (*bv_marked[bv_marked.size() - 1]);
-    for (uint64_t i = 0; i < last_level.size(); i++) {
-      if (last_level[i] == 1) {
-        leaf_count += this->tau_;
-        for (int j = 0; j < this->leaf_size * this->tau_; j++) {
-          if (static_cast<uint64_t>(blk_lvl[blk_lvl.size() - 1][i] + j) <
-              text.size()) {
-            this->leaves_.push_back(text[blk_lvl[blk_lvl.size() - 1][i] + j]);
-          }
-        }
-      }
+    this->append_compacted_levels(bv_marked, pass2_pointer, pass2_offset,
+                                  levels, level_sizes, block_size_lvl_temp,
+                                  PRUNED, threads_);
+
+    phase.next("compress_leaves");
+    this->compress_leaves(text, *bv_marked.back(), last_lvl_inx, threads_);
+    // the final levels are copies, the marked tree is not needed anymore
+    for (uint64_t i = 1; i < bv_marked.size(); i++) {
+      delete bv_marked[i];
     }
-    this->amount_of_leaves = leaf_count;
-    this->compress_leaves();
     return 0;
-  };
-  int32_t init(std::vector<input_type> &text, std::vector<size_type> &lpf,
-               std::vector<size_type> &prevOcc, bool mark) {
+  }
+  template <typename lpf_vector,
+            typename level_vector = std::vector<size_type>,
+            typename start_vector = std::vector<int64_t>>
+  int32_t init(std::vector<input_type> &text, lpf_vector &lpf,
+               lpf_vector &prevOcc, bool mark) {
     // bv_marked contains all the marked
     std::vector<pasta::BitVector *> bv_marked;
     std::vector<pasta::BitVector *> bv_pruned;
-    std::vector<std::vector<size_type>> counter;
-    std::vector<std::vector<size_type>> pass2_pointer;
-    std::vector<std::vector<size_type>> pass2_offset;
+    std::vector<level_vector> counter;
+    std::vector<level_vector> pass2_pointer;
+    std::vector<level_vector> pass2_offset;
     std::vector<size_type> pass2_max_pointer;
     std::vector<size_type> pass2_max_offset;
     std::vector<int64_t> pass2_ones;
-    std::vector<std::vector<int64_t>> blk_lvl;
+    // start of the last block of each level and the starts of all blocks of
+    // the last level, other block starts are only kept for the current level
+    std::vector<int64_t> last_block_start;
+    start_vector last_lvl_inx;
     std::vector<int64_t> block_size_lvl_temp;
     int64_t added_padding = 0;
     int64_t tree_max_height = 0;
@@ -353,7 +317,8 @@ public:
                             max_blk_size);
     auto is_padded = added_padding > 0 ? 1 : 0;
     int64_t block_size = max_blk_size;
-    std::vector<int64_t> block_text_inx;
+    lpf_array_memory_ = allocated_bytes(lpf, prevOcc);
+    start_vector block_text_inx;
 
     for (uint64_t i = 0; i < text.size(); i += block_size) {
       block_text_inx.push_back(i);
@@ -361,7 +326,7 @@ public:
 
     if (block_size <= this->max_leaf_length_) {
       auto *bv = new pasta::BitVector(block_text_inx.size(), 1);
-      this->block_tree_types_rs_.push_back(
+      this->block_tree_types_rs_.emplace_back(
           new pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>(*bv));
       auto p0 = new sdsl::int_vector<>(0, 0);
       auto o0 = new sdsl::int_vector<>(0, 0);
@@ -369,25 +334,28 @@ public:
       auto &off0 = *o0;
       sdsl::util::bit_compress(ptr0);
       sdsl::util::bit_compress(off0);
-      this->block_tree_types_.push_back(bv);
-      this->block_tree_pointers_.push_back(p0);
-      this->block_tree_offsets_.push_back(o0);
+      this->block_tree_types_.emplace_back(bv);
+      this->block_tree_pointers_.emplace_back(p0);
+      this->block_tree_offsets_.emplace_back(o0);
       this->block_size_lvl_.push_back(block_size);
       this->leaf_size = block_size / this->tau_;
       this->leaves_ = std::vector<input_type>(text.begin(), text.end());
       this->compress_leaves();
       return 0;
     }
-    for (size_type i = 0; static_cast<uint64_t>(i) < prevOcc.size(); i++) {
-      size_type p = prevOcc[i];
-      if (lpf[i] >= block_size && (lpf[p] >= block_size || lpf[i] <= lpf[p])) {
-        prevOcc[i] = prevOcc[p];
-      }
-    }
+    omp_set_num_threads(threads_);
+    follow_prev_occ(prevOcc, block_text_inx, block_size,
+                    [&](int64_t i, int64_t p) {
+                      return lpf[i] >= block_size &&
+                             (lpf[p] >= block_size || lpf[i] <= lpf[p]);
+                    });
 
     // Firstly we build the theory structure or even just generate an all
     // internal blocks tree
     while (block_size > this->max_leaf_length_) {
+      ProfilePhase phase("level", bv_marked.size(), threads_);
+      phase.set_estimated_bytes((3 * sizeof(size_type) + 1) *
+                                block_text_inx.size());
       // if marking enabled we initialize everything to 0 and mark else is
       // init_simple to 1
       auto lvl_bv = new pasta::BitVector(block_text_inx.size(), !mark);
@@ -399,11 +367,13 @@ public:
       auto offsets = std::vector<size_type>(block_text_inx.size(), -1);
       auto counter_lvl = std::vector<size_type>(block_text_inx.size(), 0);
 
-      for (size_type i = 0; static_cast<uint64_t>(i) < block_text_inx.size();
-           i++) {
+      int64_t lvl_size = block_text_inx.size();
+#pragma omp parallel for default(none)                                         \
+    shared(block_text_inx, lpf, prevOcc, bv, block_size, pointers, offsets,    \
+               counter_lvl, lvl_size)
+      for (int64_t i = 0; i < lvl_size; i++) {
         size_type first_ind = block_text_inx[i];
         size_type ind = first_ind;
-        [[maybe_unused]] bool has_ptr = false;
         while (lpf[ind] >= block_size) {
           size_type ptr = prevOcc[ind];
           if (block_size + prevOcc[ind] - 1 >= first_ind) {
@@ -418,8 +388,10 @@ public:
                 ptr, block_text_inx);
             size_type current_offset = ptr % block_size;
             if (!bv[i]) {
+#pragma omp atomic
               counter_lvl[b]++;
               if (current_offset > 0) {
+#pragma omp atomic
                 counter_lvl[b + 1]++;
               }
             }
@@ -431,34 +403,39 @@ public:
       }
 
       block_size_lvl_temp.push_back(block_size);
-      blk_lvl.push_back(block_text_inx);
+      last_block_start.push_back(block_text_inx.back());
       block_size = block_size / this->tau_;
-      //            for (size_type b = 0; b < block_text_inx.size(); b++) {
-      //                for (size_type j = 0; j < block_size * this->tau_ &&
-      //                block_text_inx[b] + j < text.size(); j++) {
-      //                    size_type i = block_text_inx[b] + j;
-      //                    size_type p = prevOcc[i];
-      //                    if ((lpf[i] >= block_size && lpf[p] >= block_size)
-      //                    || ((p != -1) && lpf[i] <= lpf[p])) {
-      //                        prevOcc[i] = prevOcc[p];
-      //                    }
-      //                }
-      //            }
-
-      std::vector<int64_t> block_text_inx_new;
+
+      start_vector block_text_inx_new;
       generate_next_level(block_text_inx, block_text_inx_new, bv, text.size(),
                           block_size);
-      block_text_inx = block_text_inx_new;
-      counter.push_back(counter_lvl);
-      pass2_pointer.push_back(pointers);
-      pass2_offset.push_back(offsets);
+      // all buffers of the level are alive once the next starts are known
+      level_memory_ = std::max<int64_t>(
+          level_memory_,
+          pruning_space_usage(counter, pass2_pointer, pass2_offset, bv_marked) +
+              allocated_bytes(bv, pointers, offsets, counter_lvl, last_lvl_inx,
+                              block_text_inx, block_text_inx_new));
+      last_lvl_inx = std::move(block_text_inx);
+      block_text_inx = std::move(block_text_inx_new);
+      counter.push_back(to_level_vector<level_vector>(std::move(counter_lvl),
+                                                      0, 2 * lvl_size));
+      pass2_pointer.push_back(
+          to_level_vector<level_vector>(std::move(pointers), PRUNED, lvl_size));
+      pass2_offset.push_back(to_level_vector<level_vector>(
+          std::move(offsets), -1, block_size_lvl_temp.back()));
       bv_marked.push_back(&bv);
     }
 
     this->leaf_size = block_size;
     block_size *= this->tau_;
+    level_memory_ = std::max<int64_t>(
+        level_memory_,
+        pruning_space_usage(counter, pass2_pointer, pass2_offset, bv_marked) +
+            allocated_bytes(block_text_inx, last_lvl_inx));
+    ProfilePhase phase("prune", -1, threads_);
     pruning_extended(counter, pass2_pointer, pass2_offset, bv_marked,
                      bv_marked);
+    phase.next("compact");
     std::vector<size_type> ones_per_lvl(bv_marked.size(), 0);
     // count 1s in each lvl;
     for (uint64_t i = 0; i < bv_marked.size(); i++) {
@@ -472,10 +449,11 @@ public:
 
     auto &top_level = *bv_marked[0];
     bool found_back_block =
-        top_level.size() != static_cast<uint64_t>(ones_per_lvl[0]);
+        top_level.size() != static_cast<uint64_t>(ones_per_lvl[0]) ||
+        bv_marked.size() == 1;
     if (found_back_block || !this->CUT_FIRST_LEVELS) {
-      this->block_tree_types_.push_back(&top_level);
-      this->block_tree_types_rs_.push_back(
+      this->block_tree_types_.emplace_back(&top_level);
+      this->block_tree_types_rs_.emplace_back(
           new pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>(top_level));
       auto p0 = new sdsl::int_vector<>(top_level.size() - ones_per_lvl[0], 0);
       auto o0 = new sdsl::int_vector<>(top_level.size() - ones_per_lvl[0], 0);
@@ -491,13 +469,18 @@ public:
       }
       sdsl::util::bit_compress(ptr0);
       sdsl::util::bit_compress(off0);
-      this->block_tree_pointers_.push_back(p0);
-      this->block_tree_offsets_.push_back(o0);
+      this->block_tree_pointers_.emplace_back(p0);
+      this->block_tree_offsets_.emplace_back(o0);
       this->block_size_lvl_.push_back(block_size_lvl_temp[0]);
+    } else {
+      delete bv_marked[0];
     }
+    // levels of the final tree and their sizes
+    std::vector<int64_t> levels;
+    std::vector<int64_t> level_sizes;
     for (uint64_t i = 1; i < bv_marked.size(); i++) {
       size_type new_size = (ones_per_lvl[i - 1] - is_padded) * this->tau_;
-      auto last_block_parent = blk_lvl[i - 1][blk_lvl[i - 1].size() - 1];
+      auto last_block_parent = last_block_start[i - 1];
       auto lvl_block_size = block_size_lvl_temp[i];
       if (is_padded) {
         for (size_type j = 0; j < this->tau_; j++) {
@@ -507,62 +490,24 @@ public:
           }
         }
       }
-      found_back_block |= new_size != ones_per_lvl[i];
+      // the last level is kept even if no level has back blocks
+      found_back_block |=
+          new_size != ones_per_lvl[i] || i + 1 == bv_marked.size();
       if (found_back_block || !this->CUT_FIRST_LEVELS) {
-        auto bit_vector = new pasta::BitVector(new_size, 0);
-        auto &bv_ref = *bit_vector;
-        auto p = new sdsl::int_vector<>(bv_ref.size() - ones_per_lvl[i], 0);
-        auto o = new sdsl::int_vector<>(bv_ref.size() - ones_per_lvl[i], 0);
-        auto &ptr = *p;
-        auto &off = *o;
-        [[maybe_unused]] size_type pointer_saved = 0;
-        [[maybe_unused]] size_type pointer_skipped = 0;
-        std::unordered_map<size_type, size_type> blocks_skipped;
-        [[maybe_unused]] size_type skip = 0;
-        [[maybe_unused]] size_type replace = 0;
-        [[maybe_unused]] auto &lvl_above_pass1 = *bv_marked[i - 1];
-        auto &lvl_pass1 = *bv_marked[i];
-        size_type c = 0;
-        size_type c_u = 0;
-        for (uint64_t j = 0; j < lvl_pass1.size(); j++) {
-          blocks_skipped[j] = j - c;
-          if (pass2_pointer[i][j] != -2) {
-            bv_ref[c] = (bool)lvl_pass1[j];
-            if (!lvl_pass1[j]) {
-              ptr[c_u] =
-                  pass2_pointer[i][j] - blocks_skipped[pass2_pointer[i][j]];
-              off[c_u] = pass2_offset[i][j];
-              c_u++;
-            }
-            c++;
-          }
-        }
-        this->block_tree_types_.push_back(&bv_ref);
-        this->block_tree_types_rs_.push_back(
-            new pasta::RankSelect<pasta::OptimizedFor::ONE_QUERIES>(bv_ref));
-        sdsl::util::bit_compress(ptr);
-        sdsl::util::bit_compress(off);
-        this->block_tree_pointers_.push_back(p);
-        this->block_tree_offsets_.push_back(o);
-        this->block_size_lvl_.push_back(block_size_lvl_temp[i]);
+        levels.push_back(i);
+        level_sizes.push_back(new_size);
       }
     }
+    this->append_compacted_levels(bv_marked, pass2_pointer, pass2_offset,
+                                  levels, level_sizes, block_size_lvl_temp,
+                                  PRUNED, threads_);
 
-    int64_t leaf_count = 0;
-    auto &last_level = (*bv_marked[bv_marked.size() - 1]);
-    for (uint64_t i = 0; i < last_level.size(); i++) {
-      if (last_level[i] == 1) {
-        leaf_count += this->tau_;
-        for (int j = 0; j < this->leaf_size * this->tau_; j++) {
-          if (static_cast<uint64_t>(blk_lvl[blk_lvl.size() - 1][i] + j) <
-              text.size()) {
-            this->leaves_.push_back(text[blk_lvl[blk_lvl.size() - 1][i] + j]);
-          }
-        }
-      }
+    phase.next("compress_leaves");
+    this->compress_leaves(text, *bv_marked.back(), last_lvl_inx, threads_);
+    // the final levels are copies, the marked tree is not needed anymore
+    for (uint64_t i = 1; i < bv_marked.size(); i++) {
+      delete bv_marked[i];
     }
-    this->amount_of_leaves = leaf_count;
-    this->compress_leaves();
 
     return 0;
   }
@@ -594,47 +539,127 @@ public:
     this->s_ = lz.size();
     init(text, lpf, lpf_ptr, mark);
   };
+  template <typename lpf_vector>
   BlockTreeLPF(std::vector<input_type> &text, size_type tau,
-               size_type max_leaf_length, size_type s,
-               std::vector<size_type> &lpf, std::vector<size_type> &lpf_ptr,
-               [[maybe_unused]] std::vector<size_type> &lz, bool mark,
-               bool cut_first_level) {
+               size_type max_leaf_length, size_type s, lpf_vector &lpf,
+               lpf_vector &lpf_ptr, [[maybe_unused]] std::vector<size_type> &lz,
+               bool mark,
+               bool cut_first_level, size_t const threads = 1,
+               bool packed_temporaries = false) {
+    threads_ = std::max<int32_t>(1, threads);
     this->CUT_FIRST_LEVELS = cut_first_level;
     this->map_unique_chars(text);
     this->tau_ = tau;
     this->max_leaf_length_ = max_leaf_length;
     this->s_ = s;
-    init(text, lpf, lpf_ptr, mark);
-  };
-  ~BlockTreeLPF() {
-    for (auto &bt_t : this->block_tree_types_) {
-      delete bt_t;
-    }
-    for (auto &bt_rs : this->block_tree_types_rs_) {
-      delete bt_rs;
-    }
-    for (auto &bt_p : this->block_tree_pointers_) {
-      delete bt_p;
-    }
-    for (auto &bt_o : this->block_tree_offsets_) {
-      delete bt_o;
+    // pointers, offsets and counters of the levels are kept until the tree is
+    // pruned, packed they only use the bytes needed for the level's values
+    // block starts are stored with as many bits as the LPF array
+    using start_vector =
+        std::conditional_t<std::is_same_v<lpf_vector, Int40Vector>,
+                           Int40Vector, std::vector<int64_t>>;
+    if (packed_temporaries) {
+      init<lpf_vector, PackedIntVector, start_vector>(text, lpf, lpf_ptr,
+                                                      mark);
+    } else {
+      init<lpf_vector, std::vector<size_type>, start_vector>(text, lpf,
+                                                             lpf_ptr, mark);
     }
-  };
-
+  }
 private:
   // magic number to indicate that a block is pruned
   const int PRUNED = -2;
   // magic number to indicate that a block has no occurrences to its left side
   const int NO_FORMER_OCC = -1;
-  size_type generate_next_level(std::vector<int64_t> &old_level,
-                                std::vector<int64_t> &new_level,
+
+  // Sets prevOcc[i] = prevOcc[prevOcc[i]] for all positions i covered by the
+  // blocks (each of the given length) if follow(i, prevOcc[i]) holds. The
+  // result is the same as processing the positions from left to right, i.e.,
+  // prevOcc[prevOcc[i]] has already been updated if it is covered. The covered
+  // positions are split into chunks that are processed in parallel. Positions
+  // whose previous occurrence lies in front of their chunk are resolved
+  // afterwards, one chunk after another.
+  template <typename lpf_vector, typename start_vector, typename Follow>
+  void follow_prev_occ(lpf_vector &prevOcc, start_vector const &block_text_inx,
+                       int64_t length, Follow follow) {
+    int64_t n = prevOcc.size();
+    int64_t blocks = block_text_inx.size();
+    int64_t covered =
+        (blocks - 1) * length + std::min(length, n - block_text_inx.back());
+    int64_t chunks = std::min<int64_t>(threads_ * 4, covered / 4096 + 1);
+    int64_t chunk_size = (covered + chunks - 1) / chunks;
+    std::vector<std::vector<int64_t>> pending(chunks);
+#pragma omp parallel for default(none) schedule(dynamic, 1)                    \
+    shared(prevOcc, block_text_inx, length, follow, n, covered, chunks,        \
+               chunk_size, pending)
+    for (int64_t c = 0; c < chunks; c++) {
+      int64_t c_begin = c * chunk_size;
+      int64_t c_end = std::min(covered, c_begin + chunk_size);
+      if (c_begin >= c_end) {
+        continue;
+      }
+      int64_t begin = block_text_inx[c_begin / length] + c_begin % length;
+      auto &chunk_pending = pending[c];
+      for (int64_t b = c_begin / length; b * length < c_end; b++) {
+        int64_t j = std::max(c_begin, b * length) - b * length;
+        int64_t end = std::min({c_end - b * length, length,
+                                n - block_text_inx[b]});
+        for (; j < end; j++) {
+          int64_t i = block_text_inx[b] + j;
+          int64_t p = prevOcc[i];
+          if (p == NO_FORMER_OCC || !follow(i, p)) {
+            continue;
+          }
+          if (p < begin) {
+            // prevOcc[p] may still change, keep p and resolve it later
+            chunk_pending.push_back(i);
+          } else {
+            prevOcc[i] = prevOcc[p];
+            if (std::binary_search(chunk_pending.begin(), chunk_pending.end(),
+                                   p)) {
+              chunk_pending.push_back(i);
+            }
+          }
+        }
+      }
+    }
+    // pending positions only refer to positions in front of their chunk
+    for (int64_t c = 1; c < chunks; c++) {
+      auto &chunk_pending = pending[c];
+      int64_t size = chunk_pending.size();
+#pragma omp parallel for default(none) shared(prevOcc, chunk_pending, size)    \
+    if (size > 4096)
+      for (int64_t k = 0; k < size; k++) {
+        prevOcc[chunk_pending[k]] = prevOcc[prevOcc[chunk_pending[k]]];
+      }
+    }
+  }
+
+  template <typename start_vector>
+  size_type generate_next_level(start_vector &old_level,
+                                start_vector &new_level,
                                 pasta::BitVector &bv, int64_t N,
                                 int64_t block_size) {
-    for (uint64_t i = 0; i < bv.size(); i++) {
+    int64_t old_size = old_level.size();
+    std::vector<int64_t> positions(old_size, 0);
+#pragma omp parallel for default(none)                                         \
+    shared(old_level, positions, bv, N, block_size, old_size)
+    for (int64_t i = 0; i < old_size; i++) {
       if (bv[i] == 1) {
+        int64_t children = (N - old_level[i] + block_size - 1) / block_size;
+        positions[i] = std::min<int64_t>(children, this->tau_);
+      }
+    }
+    new_level.resize(exclusive_prefix_sum(positions, threads_));
+    omp_set_num_threads(threads_);
+#pragma omp parallel for default(none)                                         \
+    shared(old_level, new_level, positions, bv, N, block_size, old_size)
+    for (int64_t i = 0; i < old_size; i++) {
+      if (bv[i] == 1) {
+        int64_t pos = positions[i];
         for (size_type j = 0; j < this->tau_; j++) {
           if (old_level[i] + (j * block_size) < N) {
-            new_level.push_back(old_level[i] + (j * block_size));
+            new_level[pos++] = old_level[i] + (j * block_size);
           }
         }
       }
@@ -642,16 +667,25 @@ private:
     return 0;
   }
 
-  size_type mark_blocks(pasta::BitVector &bv, std::vector<size_type> &lpf,
-                        std::vector<int64_t> &block_text_inx,
+  template <typename lpf_vector, typename start_vector>
+  size_type mark_blocks(pasta::BitVector &bv, lpf_vector &lpf,
+                        start_vector &block_text_inx,
                         int64_t block_size) {
     bv[0] = 1;
-    for (uint64_t i = 1; i < block_text_inx.size() - 1; i++) {
-      if (block_text_inx[i - 1] + block_size == block_text_inx[i] &&
-          block_text_inx[i] + block_size == block_text_inx[i + 1] &&
-          (lpf[block_text_inx[i - 1]] < 2 * block_size ||
-           lpf[block_text_inx[i]] < 2 * block_size)) {
-        bv[i] = 1;
+    // threads work on disjoint 64-bit words of bv
+    int64_t blocks = block_text_inx.size();
+    int64_t words = (blocks + 63) / 64;
+#pragma omp parallel for default(none)                                         \
+    shared(bv, lpf, block_text_inx, block_size, blocks, words)
+    for (int64_t w = 0; w < words; w++) {
+      int64_t end = std::min(blocks - 1, (w + 1) * 64);
+      for (int64_t i = std::max<int64_t>(1, w * 64); i < end; i++) {
+        if (block_text_inx[i - 1] + block_size == block_text_inx[i] &&
+            block_text_inx[i] + block_size == block_text_inx[i + 1] &&
+            (lpf[block_text_inx[i - 1]] < 2 * block_size ||
+             lpf[block_text_inx[i]] < 2 * block_size)) {
+          bv[i] = 1;
+        }
       }
     }
     if (bv.size() > 1) {
@@ -661,39 +695,83 @@ private:
           lpf[block_text_inx[last - 1]] < 2 * block_size;
     }
     return 0;
-    return 0;
   }
 };
 
+// If memory_budget > 0 and the construction is predicted to need more than
+// memory_budget bytes besides the text, the pointers, offsets and counters of
+// the levels are bit packed.
 template <typename input_type, typename size_type>
 auto *make_block_tree_lpf(std::vector<input_type> &text, size_type tau,
-                          size_type max_leaf_length, bool set_s_to_z) {
+                          size_type max_leaf_length, bool set_s_to_z,
+                          int64_t memory_budget = 0) {
+  bool packed = memory_budget > 0 &&
+                predict_lpf_construction_memory(text.size(), tau,
+                                                max_leaf_length,
+                                                sizeof(size_type), false,
+                                                false) > memory_budget;
   std::vector<size_type> lpf(text.size());
   std::vector<size_type> lpf_ptr(text.size());
   std::vector<size_type> lz;
   size_type lzn = 0;
-  lpf_array(text, lpf, lpf_ptr);
+  LpfMemoryUsage memory;
+  lpf_array(text, lpf, lpf_ptr, &memory);
   calculate_lz_factor(lzn, lpf, lz);
 
-  return new BlockTreeLPF<input_type, size_type>(text, tau, max_leaf_length,
-                                                 (set_s_to_z ? lzn : 1), lpf,
-                                                 lpf_ptr, lz, false, true);
+  auto *tree = new BlockTreeLPF<input_type, size_type>(
+      text, tau, max_leaf_length, (set_s_to_z ? lzn : 1), lpf, lpf_ptr, lz,
+      false, true, 1, packed);
+  tree->lpf_memory_ = memory;
+  return tree;
 }
 
+// Same as make_block_tree_lpf but the LPF array is computed in parallel.
 template <typename input_type, typename size_type>
 auto *make_block_tree_lpf_parallel(std::vector<input_type> &text, size_type tau,
                                    size_type max_leaf_length, bool set_s_to_z,
-                                   size_t threads) {
+                                   size_t threads, int64_t memory_budget = 0) {
+  bool packed = memory_budget > 0 &&
+                predict_lpf_construction_memory(text.size(), tau,
+                                                max_leaf_length,
+                                                sizeof(size_type),
+                                                false) > memory_budget;
   std::vector<size_type> lpf(text.size());
   std::vector<size_type> lpf_ptr(text.size());
   std::vector<size_type> lz;
   size_type lzn = 0;
-  lpf_array_ansv(text, lpf, lpf_ptr, threads);
+  LpfMemoryUsage memory;
+  lpf_array_ansv(text, lpf, lpf_ptr, threads, &memory);
+  calculate_lz_factor(lzn, lpf, lz);
+
+  auto *tree = new BlockTreeLPF<input_type, size_type>(
+      text, tau, max_leaf_length, (set_s_to_z ? lzn : 1), lpf, lpf_ptr, lz,
+      false, true, threads, packed);
+  tree->lpf_memory_ = memory;
+  return tree;
+}
+
+// Same as make_block_tree_lpf_parallel but the LPF array and the previous
+// occurrences are stored with 40 bits per entry while the levels are built and
+// the pointers, offsets and counters of the levels are bit packed. They are
+// computed with 64-bit temporaries, so the peak of the LPF array construction
+// is the same as with 64-bit positions.
+template <typename input_type>
+auto *make_block_tree_lpf_parallel_packed(std::vector<input_type> &text,
+                                          int64_t tau, int64_t max_leaf_length,
+                                          bool set_s_to_z, size_t threads) {
+  Int40Vector lpf;
+  Int40Vector lpf_ptr;
+  std::vector<int64_t> lz;
+  int64_t lzn = 0;
+  LpfMemoryUsage memory;
+  lpf_array_ansv(text, lpf, lpf_ptr, threads, &memory);
   calculate_lz_factor(lzn, lpf, lz);
 
-  return new BlockTreeLPF<input_type, size_type>(text, tau, max_leaf_length,
-                                                 (set_s_to_z ? lzn : 1), lpf,
-                                                 lpf_ptr, lz, false, true);
+  auto *tree = new BlockTreeLPF<input_type, int64_t>(
+      text, tau, max_leaf_length, (set_s_to_z ? lzn : 1), lpf, lpf_ptr, lz,
+      false, true, threads, true);
+  tree->lpf_memory_ = memory;
+  return tree;
 }
 
 } // namespace pasta
@@ -0,0 +1,159 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include "pasta/block_tree/block_tree.hpp"
+#include "pasta/block_tree/construction/block_tree_bits.hpp"
+#include "pasta/block_tree/construction/block_tree_lpf.hpp"
+#include "pasta/block_tree/utils/wavelet_matrix.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace pasta {
+
+// Rank and select for large alphabets by alphabet partitioning. The
+// characters are sorted by decreasing frequency and the character of rank r
+// belongs to class k = floor(log2(r + 1)) with offset r + 1 - 2^k, i.e., class
+// k contains 2^k characters. A block tree of the sequence of classes answers
+// rank and select on classes with rank directories for O(log sigma) instead of
+// sigma characters. The offsets of the characters of each class are stored in
+// a wavelet matrix in text order, which resolves rank and select within the
+// class. The levels of the wavelet matrices are block trees of their bits,
+// since the offsets of a repetitive text are repetitive as well.
+template <typename input_type, typename size_type>
+class BlockTreePartitioned {
+public:
+  using ClassTree = BlockTree<uint8_t, size_type>;
+  using OffsetLevel = BlockTreeBits<size_type>;
+  using Offsets = WaveletMatrix<OffsetLevel>;
+
+  BlockTreePartitioned(std::vector<input_type> const &text, size_type tau,
+                       size_type max_leaf_length, bool set_s_to_z,
+                       size_t threads = 1) {
+    std::unordered_map<input_type, int64_t> frequencies;
+    for (auto c : text) {
+      frequencies[c]++;
+    }
+    std::vector<std::pair<int64_t, input_type>> by_frequency;
+    by_frequency.reserve(frequencies.size());
+    for (auto const &[c, frequency] : frequencies) {
+      by_frequency.emplace_back(-frequency, c);
+    }
+    std::sort(by_frequency.begin(), by_frequency.end());
+    for (auto const &[frequency, c] : by_frequency) {
+      ranks_[c] = characters_.size();
+      characters_.push_back(c);
+    }
+
+    uint64_t classes = std::bit_width(characters_.size());
+    std::vector<uint8_t> class_text(text.size());
+    for (uint64_t i = 0; i < text.size(); i++) {
+      class_text[i] = class_of(ranks_[text[i]]).first;
+    }
+    classes_.reset(make_block_tree_lpf_parallel<uint8_t, size_type>(
+        class_text, tau, max_leaf_length, set_s_to_z, threads));
+    classes_->add_rank_support_omp(threads);
+    // the offsets are collected for one class at a time, leaves of the bit
+    // trees have at least one word
+    size_type leaf_bits = std::max<size_type>(max_leaf_length, 64);
+    auto make_level = [&](pasta::BitVector &&bits) {
+      return std::make_unique<OffsetLevel>(bits, tau, leaf_bits);
+    };
+    for (uint64_t k = 0; k < classes; k++) {
+      std::vector<uint64_t> offsets;
+      offsets.reserve(classes_->rank(k, text.size() - 1));
+      for (uint64_t i = 0; i < text.size(); i++) {
+        if (class_text[i] == k) {
+          offsets.push_back(class_of(ranks_[text[i]]).second);
+        }
+      }
+      offsets_.emplace_back(std::move(offsets), k, make_level);
+    }
+  }
+
+  input_type access(size_type index) {
+    uint8_t k = classes_->access(index);
+    uint64_t offset = offsets_[k].access(classes_->rank(k, index) - 1);
+    return characters_[(1ULL << k) - 1 + offset];
+  }
+
+  // Number of occurrences of c in [0, index].
+  int64_t rank(input_type c, size_type index) {
+    auto it = ranks_.find(c);
+    if (it == ranks_.end()) {
+      return 0;
+    }
+    auto [k, offset] = class_of(it->second);
+    return offsets_[k].rank(offset, classes_->rank(k, index));
+  }
+
+  // Position of the j-th occurrence of c, which must exist.
+  int64_t select(input_type c, size_type j) {
+    auto [k, offset] = class_of(ranks_.at(c));
+    return classes_->select(k, offsets_[k].select(offset, j) + 1);
+  }
+
+  int64_t print_space_usage() {
+    int64_t bytes = classes_->print_space_usage() +
+                    sizeof(input_type) * characters_.capacity() +
+                    (sizeof(std::pair<input_type const, uint64_t>) +
+                     2 * sizeof(void *)) *
+                        ranks_.size();
+    for (auto const &wm : offsets_) {
+      bytes += wm.space_usage();
+    }
+    return bytes;
+  }
+
+  ClassTree &classes() { return *classes_; }
+
+private:
+  // Class and offset of the character of the given frequency rank.
+  static std::pair<uint8_t, uint64_t> class_of(uint64_t rank) {
+    uint8_t k = std::bit_width(rank + 1) - 1;
+    return {k, rank + 1 - (1ULL << k)};
+  }
+
+  std::unique_ptr<ClassTree> classes_;
+  std::vector<Offsets> offsets_;
+  // characters by decreasing frequency and the rank of each character
+  std::vector<input_type> characters_;
+  std::unordered_map<input_type, uint64_t> ranks_;
+};
+
+template <typename input_type, typename size_type>
+auto *make_block_tree_partitioned(std::vector<input_type> const &text,
+                                  size_type const tau,
+                                  size_type const max_leaf_length,
+                                  bool const set_s_to_z, size_t threads = 1) {
+  return new BlockTreePartitioned<input_type, size_type>(
+      text, tau, max_leaf_length, set_s_to_z, threads);
+}
+
+} // namespace pasta
+
+/******************************************************************************/
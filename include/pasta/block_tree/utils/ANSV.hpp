@@ -20,235 +20,188 @@
 
 #pragma once
 
-#include <cmath>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
 #include <omp.h>
-#include <stack>
 #include <vector>
 
 namespace pasta {
 
 const int BLOCK_SIZE = 8192;
 
-inline int32_t get_left(int32_t i) { return i << 1; }
-
-inline int32_t get_right(int32_t i) { return (i << 1) | 1; }
-
-inline int32_t get_parent(int32_t i) { return i >> 1; }
-
-inline int64_t get_left(int64_t i) { return i << 1; }
-
-inline int64_t get_right(int64_t i) { return (i << 1) | 1; }
-
-inline int64_t get_parent(int64_t i) { return i >> 1; }
-
-inline int32_t get_left_opt(std::vector<std::vector<int32_t>> &table,
-                            int32_t depth, int32_t index, int32_t start) {
-  int32_t value = table[0][index];
-  if (value == table[depth - 1][0])
-    return -1;
-
-  int32_t cur = get_parent(start), d, dist = 2;
-  for (d = 1; d < depth; d++) {
-    if ((cur + 1) * dist > index + 1)
-      cur--;
-    if (cur < 0)
-      return -1;
-
-    if (table[d][cur] >= value)
-      cur = get_parent(cur);
-    else
-      break;
-
-    dist <<= 1;
-  }
-
-  for (; d > 0; d--) {
-    if (table[d - 1][get_right(cur)] < value)
-      cur = get_right(cur);
-    else
-      cur = get_left(cur);
-  }
-  return cur;
-}
-
-inline int64_t get_left_opt(std::vector<std::vector<int64_t>> &table,
-                            int64_t depth, int64_t index, int64_t start) {
-  int64_t value = table[0][index];
-  if (value == table[depth - 1][0])
-    return -1;
-
-  int64_t cur = get_parent(start), d, dist = 2;
-  for (d = 1; d < depth; d++) {
-    if ((cur + 1) * dist > index + 1)
-      cur--;
-    if (cur < 0)
-      return -1;
-
-    if (table[d][cur] >= value)
-      cur = get_parent(cur);
-    else
-      break;
-
-    dist <<= 1;
-  }
-
-  for (; d > 0; d--) {
-    if (table[d - 1][get_right(cur)] < value)
-      cur = get_right(cur);
-    else
-      cur = get_left(cur);
-  }
-  return cur;
-}
-
-inline int64_t get_right_opt(std::vector<std::vector<int64_t>> &table,
-                             int64_t depth, int64_t index, int64_t start) {
-  int64_t value = table[0][index];
-  if (value == table[depth - 1][0])
-    return -1;
-
-  int64_t cur = get_parent(start), d, dist = 2;
-  for (d = 1; d < depth; d++) {
-    if (cur * dist < index)
-      cur++;
-    if (static_cast<uint64_t>(cur * dist) >= table[0].size())
-      return -1;
-
-    if (table[d][cur] >= value)
-      cur = get_parent(cur);
-    else
-      break;
-
-    dist <<= 1;
-  }
-
-  for (; d > 0; d--) {
-    if (table[d - 1][get_left(cur)] < value)
-      cur = get_left(cur);
-    else
-      cur = get_right(cur);
-  }
-  return cur;
-}
-
-inline int32_t get_right_opt(std::vector<std::vector<int32_t>> &table,
-                             int32_t depth, int32_t index, int32_t start) {
-  int32_t value = table[0][index];
-  if (value == table[depth - 1][0])
-    return -1;
-
-  int32_t cur = get_parent(start), d, dist = 2;
-  for (d = 1; d < depth; d++) {
-    if (cur * dist < index)
-      cur++;
-    if (static_cast<uint64_t>(cur * dist) >= table[0].size())
-      return -1;
-
-    if (table[d][cur] >= value)
-      cur = get_parent(cur);
-    else
-      break;
-
-    dist <<= 1;
+// All nearest smaller values of array[offset, offset + n): ln[i] (rn[i]) is
+// the closest position to the left (right) of i in this range whose value is
+// not larger than array[i], or -1 if there is no such position.
+template <typename size_type>
+int32_t ansv(size_type const *array, size_type *ln, size_type *rn,
+             size_type offset, size_type n, std::vector<size_type> &stack) {
+  stack.clear();
+  for (size_type i = offset; i < offset + n; i++) {
+    while (!stack.empty() && array[stack.back()] > array[i]) {
+      stack.pop_back();
+    }
+    ln[i] = stack.empty() ? -1 : stack.back();
+    stack.push_back(i);
   }
-
-  for (; d > 0; d--) {
-    if (table[d - 1][get_left(cur)] < value)
-      cur = get_left(cur);
-    else
-      cur = get_right(cur);
+  stack.clear();
+  for (size_type i = offset + n - 1; i >= offset; i--) {
+    while (!stack.empty() && array[stack.back()] > array[i]) {
+      stack.pop_back();
+    }
+    rn[i] = stack.empty() ? -1 : stack.back();
+    stack.push_back(i);
   }
-  return cur;
+  return 0;
 }
 
 template <typename size_type>
 int32_t ansv(std::vector<size_type> const &array, std::vector<size_type> &ln,
              std::vector<size_type> &rn, size_type offset, size_type n) {
-  std::stack<size_type> stack_left;
-  for (size_type i = 0; i < n; i++) {
-    while (!stack_left.empty() &&
-           array[stack_left.top() + offset] > array[i + offset]) {
-      stack_left.pop();
-    }
-    if (stack_left.empty())
-      ln[i + offset] = -1;
-    else
-      ln[i + offset] = stack_left.top() + offset;
-    stack_left.push(i);
-  }
-  std::stack<size_type> stack_right;
-  for (size_type i = n - 1; i >= 0; i--) {
-    while (!stack_right.empty() &&
-           array[stack_right.top() + offset] > array[i + offset]) {
-      stack_right.pop();
+  std::vector<size_type> stack;
+  return ansv(array.data(), ln.data(), rn.data(), offset, n, stack);
+}
+
+// Minima of the chunks of an array with a sparse table on top of them, used
+// to find the closest chunk with a value not larger than a given one.
+template <typename size_type> class ChunkMinima {
+public:
+  ChunkMinima(size_type const *array, size_type n, size_type chunk_size)
+      : m_((n + chunk_size - 1) / chunk_size),
+        depth_(std::bit_width(static_cast<uint64_t>(m_))), table_(depth_ * m_) {
+    size_type m = m_;
+#pragma omp parallel for default(none) shared(array, n, chunk_size, m)
+    for (size_type c = 0; c < m; c++) {
+      size_type const *begin = array + c * chunk_size;
+      table_[c] = *std::min_element(begin, array + std::min(n, (c + 1) *
+                                                                   chunk_size));
     }
-    if (stack_right.empty()) {
-      rn[i + offset] = -1;
-    } else {
-      rn[i + offset] = stack_right.top() + offset;
+    for (size_type k = 1; k < depth_; k++) {
+      size_type dist = size_type(1) << (k - 1);
+      size_type const *prev = table_.data() + (k - 1) * m_;
+      size_type *row = table_.data() + k * m_;
+#pragma omp parallel for default(none) shared(dist, prev, row, m)
+      for (size_type c = 0; c < m; c++) {
+        row[c] = (c + dist < m) ? std::min(prev[c], prev[c + dist]) : prev[c];
+      }
     }
-    stack_right.push(i);
   }
-  return 0;
-}
 
-template <typename size_type>
-void ansv_omp(std::vector<size_type> &array, std::vector<size_type> &left,
-              std::vector<size_type> &right, size_type threads) {
-  size_type l2 = std::ceil(log2(array.size()));
-  size_type depth = l2 + 1;
-  std::vector<std::vector<size_type>> table(depth);
-  table[0] = array;
-  auto m = (size_type)array.size();
-  for (size_type i = 1; i < depth; i++) {
-    m = (m + 1) / 2;
-    table[i] = std::vector<size_type>(m);
-  }
-  m = (size_type)array.size();
-  for (size_type d = 1; d < depth; d++) {
-    size_type m2 = m / 2;
-    omp_set_num_threads(threads);
-#pragma omp parallel for default(none) shared(m2, table, d)
-    for (size_type i = 0; i < m2; i++) {
-      table[d][i] =
-          std::min(table[d - 1][get_left(i)], table[d - 1][get_right(i)]);
+  // Closest chunk in front of chunk c with a value not larger than value.
+  size_type left(size_type c, size_type value) const {
+    for (size_type k = depth_ - 1; k >= 0; k--) {
+      size_type width = size_type(1) << k;
+      if (c >= width && table_[k * m_ + c - width] > value) {
+        c -= width;
+      }
     }
+    return c - 1;
+  }
 
-    if (m % 2) {
-      table[d][m2] = table[d - 1][get_left(m2)];
+  // Closest chunk behind chunk c with a value not larger than value.
+  size_type right(size_type c, size_type value) const {
+    c++;
+    for (size_type k = depth_ - 1; k >= 0; k--) {
+      size_type width = size_type(1) << k;
+      if (c + width <= m_ && table_[k * m_ + c] > value) {
+        c += width;
+      }
     }
+    return c < m_ ? c : -1;
+  }
 
-    m = (m + 1) / 2;
+private:
+  size_type m_;
+  size_type depth_;
+  std::vector<size_type> table_;
+};
+
+// Parallel all nearest smaller values, see ansv. The array is split into
+// chunks of BLOCK_SIZE entries that are solved independently. Afterwards,
+// the entries without a nearest smaller value in their chunk are resolved by
+// following the nearest smaller values of the other chunks, skipping chunks
+// whose minimum is too large. Besides left and right, only the chunk minima
+// and one stack per thread are needed.
+template <typename size_type>
+void ansv_omp(size_type const *array, size_type n, size_type *left,
+              size_type *right, size_type threads) {
+  if (n == 0) {
+    return;
   }
+  size_type const chunk_size = BLOCK_SIZE;
+  size_type chunks = (n + chunk_size - 1) / chunk_size;
   omp_set_num_threads(threads);
-#pragma omp parallel for default(none) shared(table, array, left, right, depth)
-  for (size_type i = 0; static_cast<uint64_t>(i) < array.size();
-       i += BLOCK_SIZE) {
-    size_type j = std::min(i + BLOCK_SIZE, (size_type)array.size());
-    ansv(array, left, right, i, j - i);
-
-    size_type tmp = i;
-    for (size_type k = i; k < j; k++) {
-      if (left[k] == -1) {
-        if (tmp != -1 && array[tmp] >= array[k]) {
-          tmp = get_left_opt(table, depth, k, tmp);
+  ChunkMinima<size_type> minima(array, n, chunk_size);
+#pragma omp parallel default(none) shared(array, n, left, right, chunks)
+  {
+    std::vector<size_type> stack;
+    stack.reserve(chunk_size);
+#pragma omp for schedule(dynamic, 1)
+    for (size_type c = 0; c < chunks; c++) {
+      size_type begin = c * chunk_size;
+      ansv(array, left, right, begin, std::min(n, begin + chunk_size) - begin,
+           stack);
+    }
+  }
+  // Entries of other chunks may be resolved concurrently. Both their local
+  // and their final value lead to a valid jump, hence the atomic accesses.
+#pragma omp parallel for default(none) schedule(dynamic, 1)                    \
+    shared(array, n, left, right, chunks, minima)
+  for (size_type c = 0; c < chunks; c++) {
+    size_type begin = c * chunk_size;
+    size_type end = std::min(n, begin + chunk_size);
+    // entries without a smaller value in front of them in the chunk have
+    // decreasing values, hence the candidate p only moves to the left
+    size_type p = begin - 1;
+    for (size_type i = begin; i < end; i++) {
+      size_type value = array[i], next;
+#pragma omp atomic read
+      next = left[i];
+      if (next != -1) {
+        continue;
+      }
+      while (p != -1 && array[p] > value) {
+#pragma omp atomic read
+        next = left[p];
+        if (next == -1) {
+          size_type chunk = minima.left(p / chunk_size, value);
+          next = (chunk == -1) ? -1 : (chunk + 1) * chunk_size - 1;
         }
-        left[k] = tmp;
+        p = next;
       }
+#pragma omp atomic write
+      left[i] = p;
     }
-
-    tmp = j - 1;
-    for (size_type k = j - 1; k >= i; k--) {
-      if (right[k] == -1) {
-        if (tmp != -1 && array[tmp] >= array[k]) {
-          tmp = get_right_opt(table, depth, k, tmp);
+    p = (end == n) ? -1 : end;
+    for (size_type i = end - 1; i >= begin; i--) {
+      size_type value = array[i], next;
+#pragma omp atomic read
+      next = right[i];
+      if (next != -1) {
+        continue;
+      }
+      while (p != -1 && array[p] > value) {
+#pragma omp atomic read
+        next = right[p];
+        if (next == -1) {
+          size_type chunk = minima.right(p / chunk_size, value);
+          next = (chunk == -1) ? -1 : chunk * chunk_size;
         }
-        right[k] = tmp;
+        p = next;
       }
+#pragma omp atomic write
+      right[i] = p;
     }
   }
 }
 
+template <typename size_type>
+void ansv_omp(std::vector<size_type> &array, std::vector<size_type> &left,
+              std::vector<size_type> &right, size_type threads) {
+  ansv_omp(array.data(), static_cast<size_type>(array.size()), left.data(),
+           right.data(), threads);
+}
+
 } // namespace pasta
 
 /******************************************************************************/
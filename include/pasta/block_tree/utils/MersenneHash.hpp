@@ -21,24 +21,39 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <vector>
 
 namespace pasta {
 
-template <typename T> class MersenneHash {
+// Fingerprint of text_[start_, start_ + length_). The text can be any
+// container of characters with operator[], e.g., a packed text.
+template <typename T, typename text_type = std::vector<T>> class MersenneHash {
 public:
-  std::vector<T> const &text_;
+  text_type const &text_;
   uint64_t hash_;
-  uint32_t start_;
-  uint32_t length_;
-  MersenneHash(std::vector<T> const &text, size_t hash, uint64_t start,
+  // 64 bits, since the FP construction is also used for texts of 4 GiB and more
+  uint64_t start_;
+  uint64_t length_;
+  // optional second fingerprint (0 if unused)
+  uint64_t hash2_ = 0;
+  // if false, equal fingerprints are trusted without comparing the text
+  bool verify_ = true;
+  MersenneHash(text_type const &text, size_t hash, uint64_t start,
                uint64_t length)
       : text_(text), hash_(hash), start_(start), length_(length){};
+  MersenneHash(text_type const &text, size_t hash, uint64_t start,
+               uint64_t length, uint64_t hash2, bool verify)
+      : text_(text), hash_(hash), start_(start), length_(length),
+        hash2_(hash2), verify_(verify){};
   bool operator==(const MersenneHash &other) const {
     //            std::cout << start_ << " " << other.start_ << std::endl;
-    if (length_ != other.length_)
+    if (length_ != other.length_ || hash_ != other.hash_ ||
+        hash2_ != other.hash2_)
       return false;
+    if (!verify_ || !other.verify_)
+      return true;
 
     for (uint64_t i = 0; i < length_; i++) {
       if (text_[start_ + i] != other.text_[other.start_ + i]) {
@@ -52,8 +67,9 @@ public:
 } // namespace pasta
 
 namespace std {
-template <typename T> struct hash<pasta::MersenneHash<T>> {
-  std::size_t operator()(const pasta::MersenneHash<T> &hS) const {
+template <typename T, typename text_type>
+struct hash<pasta::MersenneHash<T, text_type>> {
+  std::size_t operator()(const pasta::MersenneHash<T, text_type> &hS) const {
     return hS.hash_;
   }
 };
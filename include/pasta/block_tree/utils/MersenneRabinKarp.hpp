@@ -21,14 +21,16 @@
 #pragma once
 
 #include <iostream>
+#include <vector>
 
 namespace pasta {
 
-template <class T, class size_type> class MersenneRabinKarp {
+template <class T, class size_type, class text_type = std::vector<T>>
+class MersenneRabinKarp {
   __extension__ typedef unsigned __int128 uint128_t;
 
 public:
-  std::vector<T> const &text_;
+  text_type const &text_;
   uint128_t sigma_;
   uint64_t init_;
   uint64_t length_;
@@ -36,41 +38,31 @@ public:
   uint64_t hash_;
   uint128_t max_sigma_;
 
-  MersenneRabinKarp(std::vector<T> const &text, uint64_t sigma, uint64_t init,
-                    uint64_t length, uint128_t prime)
+  // base and state of an optional second fingerprint, which is only computed
+  // if sigma2 != 0
+  uint128_t sigma2_;
+  uint64_t hash2_ = 0;
+  uint128_t max_sigma2_ = 1;
+
+  MersenneRabinKarp(text_type const &text, uint64_t sigma, uint64_t init,
+                    uint64_t length, uint128_t prime, uint64_t sigma2 = 0)
       : text_(text), sigma_(sigma), init_(init), length_(length),
-        prime_(prime) {
-    max_sigma_ = 1;
-    uint128_t fp = 0;
-    uint128_t sigma_c = 1;
-    for (uint64_t i = init_; i < init_ + length_; i++) {
-      fp = mersenneModulo(fp * sigma);
-      fp = mersenneModulo(fp + text_[i]);
-    }
-    for (uint64_t i = 0; i < length_ - 1; i++) {
-      sigma_c = mersenneModulo(sigma_c * sigma_);
+        prime_(prime), sigma2_(sigma2) {
+    compute(sigma_, hash_, max_sigma_);
+    if (sigma2_ != 0) {
+      compute(sigma2_, hash2_, max_sigma2_);
     }
-    hash_ = (uint64_t)(fp);
-    max_sigma_ = (uint64_t)(sigma_c);
   };
 
   void restart(uint64_t index) {
-    if (index + length_ >= text_.size()) {
+    if (index + length_ > text_.size()) {
       return;
     }
     init_ = index;
-    max_sigma_ = 1;
-    uint128_t fp = 0;
-    uint128_t sigma_c = 1;
-    for (uint64_t i = init_; i < init_ + length_; i++) {
-      fp = mersenneModulo(fp * sigma_);
-      fp = mersenneModulo(fp + text_[i]);
+    compute(sigma_, hash_, max_sigma_);
+    if (sigma2_ != 0) {
+      compute(sigma2_, hash2_, max_sigma2_);
     }
-    for (uint64_t i = 0; i < length_ - 1; i++) {
-      sigma_c = mersenneModulo(sigma_c * sigma_);
-    }
-    hash_ = (uint64_t)(fp);
-    max_sigma_ = (uint64_t)(sigma_c);
   };
 
   inline uint128_t mersenneModulo(uint128_t k) {
@@ -84,21 +76,44 @@ public:
       return;
     }
 
-    uint128_t fp = hash_;
     T out_char = text_[init_];
     T in_char = text_[init_ + length_];
-    uint128_t out_char_influence = out_char * max_sigma_;
+    hash_ = roll(hash_, sigma_, max_sigma_, out_char, in_char);
+    if (sigma2_ != 0) {
+      hash2_ = roll(hash2_, sigma2_, max_sigma2_, out_char, in_char);
+    }
+    init_++;
+  };
+
+private:
+  void compute(uint128_t sigma, uint64_t &hash, uint128_t &max_sigma) {
+    uint128_t fp = 0;
+    uint128_t sigma_c = 1;
+    for (uint64_t i = init_; i < init_ + length_; i++) {
+      fp = mersenneModulo(fp * sigma);
+      fp = mersenneModulo(fp + text_[i]);
+    }
+    for (uint64_t i = 0; i < length_ - 1; i++) {
+      sigma_c = mersenneModulo(sigma_c * sigma);
+    }
+    hash = (uint64_t)(fp);
+    max_sigma = (uint64_t)(sigma_c);
+  };
+
+  uint64_t roll(uint64_t hash, uint128_t sigma, uint128_t max_sigma,
+                T out_char, T in_char) {
+    uint128_t fp = hash;
+    uint128_t out_char_influence = out_char * max_sigma;
     out_char_influence = mersenneModulo(out_char_influence);
-    if (out_char_influence < hash_) {
+    if (out_char_influence < hash) {
       fp -= out_char_influence;
     } else {
       fp = prime_ - (out_char_influence - fp);
     }
-    fp *= sigma_;
+    fp *= sigma;
     fp += in_char;
     fp = mersenneModulo(fp);
-    hash_ = (uint64_t)(fp);
-    init_++;
+    return (uint64_t)(fp);
   };
 };
 
@@ -0,0 +1,207 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace pasta {
+
+// Peak resident set size of the process in bytes, -1 if it is not available.
+// If reset is true, the peak is set to the current resident set size first.
+inline int64_t peak_rss(bool reset = false) {
+  if (reset) {
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+    clear_refs.close();
+    if (clear_refs.fail()) {
+      return -1;
+    }
+  }
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.rfind("VmHWM:", 0) == 0) {
+      return std::stoll(line.substr(6)) * 1024;
+    }
+  }
+  return -1;
+}
+
+// Bytes allocated by the given buffers of a construction, measured from their
+// current sizes: the capacity of vectors, the space usage of bit vectors and of
+// the packed vectors of this library, and the buckets, nodes and mapped
+// vectors of hash maps.
+template <typename... Buffers>
+int64_t allocated_bytes(Buffers const &...buffers) {
+  auto bytes = [](auto const &buffer) -> int64_t {
+    if constexpr (requires { buffer.bucket_count(); }) {
+      int64_t sum = sizeof(void *) * buffer.bucket_count();
+      for (auto const &entry : buffer) {
+        // a node also holds the next pointer and the cached hash value
+        sum += sizeof(entry) + sizeof(void *) + sizeof(size_t) +
+               allocated_bytes(entry.second);
+      }
+      return sum;
+    } else if constexpr (requires { buffer.space_usage(); }) {
+      return buffer.space_usage();
+    } else {
+      return sizeof(buffer[0]) * buffer.capacity();
+    }
+  };
+  return (int64_t{0} + ... + bytes(buffers));
+}
+
+// One measured phase of a construction.
+struct PhaseRecord {
+  std::string name;
+  // level of the tree the phase works on, -1 if it works on all levels
+  int64_t level = -1;
+  double seconds = 0;
+  int32_t threads = 1;
+  // bytes of the buffers allocated by the phase as estimated from the input
+  // size, 0 if they are not estimated
+  int64_t estimated_bytes = 0;
+  // increase of the process's peak resident set size during the phase, -1 if
+  // unknown. Unless the profiler resets the peak, it is 0 for phases that stay
+  // below an earlier peak.
+  int64_t peak_rss_increase = -1;
+};
+
+// Collects the phases of all constructions that run on a thread while the
+// profiler is active there, see ProfilingScope. Phases are only measured if
+// PASTA_BLOCK_TREE_PROFILE is defined, otherwise the profiler stays empty.
+class BuildProfiler {
+public:
+  std::vector<PhaseRecord> phases_;
+  // Whether the peak resident set size of the process is reset at the start of
+  // each phase, which measures the increase from the resident set size at the
+  // start instead of from the earlier peak. The peak is shared by the whole
+  // process, so this is off by default.
+  bool reset_peak_rss_ = false;
+
+  // The profiler that the phases of the calling thread are added to.
+  static BuildProfiler *&active() {
+    thread_local BuildProfiler *profiler = nullptr;
+    return profiler;
+  }
+
+  void write_json(std::ostream &out) const {
+    out << "{\"phases\":[";
+    for (size_t i = 0; i < phases_.size(); i++) {
+      auto const &phase = phases_[i];
+      out << (i > 0 ? "," : "") << "{\"name\":\"" << phase.name
+          << "\",\"level\":" << phase.level
+          << ",\"seconds\":" << phase.seconds
+          << ",\"threads\":" << phase.threads
+          << ",\"estimated_bytes\":" << phase.estimated_bytes
+          << ",\"peak_rss_increase\":" << phase.peak_rss_increase << "}";
+    }
+    out << "]}";
+  }
+
+  std::string to_json() const {
+    std::ostringstream out;
+    write_json(out);
+    return out.str();
+  }
+};
+
+// Makes a profiler the active one of the calling thread while in scope.
+class ProfilingScope {
+public:
+  explicit ProfilingScope(BuildProfiler &profiler)
+      : previous_(BuildProfiler::active()) {
+    BuildProfiler::active() = &profiler;
+  }
+  ~ProfilingScope() { BuildProfiler::active() = previous_; }
+  ProfilingScope(ProfilingScope const &) = delete;
+  ProfilingScope &operator=(ProfilingScope const &) = delete;
+
+private:
+  BuildProfiler *previous_;
+};
+
+// Measures a phase from its creation until it goes out of scope or the next
+// phase is started and adds it to the active profiler. Phases must not be
+// nested. Without PASTA_BLOCK_TREE_PROFILE this class is empty and all calls
+// are no-ops.
+class ProfilePhase {
+public:
+#ifdef PASTA_BLOCK_TREE_PROFILE
+  ProfilePhase(char const *name, int64_t level = -1, int32_t threads = 1)
+      : profiler_(BuildProfiler::active()) {
+    start(name, level, threads);
+  }
+  ~ProfilePhase() { finish(); }
+  // Ends this phase and starts the next one with the same number of threads.
+  void next(char const *name, int64_t level = -1) {
+    finish();
+    start(name, level, record_.threads);
+  }
+  void set_estimated_bytes(int64_t bytes) { record_.estimated_bytes = bytes; }
+
+private:
+  void start(char const *name, int64_t level, int32_t threads) {
+    if (profiler_ != nullptr) {
+      record_ = PhaseRecord{name, level, 0, threads, 0, -1};
+      start_rss_ = peak_rss(profiler_->reset_peak_rss_);
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+  void finish() {
+    if (profiler_ != nullptr) {
+      std::chrono::duration<double> time =
+          std::chrono::steady_clock::now() - start_;
+      record_.seconds = time.count();
+      int64_t peak = peak_rss();
+      if (start_rss_ >= 0 && peak >= 0) {
+        record_.peak_rss_increase = std::max<int64_t>(0, peak - start_rss_);
+      }
+      profiler_->phases_.push_back(record_);
+    }
+  }
+
+  BuildProfiler *profiler_;
+  PhaseRecord record_;
+  std::chrono::steady_clock::time_point start_;
+  int64_t start_rss_ = -1;
+
+public:
+#else
+  ProfilePhase(char const *, int64_t = -1, int32_t = 1) {}
+  void next(char const *, int64_t = -1) {}
+  void set_estimated_bytes(int64_t) {}
+#endif
+  ProfilePhase(ProfilePhase const &) = delete;
+  ProfilePhase &operator=(ProfilePhase const &) = delete;
+};
+
+} // namespace pasta
+
+/******************************************************************************/
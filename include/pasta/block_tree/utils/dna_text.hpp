@@ -0,0 +1,225 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include "pasta/block_tree/utils/text_iterator.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <unordered_map>
+#include <vector>
+
+namespace pasta {
+
+// Runs of equal characters other than A, C, G and T in a DNA text, e.g., the
+// runs of N in genome assemblies.
+class DnaRuns {
+public:
+  // Run of length characters c starting at position begin. before is the total
+  // length of the runs in front of it and before_char the total length of the
+  // runs of c in front of it.
+  struct Run {
+    int64_t begin;
+    int64_t length;
+    int64_t before;
+    int64_t before_char;
+    uint8_t c;
+  };
+
+  // Appends character c at position index, which must be behind all runs.
+  void push_back(int64_t index, uint8_t c) {
+    if (!runs_.empty() && runs_.back().c == c &&
+        runs_.back().begin + runs_.back().length == index) {
+      runs_.back().length++;
+    } else {
+      runs_.push_back(Run{index, 1, rank(index), rank(c, index), c});
+      runs_of_[c].push_back(runs_.size() - 1);
+    }
+  }
+
+  // Run containing position index or nullptr.
+  Run const *find(int64_t index) const {
+    auto it = last_run_before(index);
+    if (it == runs_.end() || index >= it->begin + it->length) {
+      return nullptr;
+    }
+    return &*it;
+  }
+
+  // Number of positions in [0, index) that belong to runs.
+  int64_t rank(int64_t index) const {
+    auto it = last_run_before(index);
+    if (it == runs_.end()) {
+      return 0;
+    }
+    return it->before + std::min(it->length, index - it->begin);
+  }
+
+  // Number of occurrences of c in [0, index).
+  int64_t rank(uint8_t c, int64_t index) const {
+    auto const *runs = runs_of(c);
+    if (runs == nullptr) {
+      return 0;
+    }
+    // last run of c that begins before index
+    auto it = std::partition_point(
+        runs->begin(), runs->end(),
+        [&](int64_t r) { return runs_[r].begin < index; });
+    if (it == runs->begin()) {
+      return 0;
+    }
+    Run const &run = runs_[*(it - 1)];
+    return run.before_char + std::min(run.length, index - run.begin);
+  }
+
+  // Position of the j-th occurrence of c or -1 if c occurs less often.
+  int64_t select(uint8_t c, int64_t j) const {
+    auto const *runs = runs_of(c);
+    if (runs == nullptr || j < 1) {
+      return -1;
+    }
+    // last run of c with less than j occurrences of c in front of it
+    auto it = std::partition_point(
+        runs->begin(), runs->end(),
+        [&](int64_t r) { return runs_[r].before_char < j; });
+    Run const &run = runs_[*(it - 1)];
+    if (j > run.before_char + run.length) {
+      return -1;
+    }
+    return run.begin + j - run.before_char - 1;
+  }
+
+  std::vector<Run> const &runs() const { return runs_; }
+
+  int64_t space_usage() const {
+    int64_t bytes = runs_.capacity() * sizeof(Run) + sizeof(*this);
+    for (auto const &[c, runs] : runs_of_) {
+      bytes += runs.capacity() * sizeof(int64_t) + sizeof(runs);
+    }
+    return bytes;
+  }
+
+private:
+  // Indices of the runs of c or nullptr if there are none.
+  std::vector<int64_t> const *runs_of(uint8_t c) const {
+    auto it = runs_of_.find(c);
+    return (it == runs_of_.end()) ? nullptr : &it->second;
+  }
+
+  // Last run that begins at or before position index or runs_.end().
+  std::vector<Run>::const_iterator last_run_before(int64_t index) const {
+    auto it = std::upper_bound(
+        runs_.begin(), runs_.end(), index,
+        [](int64_t i, Run const &run) { return i < run.begin; });
+    return (it == runs_.begin()) ? runs_.end() : it - 1;
+  }
+
+  std::vector<Run> runs_;
+  // indices of the runs of each character in text order
+  std::unordered_map<uint8_t, std::vector<int64_t>> runs_of_;
+};
+
+// DNA text with two bits per character. The codes 0 to 3 stand for A, C, G and
+// T. Any other character is stored as A and kept in the runs. operator[]
+// returns the characters of the codes, i.e., the text with all runs replaced
+// by A, which allows building block trees on the packed text directly.
+class PackedDnaText {
+public:
+  using ConstIterator = TextIterator<PackedDnaText, uint8_t>;
+
+  static constexpr uint8_t kCharacters[4] = {'A', 'C', 'G', 'T'};
+
+  PackedDnaText() = default;
+
+  template <typename Iterator> PackedDnaText(Iterator begin, Iterator end) {
+    if constexpr (std::random_access_iterator<Iterator>) {
+      words_.reserve((end - begin + 31) / 32);
+    }
+    for (; begin != end; ++begin) {
+      push_back(*begin);
+    }
+  }
+
+  explicit PackedDnaText(std::vector<uint8_t> const &text)
+      : PackedDnaText(text.begin(), text.end()){};
+
+  // Code of a character or -1 if it is not one of A, C, G and T.
+  static int32_t code_of(uint8_t c) {
+    switch (c) {
+    case 'A':
+      return 0;
+    case 'C':
+      return 1;
+    case 'G':
+      return 2;
+    case 'T':
+      return 3;
+    default:
+      return -1;
+    }
+  }
+
+  void push_back(uint8_t c) {
+    if (size_ % 32 == 0) {
+      words_.push_back(0);
+    }
+    int32_t code = code_of(c);
+    if (code < 0) {
+      runs_.push_back(size_, c);
+      code = 0;
+    }
+    words_.back() |= static_cast<uint64_t>(code) << (2 * (size_ % 32));
+    size_++;
+  }
+
+  uint8_t code(int64_t index) const {
+    return (words_[index / 32] >> (2 * (index % 32))) & 0b11;
+  }
+
+  uint8_t operator[](int64_t index) const { return kCharacters[code(index)]; }
+
+  // Character at position index including the runs.
+  uint8_t at(int64_t index) const {
+    auto const *run = runs_.find(index);
+    return (run == nullptr) ? operator[](index) : run->c;
+  }
+
+  DnaRuns const &runs() const { return runs_; }
+  uint64_t const *data() const { return words_.data(); }
+  uint64_t size() const { return size_; }
+  ConstIterator begin() const { return ConstIterator(this, 0); }
+  ConstIterator end() const { return ConstIterator(this, size_); }
+
+  int64_t space_usage() const {
+    return words_.capacity() * sizeof(uint64_t) + runs_.space_usage() +
+           sizeof(*this);
+  }
+
+private:
+  int64_t size_ = 0;
+  std::vector<uint64_t> words_;
+  DnaRuns runs_;
+};
+
+} // namespace pasta
+
+/******************************************************************************/
@@ -0,0 +1,111 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace pasta {
+
+// Vector of signed 40-bit integers stored in five bytes each. This is enough
+// for positions in texts of up to 512 GiB and saves 3/8 of the space of an
+// int64_t vector. Entries are byte aligned, hence different entries can be
+// written concurrently.
+class Int40Vector {
+public:
+  class Reference {
+  public:
+    Reference(Int40Vector &vector, uint64_t index)
+        : vector_(vector), index_(index){};
+    operator int64_t() const { return vector_.get(index_); }
+    Reference &operator=(int64_t value) {
+      vector_.set(index_, value);
+      return *this;
+    }
+    Reference &operator=(Reference const &other) {
+      vector_.set(index_, other);
+      return *this;
+    }
+
+  private:
+    Int40Vector &vector_;
+    uint64_t index_;
+  };
+
+  Int40Vector() = default;
+  explicit Int40Vector(uint64_t size, int64_t value = 0)
+      : size_(size), data_(kBytes * size) {
+    if (value != 0) {
+      for (uint64_t i = 0; i < size_; i++) {
+        set(i, value);
+      }
+    }
+  };
+
+  inline int64_t get(uint64_t index) const {
+    uint64_t value = 0;
+    std::memcpy(&value, data_.data() + kBytes * index, kBytes);
+    // sign extension of the 40-bit value
+    return static_cast<int64_t>(value << 24) >> 24;
+  }
+
+  inline void set(uint64_t index, int64_t value) {
+    std::memcpy(data_.data() + kBytes * index, &value, kBytes);
+  }
+
+  int64_t operator[](uint64_t index) const { return get(index); }
+  Reference operator[](uint64_t index) { return Reference(*this, index); }
+
+  int64_t back() const { return get(size_ - 1); }
+
+  void push_back(int64_t value) {
+    data_.resize(kBytes * (size_ + 1));
+    set(size_++, value);
+  }
+
+  uint64_t size() const { return size_; }
+
+  void resize(uint64_t size) {
+    size_ = size;
+    data_.resize(kBytes * size);
+  }
+
+  void clear() {
+    size_ = 0;
+    data_.clear();
+    data_.shrink_to_fit();
+  }
+
+  uint64_t space_usage() const { return data_.capacity() + sizeof(*this); }
+
+private:
+  static_assert(std::endian::native == std::endian::little,
+                "Int40Vector stores the lowest five bytes of each value");
+  static constexpr uint64_t kBytes = 5;
+  uint64_t size_ = 0;
+  std::vector<uint8_t> data_;
+};
+
+} // namespace pasta
+
+/******************************************************************************/
@@ -21,19 +21,178 @@
 #pragma once
 
 #include "pasta/block_tree/utils/ANSV.hpp"
+#include "pasta/block_tree/utils/build_profiler.hpp"
+#include "pasta/block_tree/utils/int40_vector.hpp"
 #include "pasta/block_tree/utils/range_minimum.hpp"
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <libsais.h>
 #include <libsais64.h>
 #include <omp.h>
 #include <stack>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace pasta {
 
-template <typename size_type>
-int32_t calculate_lz_factor(size_type &z, std::vector<size_type> &lpf,
+// Number of bytes held by the buffers of lpf_array and lpf_array_ansv in each
+// of their phases, including the output arrays. The functions measure them
+// with allocated_bytes when the phase's buffers are alive, the predict
+// functions below give upper bounds before the construction. lpf_array only
+// has the suffix array and the lpf phase.
+struct LpfMemoryUsage {
+  // suffix array, PLCP and LCP array
+  int64_t suffix_array = 0;
+  // nearest smaller values of the suffix array
+  int64_t ansv = 0;
+  // range minimum queries on the LCP array
+  int64_t rmq = 0;
+  // permutation of the results from suffix array order to text order
+  int64_t lpf = 0;
+
+  int64_t peak() const { return std::max({suffix_array, ansv, rmq, lpf}); }
+};
+
+// Bytes that lpf_array_ansv allocates in each phase for a text of length n
+// whose results are stored with entry_bytes bytes per entry, i.e., 4 and 8 for
+// int32_t and int64_t vectors and 5 for Int40Vectors.
+inline LpfMemoryUsage predict_lpf_array_ansv_memory(int64_t n,
+                                                    int64_t entry_bytes) {
+  LpfMemoryUsage memory;
+  if (entry_bytes == 4) {
+    memory.suffix_array = 4 * sizeof(int32_t) * n;
+    memory.ansv = 4 * sizeof(int32_t) * n;
+    memory.rmq = 4 * sizeof(int32_t) * n +
+                 RangeMinimum<int32_t>::predict_space_usage(n);
+    memory.lpf = 4 * sizeof(int32_t) * n;
+  } else {
+    memory.suffix_array = 4 * sizeof(int64_t) * n;
+    memory.ansv = 4 * sizeof(int64_t) * n;
+    memory.rmq = 4 * sizeof(int64_t) * n +
+                 RangeMinimum<int64_t>::predict_space_usage(n);
+    memory.lpf = (entry_bytes == 8) ? 4 * sizeof(int64_t) * n
+                                    : 3 * sizeof(int64_t) * n + 5 * n +
+                                          sizeof(Int40Vector);
+  }
+  return memory;
+}
+
+// Bytes that lpf_array allocates in each phase for a text of length n and
+// entries of entry_bytes bytes.
+inline LpfMemoryUsage predict_lpf_array_memory(int64_t n, int64_t entry_bytes) {
+  LpfMemoryUsage memory;
+  memory.suffix_array = 5 * entry_bytes * n;
+  memory.lpf = 7 * entry_bytes * n;
+  return memory;
+}
+
+// Suffix arrays and PLCP arrays computed with libsais. Byte texts are passed
+// directly. Wider symbols are renamed to their rank among the distinct symbols
+// of the text, since the integer variants of libsais expect a text of the
+// suffix array's integer type over the alphabet [0, k).
+template <typename input_type, typename size_type> class SuffixSorter {
+public:
+  SuffixSorter(std::vector<input_type> const &text, int32_t threads)
+      : text_(text), threads_(std::max<int32_t>(1, threads)) {
+    if constexpr (sizeof(input_type) > 1) {
+      static_assert(std::is_unsigned_v<input_type>,
+                    "symbols must be unsigned integers");
+      rename();
+    }
+  }
+
+  void suffix_array(size_type *sa) {
+    size_type n = text_.size();
+    if constexpr (sizeof(input_type) == 1) {
+      auto const *text = reinterpret_cast<uint8_t const *>(text_.data());
+      if constexpr (sizeof(size_type) == 4) {
+        if (threads_ == 1) {
+          libsais(text, sa, n, 0, nullptr);
+        } else {
+          libsais_omp(text, sa, n, 0, nullptr, threads_);
+        }
+      } else {
+        if (threads_ == 1) {
+          libsais64(text, sa, n, 0, nullptr);
+        } else {
+          libsais64_omp(text, sa, n, 0, nullptr, threads_);
+        }
+      }
+    } else if constexpr (sizeof(size_type) == 4) {
+      libsais_int_omp(renamed_.data(), sa, n, sigma_, 0, threads_);
+    } else {
+      libsais64_long_omp(renamed_.data(), sa, n, sigma_, 0, threads_);
+    }
+  }
+
+  void plcp(size_type const *sa, size_type *plcp) {
+    size_type n = text_.size();
+    if constexpr (sizeof(input_type) == 1) {
+      auto const *text = reinterpret_cast<uint8_t const *>(text_.data());
+      if constexpr (sizeof(size_type) == 4) {
+        if (threads_ == 1) {
+          libsais_plcp(text, sa, plcp, n);
+        } else {
+          libsais_plcp_omp(text, sa, plcp, n, threads_);
+        }
+      } else {
+        if (threads_ == 1) {
+          libsais64_plcp(text, sa, plcp, n);
+        } else {
+          libsais64_plcp_omp(text, sa, plcp, n, threads_);
+        }
+      }
+    } else if constexpr (sizeof(size_type) == 4) {
+      libsais_plcp_int_omp(renamed_.data(), sa, plcp, n, threads_);
+    } else {
+      libsais64_plcp_long_omp(renamed_.data(), sa, plcp, n, threads_);
+    }
+  }
+
+  // bytes of the renamed text
+  int64_t space_usage() const { return sizeof(size_type) * renamed_.size(); }
+
+private:
+  std::vector<input_type> const &text_;
+  int32_t threads_;
+  std::vector<size_type> renamed_;
+  size_type sigma_ = 0;
+
+  void rename() {
+    int64_t n = text_.size();
+    std::vector<input_type> symbols;
+    if constexpr (sizeof(input_type) <= 2) {
+      std::vector<uint8_t> used(size_t{1} << (8 * sizeof(input_type)), 0);
+      for (auto c : text_) {
+        used[c] = 1;
+      }
+      for (size_t c = 0; c < used.size(); c++) {
+        if (used[c]) {
+          symbols.push_back(c);
+        }
+      }
+    } else {
+      symbols = text_;
+      std::sort(symbols.begin(), symbols.end());
+      symbols.erase(std::unique(symbols.begin(), symbols.end()),
+                    symbols.end());
+    }
+    sigma_ = symbols.size();
+    renamed_.resize(n);
+    omp_set_num_threads(threads_);
+#pragma omp parallel for default(none) shared(symbols, n)
+    for (int64_t i = 0; i < n; i++) {
+      renamed_[i] =
+          std::lower_bound(symbols.begin(), symbols.end(), text_[i]) -
+          symbols.begin();
+    }
+  }
+};
+
+template <typename size_type, typename lpf_vector>
+int32_t calculate_lz_factor(size_type &z, lpf_vector &lpf,
                             std::vector<size_type> &lz) {
   size_type i = 0;
   lz.push_back(0);
@@ -59,18 +218,34 @@ int32_t calculate_number_lz_factor(size_type &z, std::vector<size_type> &lpf) {
   return 0;
 }
 
-int32_t lpf_array(std::vector<uint8_t> &text, std::vector<int64_t> &lpf,
-                  std::vector<int64_t> &lpf_ptr) {
+template <typename input_type>
+int32_t lpf_array(std::vector<input_type> &text, std::vector<int64_t> &lpf,
+                  std::vector<int64_t> &lpf_ptr,
+                  LpfMemoryUsage *memory = nullptr) {
+  ProfilePhase phase("suffix_array");
+  phase.set_estimated_bytes(3 * sizeof(int64_t) * text.size());
   std::vector<int64_t> sa(text.size());
   std::vector<int64_t> p_lcp(text.size());
   std::vector<int64_t> lcp(text.size());
-  libsais64(text.data(), sa.data(), text.size(), 0, NULL);
-  libsais64_plcp(text.data(), sa.data(), p_lcp.data(), text.size());
+  SuffixSorter<input_type, int64_t> sorter(text, 1);
+  sorter.suffix_array(sa.data());
+  phase.next("lcp_array");
+  sorter.plcp(sa.data(), p_lcp.data());
   libsais64_lcp(p_lcp.data(), sa.data(), lcp.data(), text.size());
+  phase.next("lpf_from_lcp");
+  phase.set_estimated_bytes(2 * sizeof(int64_t) * text.size());
+  if (memory != nullptr) {
+    memory->suffix_array =
+        allocated_bytes(sa, p_lcp, lcp, lpf, lpf_ptr, sorter);
+  }
 
-  std::vector<int64_t> isu(text.size());
+  // the PLCP array is not needed anymore, reuse its memory
+  std::vector<int64_t> isu = std::move(p_lcp);
   std::vector<int64_t> prev(text.size());
   std::vector<int64_t> next(text.size());
+  if (memory != nullptr) {
+    memory->lpf = allocated_bytes(sa, isu, lcp, prev, next, lpf, lpf_ptr);
+  }
   for (size_t i = 0; i < text.size(); i++) {
     isu[sa[i]] = i;
   }
@@ -104,15 +279,18 @@ int32_t lpf_array(std::vector<uint8_t> &text, std::vector<int64_t> &lpf,
   }
   return 0;
 }
-int32_t lpf_array_omp(std::vector<uint8_t> &text, std::vector<int64_t> &lpf,
+template <typename input_type>
+int32_t lpf_array_omp(std::vector<input_type> &text, std::vector<int64_t> &lpf,
                       std::vector<int64_t> &lpf_ptr, int32_t threads) {
   std::vector<int64_t> sa(text.size());
   std::vector<int64_t> plcp(text.size());
   std::vector<int64_t> lcp(text.size());
-  libsais64_omp(text.data(), sa.data(), text.size(), 0, NULL, threads);
-  libsais64_plcp_omp(text.data(), sa.data(), plcp.data(), text.size(), threads);
+  SuffixSorter<input_type, int64_t> sorter(text, threads);
+  sorter.suffix_array(sa.data());
+  sorter.plcp(sa.data(), plcp.data());
   libsais64_lcp_omp(plcp.data(), sa.data(), lcp.data(), text.size(), threads);
-  std::vector<int64_t> isu(text.size());
+  // the PLCP array is not needed anymore, reuse its memory
+  std::vector<int64_t> isu = std::move(plcp);
   std::vector<int64_t> prev(text.size());
   std::vector<int64_t> next(text.size());
 #pragma omp for
@@ -149,15 +327,18 @@ int32_t lpf_array_omp(std::vector<uint8_t> &text, std::vector<int64_t> &lpf,
   return 0;
 }
 
-int32_t lpf_array_omp(std::vector<uint8_t> &text, std::vector<int32_t> &lpf,
+template <typename input_type>
+int32_t lpf_array_omp(std::vector<input_type> &text, std::vector<int32_t> &lpf,
                       std::vector<int32_t> &lpf_ptr, int32_t threads) {
   std::vector<int32_t> sa(text.size());
   std::vector<int32_t> plcp(text.size());
   std::vector<int32_t> lcp(text.size());
-  libsais_omp(text.data(), sa.data(), text.size(), 0, NULL, threads);
-  libsais_plcp_omp(text.data(), sa.data(), plcp.data(), text.size(), threads);
+  SuffixSorter<input_type, int32_t> sorter(text, threads);
+  sorter.suffix_array(sa.data());
+  sorter.plcp(sa.data(), plcp.data());
   libsais_lcp_omp(plcp.data(), sa.data(), lcp.data(), text.size(), threads);
-  std::vector<int32_t> isu(text.size());
+  // the PLCP array is not needed anymore, reuse its memory
+  std::vector<int32_t> isu = std::move(plcp);
   std::vector<int32_t> prev(text.size());
   std::vector<int32_t> next(text.size());
 #pragma omp for
@@ -191,14 +372,24 @@ int32_t lpf_array_omp(std::vector<uint8_t> &text, std::vector<int32_t> &lpf,
   return 0;
 }
 
-int32_t lpf_array_stack(std::vector<uint8_t> &text, std::vector<int32_t> &lpf,
+template <typename input_type>
+int32_t lpf_array_stack(std::vector<input_type> &text,
+                        std::vector<int32_t> &lpf,
                         std::vector<int32_t> &lpf_ptr) {
+  ProfilePhase phase("suffix_array");
+  phase.set_estimated_bytes(2 * sizeof(int32_t) * (text.size() + 1));
   std::vector<int32_t> sa(text.size());
-  std::vector<int32_t> plcp(text.size());
   std::vector<int32_t> lcp(text.size());
-  libsais(text.data(), sa.data(), (int)text.size(), 0, nullptr);
-  libsais_plcp(text.data(), sa.data(), plcp.data(), (int)text.size());
-  libsais_lcp(plcp.data(), sa.data(), lcp.data(), (int)text.size());
+  // room for the sentinels, avoids reallocating both arrays
+  sa.reserve(text.size() + 1);
+  lcp.reserve(text.size() + 1);
+  SuffixSorter<input_type, int32_t> sorter(text, 1);
+  sorter.suffix_array(sa.data());
+  phase.next("lcp_array");
+  // lpf_ptr is overwritten below, use it for the PLCP array
+  sorter.plcp(sa.data(), lpf_ptr.data());
+  libsais_lcp(lpf_ptr.data(), sa.data(), lcp.data(), text.size());
+  phase.next("lpf_from_lcp");
   std::stack<std::pair<int32_t, int32_t>> stacker;
   sa.push_back(-1);
   lcp.push_back(0);
@@ -225,14 +416,24 @@ int32_t lpf_array_stack(std::vector<uint8_t> &text, std::vector<int32_t> &lpf,
   return 0;
 }
 
-int32_t lpf_array_stack(std::vector<uint8_t> &text, std::vector<int64_t> &lpf,
+template <typename input_type>
+int32_t lpf_array_stack(std::vector<input_type> &text,
+                        std::vector<int64_t> &lpf,
                         std::vector<int64_t> &lpf_ptr) {
+  ProfilePhase phase("suffix_array");
+  phase.set_estimated_bytes(2 * sizeof(int64_t) * (text.size() + 1));
   std::vector<int64_t> sa(text.size());
-  std::vector<int64_t> plcp(text.size());
   std::vector<int64_t> lcp(text.size());
-  libsais64(text.data(), sa.data(), (int)text.size(), 0, nullptr);
-  libsais64_plcp(text.data(), sa.data(), plcp.data(), (int)text.size());
-  libsais64_lcp(plcp.data(), sa.data(), lcp.data(), (int)text.size());
+  // room for the sentinels, avoids reallocating both arrays
+  sa.reserve(text.size() + 1);
+  lcp.reserve(text.size() + 1);
+  SuffixSorter<input_type, int64_t> sorter(text, 1);
+  sorter.suffix_array(sa.data());
+  phase.next("lcp_array");
+  // lpf_ptr is overwritten below, use it for the PLCP array
+  sorter.plcp(sa.data(), lpf_ptr.data());
+  libsais64_lcp(lpf_ptr.data(), sa.data(), lcp.data(), text.size());
+  phase.next("lpf_from_lcp");
   std::stack<std::pair<int64_t, int64_t>> stacker;
   sa.push_back(-1);
   lcp.push_back(0);
@@ -260,18 +461,33 @@ int32_t lpf_array_stack(std::vector<uint8_t> &text, std::vector<int64_t> &lpf,
   return 0;
 }
 
-int32_t lpf_array(std::vector<uint8_t> &text, std::vector<int32_t> &lpf,
-                  std::vector<int32_t> &lpf_ptr) {
+template <typename input_type>
+int32_t lpf_array(std::vector<input_type> &text, std::vector<int32_t> &lpf,
+                  std::vector<int32_t> &lpf_ptr,
+                  LpfMemoryUsage *memory = nullptr) {
+  ProfilePhase phase("suffix_array");
+  phase.set_estimated_bytes(3 * sizeof(int32_t) * text.size());
   std::vector<int32_t> sa(text.size());
   std::vector<int32_t> plcp(text.size());
   std::vector<int32_t> lcp(text.size());
-  libsais(text.data(), sa.data(), text.size(), 0, NULL);
-  libsais_plcp(text.data(), sa.data(), plcp.data(), text.size());
+  SuffixSorter<input_type, int32_t> sorter(text, 1);
+  sorter.suffix_array(sa.data());
+  phase.next("lcp_array");
+  sorter.plcp(sa.data(), plcp.data());
   libsais_lcp(plcp.data(), sa.data(), lcp.data(), text.size());
+  phase.next("lpf_from_lcp");
+  phase.set_estimated_bytes(2 * sizeof(int32_t) * text.size());
+  if (memory != nullptr) {
+    memory->suffix_array = allocated_bytes(sa, plcp, lcp, lpf, lpf_ptr, sorter);
+  }
 
-  std::vector<int32_t> isu(text.size());
+  // the PLCP array is not needed anymore, reuse its memory
+  std::vector<int32_t> isu = std::move(plcp);
   std::vector<int32_t> prev(text.size());
   std::vector<int32_t> next(text.size());
+  if (memory != nullptr) {
+    memory->lpf = allocated_bytes(sa, isu, lcp, prev, next, lpf, lpf_ptr);
+  }
   for (uint64_t i = 0; i < text.size(); i++) {
     isu[sa[i]] = i;
   }
@@ -311,7 +527,8 @@ int32_t lpf_array(std::string &text, std::vector<int32_t> &lpf,
   libsais_plcp(reinterpret_cast<const uint8_t *>(text.c_str()), sa.data(),
                plcp.data(), text.size());
   libsais_lcp(plcp.data(), sa.data(), lcp.data(), text.size());
-  std::vector<int32_t> isu(text.size());
+  // the PLCP array is not needed anymore, reuse its memory
+  std::vector<int32_t> isu = std::move(plcp);
   std::vector<int32_t> prev(text.size());
   std::vector<int32_t> next(text.size());
   for (uint64_t i = 0; i < text.size(); i++) {
@@ -335,28 +552,25 @@ int32_t lpf_array(std::string &text, std::vector<int32_t> &lpf,
   return 0;
 }
 
-int32_t lpf_array_ansv(std::vector<uint8_t> &text, std::vector<int32_t> &lpf,
-                       std::vector<int32_t> &prev_Occ, int32_t threads) {
-  std::vector<int32_t> sa(text.size());
-  std::vector<int32_t> plcp(text.size());
-  std::vector<int32_t> lcp(text.size());
-  libsais_omp(text.data(), sa.data(), text.size(), 0, NULL, threads);
-  libsais_plcp_omp(text.data(), sa.data(), plcp.data(), text.size(), threads);
-  libsais_lcp_omp(plcp.data(), sa.data(), lcp.data(), text.size(), threads);
-
-  std::vector<int32_t> l(text.size());
-  std::vector<int32_t> r(text.size());
-
-  ansv_omp(sa, l, r, threads);
-
-  auto rmq = RangeMinimum<int32_t>(lcp, lcp.size(), threads);
+// Replaces the nearest smaller values l[i] and r[i] of the suffix array by the
+// LPF value and the previous occurrence of suffix sa[i].
+template <typename size_type>
+void lpf_from_nearest_smaller_values(std::vector<size_type> const &sa,
+                                     std::vector<size_type> const &lcp,
+                                     std::vector<size_type> &l,
+                                     std::vector<size_type> &r,
+                                     int32_t threads,
+                                     LpfMemoryUsage *memory) {
+  auto rmq = RangeMinimum<size_type>(lcp, lcp.size(), threads);
+  if (memory != nullptr) {
+    memory->rmq = allocated_bytes(sa, lcp, l, r, rmq);
+  }
+  int64_t n = sa.size();
   omp_set_num_threads(threads);
-
-#pragma omp parallel for default(none) shared(lpf, l, r, sa, lcp, rmq, prev_Occ)
-  for (uint64_t i = 0; i < lpf.size(); i++) {
-    int32_t l_lcp = 0, r_lcp = 0;
-    int32_t ln = l[i], rn = r[i];
-    int32_t sai = sa[i];
+#pragma omp parallel for default(none) shared(l, r, sa, lcp, rmq, n)
+  for (int64_t i = 0; i < n; i++) {
+    size_type l_lcp = 0, r_lcp = 0;
+    size_type ln = l[i], rn = r[i];
     if (ln != -1) {
       l_lcp = lcp[rmq.query(ln + 1, i)];
     }
@@ -365,61 +579,168 @@ int32_t lpf_array_ansv(std::vector<uint8_t> &text, std::vector<int32_t> &lpf,
     }
 
     if (l_lcp == 0 && r_lcp == 0) {
-      prev_Occ[sai] = -1;
-      lpf[sai] = 1;
+      r[i] = -1;
+      l[i] = 1;
     } else if (l_lcp > r_lcp) {
-      prev_Occ[sai] = sa[ln];
-      lpf[sai] = l_lcp;
+      r[i] = sa[ln];
+      l[i] = l_lcp;
     } else {
-      prev_Occ[sai] = sa[rn];
-      lpf[sai] = r_lcp;
+      r[i] = sa[rn];
+      l[i] = r_lcp;
     }
   }
+}
+
+// Moves values[i] to position sa[i] using buffer, which afterwards contains the
+// old content of values.
+template <typename size_type, typename lpf_vector>
+void permute_to_text_order(std::vector<size_type> const &sa,
+                           std::vector<size_type> const &values,
+                           lpf_vector &buffer, int32_t threads) {
+  int64_t n = sa.size();
+  omp_set_num_threads(threads);
+#pragma omp parallel for default(none) shared(sa, values, buffer, n)
+  for (int64_t i = 0; i < n; i++) {
+    buffer[sa[i]] = values[i];
+  }
+}
+
+// The LPF array is computed from the suffix array, the LCP array and the
+// nearest smaller values of the suffix array. To keep the memory footprint
+// small, lpf and prev_Occ are used as scratch space for the PLCP array and the
+// nearest smaller values, the results are computed in suffix array order in
+// place and then moved to text order using the LCP array's buffer. Besides
+// lpf and prev_Occ, at most two arrays of length n (and the RMQ) are alive.
+template <typename input_type>
+int32_t lpf_array_ansv(std::vector<input_type> &text, std::vector<int32_t> &lpf,
+                       std::vector<int32_t> &prev_Occ, int32_t threads,
+                       LpfMemoryUsage *memory = nullptr) {
+  int64_t n = text.size();
+  ProfilePhase phase("suffix_array", -1, threads);
+  phase.set_estimated_bytes(2 * sizeof(int32_t) * n);
+  std::vector<int32_t> sa(n);
+  std::vector<int32_t> lcp(n);
+  SuffixSorter<input_type, int32_t> sorter(text, threads);
+  sorter.suffix_array(sa.data());
+  phase.next("lcp_array");
+  sorter.plcp(sa.data(), prev_Occ.data());
+  libsais_lcp_omp(prev_Occ.data(), sa.data(), lcp.data(), n, threads);
+  if (memory != nullptr) {
+    memory->suffix_array = allocated_bytes(sa, lcp, lpf, prev_Occ, sorter);
+  }
+
+  phase.next("ansv");
+  ansv_omp(sa, lpf, prev_Occ, threads);
+  if (memory != nullptr) {
+    memory->ansv = allocated_bytes(sa, lcp, lpf, prev_Occ);
+  }
+  phase.next("lpf_from_ansv");
+  phase.set_estimated_bytes(RangeMinimum<int32_t>::predict_space_usage(n));
+  lpf_from_nearest_smaller_values(sa, lcp, lpf, prev_Occ, threads, memory);
+  phase.next("permute");
+  permute_to_text_order(sa, lpf, lcp, threads);
+  lpf.swap(lcp);
+  permute_to_text_order(sa, prev_Occ, lcp, threads);
+  prev_Occ.swap(lcp);
+  if (memory != nullptr) {
+    memory->lpf = allocated_bytes(sa, lcp, lpf, prev_Occ);
+  }
+
   lpf[0] = 0;
   prev_Occ[0] = -1;
   return 0;
 }
 
-int32_t lpf_array_ansv(std::vector<uint8_t> &text, std::vector<int64_t> &lpf,
-                       std::vector<int64_t> &prev_Occ, int64_t threads) {
-  std::vector<int64_t> sa(text.size());
-  std::vector<int64_t> plcp(text.size());
-  std::vector<int64_t> lcp(text.size());
-  libsais64_omp(text.data(), sa.data(), (int64_t)text.size(), 0, NULL, threads);
-  libsais64_plcp_omp(text.data(), sa.data(), plcp.data(), (int64_t)text.size(),
-                     threads);
-  libsais64_lcp_omp(plcp.data(), sa.data(), lcp.data(), (int64_t)text.size(),
-                    threads);
-  std::vector<int64_t> l(text.size());
-  std::vector<int64_t> r(text.size());
-  ansv_omp(sa, l, r, threads);
-
-  auto rmq = RangeMinimum<int64_t>(lcp, lcp.size(), threads);
-  omp_set_num_threads(threads);
+template <typename input_type>
+int32_t lpf_array_ansv(std::vector<input_type> &text, std::vector<int64_t> &lpf,
+                       std::vector<int64_t> &prev_Occ, int64_t threads,
+                       LpfMemoryUsage *memory = nullptr) {
+  int64_t n = text.size();
+  ProfilePhase phase("suffix_array", -1, threads);
+  phase.set_estimated_bytes(2 * sizeof(int64_t) * n);
+  std::vector<int64_t> sa(n);
+  std::vector<int64_t> lcp(n);
+  SuffixSorter<input_type, int64_t> sorter(text, threads);
+  sorter.suffix_array(sa.data());
+  phase.next("lcp_array");
+  sorter.plcp(sa.data(), prev_Occ.data());
+  libsais64_lcp_omp(prev_Occ.data(), sa.data(), lcp.data(), n, threads);
+  if (memory != nullptr) {
+    memory->suffix_array = allocated_bytes(sa, lcp, lpf, prev_Occ, sorter);
+  }
 
-#pragma omp parallel for default(none) shared(lpf, l, r, sa, lcp, rmq, prev_Occ)
-  for (uint64_t i = 0; i < lpf.size(); i++) {
-    int32_t l_lcp = 0, r_lcp = 0;
-    int32_t ln = l[i], rn = r[i];
-    int32_t sai = sa[i];
-    if (ln != -1) {
-      l_lcp = lcp[rmq.query(ln + 1, i)];
-    }
-    if (rn != -1) {
-      r_lcp = lcp[rmq.query(i + 1, rn)];
-    }
+  phase.next("ansv");
+  ansv_omp(sa, lpf, prev_Occ, threads);
+  if (memory != nullptr) {
+    memory->ansv = allocated_bytes(sa, lcp, lpf, prev_Occ);
+  }
+  phase.next("lpf_from_ansv");
+  phase.set_estimated_bytes(RangeMinimum<int64_t>::predict_space_usage(n));
+  lpf_from_nearest_smaller_values(sa, lcp, lpf, prev_Occ, threads, memory);
+  phase.next("permute");
+  permute_to_text_order(sa, lpf, lcp, threads);
+  lpf.swap(lcp);
+  permute_to_text_order(sa, prev_Occ, lcp, threads);
+  prev_Occ.swap(lcp);
+  if (memory != nullptr) {
+    memory->lpf = allocated_bytes(sa, lcp, lpf, prev_Occ);
+  }
 
-    if (l_lcp == 0 && r_lcp == 0) {
-      prev_Occ[sai] = -1;
-      lpf[sai] = 1;
-    } else if (l_lcp > r_lcp) {
-      prev_Occ[sai] = sa[ln];
-      lpf[sai] = l_lcp;
-    } else {
-      prev_Occ[sai] = sa[rn];
-      lpf[sai] = r_lcp;
+  lpf[0] = 0;
+  prev_Occ[0] = -1;
+  return 0;
+}
+
+// Same as above but the results are stored with 40 bits per entry. The suffix
+// array, the LCP array, the nearest smaller values and the RMQ still use 64-bit
+// integers, so the peak of this function is the same as for int64_t results.
+// The 40-bit results are only allocated after the LCP array and the RMQ have
+// been released and save memory in the later phases of the construction, which
+// keep them while the levels are built.
+template <typename input_type>
+int32_t lpf_array_ansv(std::vector<input_type> &text, Int40Vector &lpf,
+                       Int40Vector &prev_Occ, int64_t threads,
+                       LpfMemoryUsage *memory = nullptr) {
+  int64_t n = text.size();
+  ProfilePhase phase("suffix_array", -1, threads);
+  phase.set_estimated_bytes(4 * sizeof(int64_t) * n);
+  std::vector<int64_t> sa(n);
+  std::vector<int64_t> l(n);
+  std::vector<int64_t> r(n);
+  {
+    std::vector<int64_t> lcp(n);
+    SuffixSorter<input_type, int64_t> sorter(text, threads);
+    sorter.suffix_array(sa.data());
+    phase.next("lcp_array");
+    sorter.plcp(sa.data(), r.data());
+    libsais64_lcp_omp(r.data(), sa.data(), lcp.data(), n, threads);
+    if (memory != nullptr) {
+      memory->suffix_array = allocated_bytes(sa, l, r, lcp, sorter);
+    }
+    phase.next("ansv");
+    ansv_omp(sa, l, r, threads);
+    if (memory != nullptr) {
+      memory->ansv = allocated_bytes(sa, l, r, lcp);
     }
+    phase.next("lpf_from_ansv");
+    phase.set_estimated_bytes(RangeMinimum<int64_t>::predict_space_usage(n));
+    lpf_from_nearest_smaller_values(sa, lcp, l, r, threads, memory);
+  }
+  phase.next("permute");
+  phase.set_estimated_bytes(2 * 5 * n);
+  lpf.resize(n);
+  permute_to_text_order(sa, l, lpf, threads);
+  if (memory != nullptr) {
+    memory->lpf = allocated_bytes(sa, l, r, lpf);
   }
+  std::vector<int64_t>().swap(l);
+  prev_Occ.resize(n);
+  permute_to_text_order(sa, r, prev_Occ, threads);
+  if (memory != nullptr) {
+    memory->lpf = std::max<int64_t>(memory->lpf,
+                                    allocated_bytes(sa, r, lpf, prev_Occ));
+  }
+
   lpf[0] = 0;
   prev_Occ[0] = -1;
   return 0;
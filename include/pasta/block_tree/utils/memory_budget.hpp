@@ -0,0 +1,122 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include "pasta/block_tree/utils/lpf_array.hpp"
+#include "pasta/block_tree/utils/packed_int_vector.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace pasta {
+
+// Builders that make_block_tree chooses from if it is given a memory budget.
+// LPF computes the LPF array sequentially with lpf_array, LPF_PARALLEL with
+// nearest smaller values and FP uses Karp-Rabin fingerprints, which needs the
+// least memory.
+enum class ConstructionStrategy { LPF, LPF_PARALLEL, FP };
+
+// How a tree was built with a memory budget. All peaks are in bytes and do not
+// include the text.
+struct ConstructionReport {
+  ConstructionStrategy strategy = ConstructionStrategy::LPF_PARALLEL;
+  // bytes per entry of the LPF array and the previous occurrences (0 for FP)
+  int64_t lpf_entry_bytes = 0;
+  // whether pointers, offsets and counters of the levels are bit packed
+  bool packed_temporaries = false;
+  // whether the predicted peak is within the budget
+  bool fits = true;
+  int64_t predicted_peak = 0;
+  // largest number of bytes held by the construction's buffers at the same
+  // time, measured from their sizes while the tree is built
+  int64_t observed_peak = 0;
+  // Best-effort increase of the process's peak resident set size during the
+  // construction, -1 if it cannot be read. It is 0 if the process had a higher
+  // peak before and includes allocations of other threads.
+  int64_t observed_rss = -1;
+};
+
+// Upper bound for the bytes of the per-level temporaries of the extended
+// construction with s = 1. It is reached if no block is pruned while the levels
+// are built and consists of the marked bit vectors, counters, pointers and
+// offsets of all levels and the block starts of three consecutive levels. If
+// the temporaries are packed, the deepest level's values are unpacked until
+// the level is complete. For fingerprints (hash_entry_bytes > 0), the bit
+// vectors of the pairs and the fingerprint maps of the largest level are added.
+inline int64_t predict_level_memory(int64_t n, int64_t tau,
+                                    int64_t max_leaf_length, bool packed,
+                                    int64_t hash_entry_bytes = 0) {
+  int64_t padded = tau;
+  int64_t block_size = tau;
+  while (padded < n) {
+    padded *= tau;
+    block_size *= tau;
+  }
+  int64_t bytes = 0;
+  int64_t prev_size = 0;
+  int64_t last_size = 0;
+  int64_t next_size = 0;
+  for (; block_size > max_leaf_length; block_size /= tau) {
+    int64_t size = (n + block_size - 1) / block_size;
+    bytes += (size + 63) / 64 * sizeof(uint64_t);
+    if (packed) {
+      bytes += size * (PackedIntVector::bytes_for(0, 2 * size) +
+                       PackedIntVector::bytes_for(-2, size) +
+                       PackedIntVector::bytes_for(-1, block_size)) +
+               3 * sizeof(PackedIntVector);
+    } else {
+      bytes += 3 * sizeof(int64_t) * size;
+    }
+    prev_size = last_size;
+    last_size = size;
+    next_size = (n + block_size / tau - 1) / (block_size / tau);
+  }
+  bytes += sizeof(int64_t) * (prev_size + last_size + next_size);
+  if (packed) {
+    bytes += 3 * sizeof(int64_t) * last_size;
+  }
+  if (hash_entry_bytes > 0) {
+    bytes += 2 * ((last_size + 63) / 64) * sizeof(uint64_t) +
+             2 * last_size * (hash_entry_bytes + sizeof(void *));
+  }
+  return bytes;
+}
+
+// Upper bound for the peak of the LPF construction with LPF arrays of
+// entry_bytes bytes per entry. The LPF array is computed with nearest smaller
+// values if parallel is true and with lpf_array otherwise. 40-bit LPF arrays
+// (entry_bytes = 5) are computed from 64-bit suffix, LCP and nearest smaller
+// value arrays, so they have the same peak as 64-bit ones until the levels are
+// built and only make the levels cheaper.
+inline int64_t predict_lpf_construction_memory(int64_t n, int64_t tau,
+                                               int64_t max_leaf_length,
+                                               int64_t entry_bytes, bool packed,
+                                               bool parallel = true) {
+  LpfMemoryUsage lpf = parallel
+                           ? predict_lpf_array_ansv_memory(n, entry_bytes)
+                           : predict_lpf_array_memory(n, entry_bytes);
+  int64_t levels = predict_level_memory(n, tau, max_leaf_length, packed);
+  return std::max(lpf.peak(), 2 * entry_bytes * n + levels);
+}
+
+} // namespace pasta
+
+/******************************************************************************/
@@ -0,0 +1,134 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <omp.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace pasta {
+
+// Vector of signed integers that are stored with the smallest number of whole
+// bytes that can hold all values in [min, max]. Entries are byte aligned,
+// hence different entries can be written concurrently.
+class PackedIntVector {
+public:
+  class Reference {
+  public:
+    Reference(PackedIntVector &vector, uint64_t index)
+        : vector_(vector), index_(index){};
+    operator int64_t() const { return vector_.get(index_); }
+    Reference &operator=(int64_t value) {
+      vector_.set(index_, value);
+      return *this;
+    }
+    Reference &operator=(Reference const &other) {
+      vector_.set(index_, other);
+      return *this;
+    }
+    int64_t operator++(int) {
+      int64_t value = vector_.get(index_);
+      vector_.set(index_, value + 1);
+      return value;
+    }
+    int64_t operator--(int) {
+      int64_t value = vector_.get(index_);
+      vector_.set(index_, value - 1);
+      return value;
+    }
+
+  private:
+    PackedIntVector &vector_;
+    uint64_t index_;
+  };
+
+  PackedIntVector() = default;
+  PackedIntVector(uint64_t size, int64_t min, int64_t max)
+      : bytes_(bytes_for(min, max)), shift_(64 - 8 * bytes_), size_(size),
+        data_(bytes_ * size){};
+
+  // number of bytes needed to store all values in [min, max] in two's
+  // complement
+  static uint64_t bytes_for(int64_t min, int64_t max) {
+    uint64_t magnitude = std::max<uint64_t>((max > 0) ? max : 0,
+                                            (min < 0) ? ~min : 0);
+    uint64_t bits = std::bit_width(magnitude) + 1;
+    return std::max<uint64_t>(1, (bits + 7) / 8);
+  }
+
+  inline int64_t get(uint64_t index) const {
+    uint64_t value = 0;
+    std::memcpy(&value, data_.data() + bytes_ * index, bytes_);
+    // sign extension of the stored bytes
+    return static_cast<int64_t>(value << shift_) >> shift_;
+  }
+
+  inline void set(uint64_t index, int64_t value) {
+    std::memcpy(data_.data() + bytes_ * index, &value, bytes_);
+  }
+
+  int64_t operator[](uint64_t index) const { return get(index); }
+  Reference operator[](uint64_t index) { return Reference(*this, index); }
+
+  uint64_t size() const { return size_; }
+
+  uint64_t width() const { return 8 * bytes_; }
+
+  uint64_t space_usage() const { return data_.capacity() + sizeof(*this); }
+
+private:
+  static_assert(std::endian::native == std::endian::little,
+                "PackedIntVector stores the lowest bytes of each value");
+  uint64_t bytes_ = 8;
+  uint64_t shift_ = 0;
+  uint64_t size_ = 0;
+  std::vector<uint8_t> data_;
+};
+
+// Converts the temporary values of one level of the construction into the
+// vector type used to keep them until the tree is compacted. All values must
+// be in [min, max]. std::vectors are moved, PackedIntVectors are filled with
+// the calling thread's number of OpenMP threads.
+template <typename level_vector, typename value_type>
+level_vector to_level_vector(std::vector<value_type> &&values, int64_t min,
+                             int64_t max) {
+  if constexpr (std::is_same_v<level_vector, std::vector<value_type>>) {
+    return std::move(values);
+  } else {
+    int64_t size = values.size();
+    level_vector result(size, min, max);
+#pragma omp parallel for default(none) shared(values, result, size)
+    for (int64_t i = 0; i < size; i++) {
+      result.set(i, values[i]);
+    }
+    std::vector<value_type>().swap(values);
+    return result;
+  }
+}
+
+} // namespace pasta
+
+/******************************************************************************/
@@ -0,0 +1,200 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <linux/mempolicy.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+namespace pasta {
+
+// Pages that back memory allocated with allocate_placed.
+enum class PageMode {
+  // regular pages
+  SMALL,
+  // regular pages that the kernel is advised to back with transparent huge
+  // pages (madvise)
+  TRANSPARENT_HUGE,
+  // pages from the hugetlbfs pools, which fall back to TRANSPARENT_HUGE if
+  // the pool cannot hold the allocation
+  HUGETLB_2M,
+  HUGETLB_1G
+};
+
+// Placement of memory on the NUMA nodes.
+enum class NumaMode {
+  // first touch
+  LOCAL,
+  // pages round robin on all nodes
+  INTERLEAVE,
+  // one copy on each node
+  REPLICATE
+};
+
+struct PlacedMemory {
+  void *data = nullptr;
+  // mapped bytes, i.e., rounded up to the page size
+  uint64_t bytes = 0;
+  PageMode pages = PageMode::SMALL;
+};
+
+// Online NUMA nodes (only node 0 if the system does not report them).
+inline std::vector<int32_t> numa_nodes() {
+  std::vector<int32_t> nodes;
+  std::ifstream in("/sys/devices/system/node/online");
+  std::string list;
+  if (in >> list) {
+    // comma separated list of nodes and ranges of nodes, e.g., 0-3,6
+    size_t begin = 0;
+    while (begin < list.size()) {
+      size_t end = std::min(list.find(',', begin), list.size());
+      std::string range = list.substr(begin, end - begin);
+      size_t dash = range.find('-');
+      int32_t first = std::stoi(range.substr(0, dash));
+      int32_t last = (dash == std::string::npos)
+                         ? first
+                         : std::stoi(range.substr(dash + 1));
+      for (int32_t node = first; node <= last; node++) {
+        nodes.push_back(node);
+      }
+      begin = end + 1;
+    }
+  }
+  if (nodes.empty()) {
+    nodes.push_back(0);
+  }
+  return nodes;
+}
+
+// NUMA node of the CPU that the calling thread currently runs on. This is a
+// system call, threads that are pinned should call it once.
+inline int32_t current_numa_node() {
+  unsigned cpu = 0;
+  unsigned node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+    return 0;
+  }
+  return static_cast<int32_t>(node);
+}
+
+// Sets the NUMA policy of memory that has not been touched yet. Pages are
+// interleaved on all online nodes or bound to the given node. Returns 0 on
+// success and -1 otherwise.
+inline int32_t
+bind_memory(void *data, uint64_t bytes, NumaMode mode, int32_t node = 0) {
+  if (mode == NumaMode::LOCAL) {
+    return 0;
+  }
+  constexpr uint64_t max_nodes = 1024;
+  std::vector<unsigned long> mask(max_nodes / (8 * sizeof(unsigned long)), 0);
+  auto set = [&](int32_t n) {
+    if (n >= 0 && static_cast<uint64_t>(n) < max_nodes) {
+      mask[n / (8 * sizeof(unsigned long))] |=
+          1UL << (n % (8 * sizeof(unsigned long)));
+    }
+  };
+  if (mode == NumaMode::INTERLEAVE) {
+    for (int32_t n : numa_nodes()) {
+      set(n);
+    }
+  } else {
+    set(node);
+  }
+  int policy = (mode == NumaMode::INTERLEAVE) ? MPOL_INTERLEAVE : MPOL_BIND;
+  // the kernel expects the number of bits plus one
+  long result = syscall(SYS_mbind, data, bytes, policy, mask.data(),
+                        max_nodes + 1, 0);
+  return (result == 0) ? 0 : -1;
+}
+
+// Anonymous memory backed by the requested pages and placed on the NUMA nodes
+// (node is only used if the mode is REPLICATE). The policy is set before the
+// memory is touched, hence it applies to all pages. The returned memory is
+// empty if nothing could be allocated.
+inline PlacedMemory allocate_placed(uint64_t bytes,
+                                    PageMode pages,
+                                    NumaMode numa = NumaMode::LOCAL,
+                                    int32_t node = 0) {
+  PlacedMemory memory;
+  if (bytes == 0) {
+    return memory;
+  }
+  constexpr uint64_t huge_page = uint64_t{1} << 21;
+  if (pages == PageMode::HUGETLB_2M || pages == PageMode::HUGETLB_1G) {
+    int shift = (pages == PageMode::HUGETLB_2M) ? 21 : 30;
+    uint64_t page = uint64_t{1} << shift;
+    uint64_t size = (bytes + page - 1) / page * page;
+    void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                          (shift << MAP_HUGE_SHIFT),
+                      -1, 0);
+    if (data != MAP_FAILED) {
+      memory = PlacedMemory{data, size, pages};
+    } else {
+      pages = PageMode::TRANSPARENT_HUGE;
+    }
+  }
+  if (memory.data == nullptr) {
+    uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    uint64_t alignment = (pages == PageMode::SMALL) ? page : huge_page;
+    uint64_t size = (bytes + alignment - 1) / alignment * alignment;
+    // over-allocate to align the memory to huge pages, otherwise the first
+    // and last partial huge page cannot be backed by a huge page
+    uint64_t padded = size + alignment - page;
+    void *data = mmap(nullptr, padded, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+      return memory;
+    }
+    auto begin = reinterpret_cast<uintptr_t>(data);
+    uintptr_t aligned = (begin + alignment - 1) / alignment * alignment;
+    if (aligned > begin) {
+      munmap(data, aligned - begin);
+    }
+    if (begin + padded > aligned + size) {
+      munmap(reinterpret_cast<void *>(aligned + size),
+             begin + padded - aligned - size);
+    }
+    memory = PlacedMemory{reinterpret_cast<void *>(aligned), size, pages};
+    if (pages == PageMode::TRANSPARENT_HUGE) {
+      madvise(memory.data, memory.bytes, MADV_HUGEPAGE);
+    }
+  }
+  bind_memory(memory.data, memory.bytes, numa, node);
+  return memory;
+}
+
+inline void free_placed(PlacedMemory &memory) {
+  if (memory.data != nullptr) {
+    munmap(memory.data, memory.bytes);
+  }
+  memory = PlacedMemory{};
+}
+
+} // namespace pasta
+
+/******************************************************************************/
@@ -0,0 +1,66 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <omp.h>
+#include <vector>
+
+namespace pasta {
+
+// Replaces every entry of values with the sum of all entries before it and
+// returns the sum of all entries. Each thread first sums up a contiguous part
+// of the vector, then the parts are shifted by the sums of all previous parts.
+template <typename T>
+T exclusive_prefix_sum(std::vector<T> &values, int32_t threads) {
+  int64_t n = values.size();
+  threads = std::max<int32_t>(1, std::min<int64_t>(threads, n / 4096 + 1));
+  std::vector<T> part_sums(threads + 1, 0);
+  int64_t part_size = (n + threads - 1) / threads;
+  omp_set_num_threads(threads);
+#pragma omp parallel for default(none) shared(values, part_sums, part_size, n, threads)
+  for (int32_t t = 0; t < threads; t++) {
+    int64_t end = std::min(n, (t + 1) * part_size);
+    T sum = 0;
+    for (int64_t i = t * part_size; i < end; i++) {
+      T value = values[i];
+      values[i] = sum;
+      sum += value;
+    }
+    part_sums[t + 1] = sum;
+  }
+  for (int32_t t = 1; t <= threads; t++) {
+    part_sums[t] += part_sums[t - 1];
+  }
+#pragma omp parallel for default(none) shared(values, part_sums, part_size, n, threads)
+  for (int32_t t = 1; t < threads; t++) {
+    int64_t end = std::min(n, (t + 1) * part_size);
+    for (int64_t i = t * part_size; i < end; i++) {
+      values[i] += part_sums[t];
+    }
+  }
+  return part_sums[threads];
+}
+
+} // namespace pasta
+
+/******************************************************************************/
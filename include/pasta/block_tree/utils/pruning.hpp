@@ -0,0 +1,279 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include "pasta/block_tree/utils/prefix_sum.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <omp.h>
+#include <pasta/bit_vector/bit_vector.hpp>
+#include <utility>
+#include <vector>
+
+namespace pasta {
+
+// Bytes of the per-level temporaries that are kept until the marked tree is
+// pruned, i.e., the marked bit vectors and the counters, pointers and offsets.
+template <typename level_vector>
+int64_t
+pruning_space_usage(std::vector<level_vector> const &counter,
+                    std::vector<level_vector> const &pointer,
+                    std::vector<level_vector> const &offset,
+                    std::vector<pasta::BitVector *> const &marked_tree) {
+  int64_t bytes = 0;
+  for (auto const *lvl : {&counter, &pointer, &offset}) {
+    for (auto const &values : *lvl) {
+      if constexpr (requires { values.space_usage(); }) {
+        bytes += values.space_usage();
+      } else {
+        bytes += sizeof(values[0]) * values.capacity();
+      }
+    }
+  }
+  for (auto const *bv : marked_tree) {
+    bytes += (bv->size() + 63) / 64 * sizeof(uint64_t);
+  }
+  return bytes;
+}
+
+// Calls f(level, owner, rank) for each level of the marked tree from the top
+// down. owner[j] is the top level block that contains block j of the level
+// and rank[j] is the number of marked blocks in front of block j (rank has one
+// additional entry for the total number of marked blocks).
+template <typename size_type, typename Function>
+void for_each_pruning_level(std::vector<pasta::BitVector *> &marked_tree,
+                            size_type tau, int32_t threads, Function f) {
+  size_type levels = marked_tree.size();
+  std::vector<size_type> owner(marked_tree[0]->size());
+  for (size_type j = 0; j < static_cast<size_type>(owner.size()); j++) {
+    owner[j] = j;
+  }
+  std::vector<size_type> rank;
+  std::vector<size_type> next_owner;
+  for (size_type i = 0; i < levels; i++) {
+    auto &bv = *marked_tree[i];
+    size_type size = bv.size();
+    rank.resize(size + 1);
+    omp_set_num_threads(threads);
+#pragma omp parallel for default(none) shared(bv, rank, size)
+    for (size_type j = 0; j < size; j++) {
+      rank[j] = bv[j] == 1;
+    }
+    rank[size] = 0;
+    exclusive_prefix_sum(rank, threads);
+    f(i, owner, rank);
+    if (i + 1 == levels) {
+      break;
+    }
+    size_type next_size = marked_tree[i + 1]->size();
+    next_owner.resize(next_size);
+    omp_set_num_threads(threads);
+#pragma omp parallel for default(none)                                         \
+    shared(bv, rank, owner, next_owner, size, next_size, tau)
+    for (size_type j = 0; j < size; j++) {
+      if (bv[j] == 1) {
+        size_type end = std::min(next_size, (rank[j] + 1) * tau);
+        for (size_type c = rank[j] * tau; c < end; c++) {
+          next_owner[c] = owner[j];
+        }
+      }
+    }
+    owner.swap(next_owner);
+  }
+}
+
+// Extended pruning of the marked tree: a marked block is unmarked if none of
+// its children stays marked, no block points to it and it has a former
+// occurrence. Blocks are processed in inverse postorder, i.e., the right-most
+// top level block first and children before their parent. The counters of
+// the block that a pruned block points to are incremented, its children are
+// marked as pruned and their counters are decremented.
+//
+// A subtree can only change counters of blocks between its pointer targets
+// and itself. Hence, the top level blocks are split into segments that no
+// pointer leaves to the left, which are processed independently in parallel
+// with an explicit stack. The result is the same as the sequential recursion.
+// The temporaries of a level can be stored in any vector type whose entries
+// can be written concurrently, e.g., std::vector or PackedIntVector.
+template <typename size_type, typename level_vector>
+int32_t prune_extended(std::vector<level_vector> &counter,
+                       std::vector<level_vector> &pointer,
+                       std::vector<level_vector> &offset,
+                       std::vector<pasta::BitVector *> &marked_tree,
+                       size_type tau, size_type pruned,
+                       size_type no_former_occ, int32_t threads) {
+  size_type levels = marked_tree.size();
+  size_type top_size = (levels == 0) ? 0 : marked_tree[0]->size();
+  if (top_size == 0) {
+    return 0;
+  }
+  threads = std::max<int32_t>(1, threads);
+
+  // left-most top level block whose counters are changed by each subtree
+  std::vector<size_type> reach(top_size);
+  for (size_type j = 0; j < top_size; j++) {
+    reach[j] = j;
+  }
+  for_each_pruning_level(
+      marked_tree, tau, threads,
+      [&](size_type i, std::vector<size_type> const &owner,
+          std::vector<size_type> const &) {
+        auto const &ptr = pointer[i];
+        size_type size = ptr.size();
+        omp_set_num_threads(threads);
+#pragma omp parallel for default(none) shared(ptr, owner, reach, size)
+        for (size_type j = 0; j < size; j++) {
+          if (ptr[j] < 0) {
+            continue;
+          }
+          std::atomic_ref<size_type> r(reach[owner[j]]);
+          size_type target = owner[ptr[j]];
+          size_type current = r.load(std::memory_order_relaxed);
+          while (target < current &&
+                 !r.compare_exchange_weak(current, target,
+                                          std::memory_order_relaxed)) {
+          }
+        }
+      });
+
+  // segments [begin, end) of top level blocks, ordered from right to left
+  std::vector<std::pair<size_type, size_type>> segments;
+  size_type end = top_size;
+  size_type min_reach = top_size;
+  for (size_type j = top_size - 1; j >= 0; j--) {
+    min_reach = std::min(min_reach, reach[j]);
+    if (min_reach == j) {
+      segments.emplace_back(j, end);
+      end = j;
+    }
+  }
+  std::vector<size_type>().swap(reach);
+
+  // number of marked blocks of each level in front of each segment's end
+  size_type segment_count = segments.size();
+  std::vector<std::vector<size_type>> start_rank(
+      segment_count, std::vector<size_type>(levels));
+  for_each_pruning_level(
+      marked_tree, tau, threads,
+      [&](size_type i, std::vector<size_type> const &owner,
+          std::vector<size_type> const &rank) {
+        for (size_type s = 0; s < segment_count; s++) {
+          auto first_behind = std::lower_bound(owner.begin(), owner.end(),
+                                               segments[s].second);
+          start_rank[s][i] = rank[first_behind - owner.begin()];
+        }
+      });
+
+  struct Frame {
+    size_type level;
+    size_type block;
+    size_type rank;
+    size_type child;
+    bool marked_children;
+  };
+  // marks are cleared afterwards since segments may share words of the bit
+  // vectors, a pruned block's mark is not read again
+  std::vector<std::vector<std::pair<size_type, size_type>>> unmarked(
+      segment_count);
+  omp_set_num_threads(threads);
+#pragma omp parallel for default(none) schedule(dynamic, 1)                    \
+    shared(counter, pointer, offset, marked_tree, tau, pruned, no_former_occ,  \
+               levels, segments, segment_count, start_rank, unmarked)
+  for (size_type s = 0; s < segment_count; s++) {
+    std::vector<size_type> &remaining = start_rank[s];
+    std::vector<Frame> stack;
+    // whether block j of level i stays marked, if it has no marked children
+    auto stays = [&](size_type i, size_type j, bool marked_children) {
+      return marked_children || counter[i][j] > 0 ||
+             pointer[i][j] == no_former_occ;
+    };
+    auto visit = [&](size_type i, size_type j) {
+      // fully padded children don't exist and can be ignored
+      if (i >= levels || j >= static_cast<size_type>(marked_tree[i]->size())) {
+        return std::make_pair(false, false);
+      }
+      if ((*marked_tree[i])[j] == 1) {
+        stack.push_back(Frame{i, j, --remaining[i], tau - 1, false});
+        return std::make_pair(true, false);
+      }
+      return std::make_pair(false, stays(i, j, false));
+    };
+    for (size_type top = segments[s].second - 1; top >= segments[s].first;
+         top--) {
+      visit(0, top);
+      while (!stack.empty()) {
+        Frame &frame = stack.back();
+        if (frame.child >= 0) {
+          size_type child = frame.rank * tau + frame.child--;
+          bool marked_children = frame.marked_children;
+          auto [pushed, result] = visit(frame.level + 1, child);
+          if (!pushed) {
+            stack.back().marked_children = marked_children || result;
+          }
+          continue;
+        }
+        size_type i = frame.level;
+        size_type j = frame.block;
+        size_type rank_blk = frame.rank;
+        bool marked_children = frame.marked_children;
+        stack.pop_back();
+        if (!marked_children && counter[i][j] == 0 &&
+            pointer[i][j] != no_former_occ) {
+          unmarked[s].emplace_back(i, j);
+          counter[i][pointer[i][j]]++;
+          if (offset[i][j] > 0) {
+            counter[i][pointer[i][j] + 1]++;
+          }
+          if (i + 1 < static_cast<size_type>(counter.size())) {
+            // remove all of its children by decrementing counters and marking
+            // them as pruned
+            for (size_type k = tau - 1; k >= 0; k--) {
+              size_type child = rank_blk * tau + k;
+              if (child < static_cast<size_type>(counter[i + 1].size())) {
+                size_type ptr_child = pointer[i + 1][child];
+                counter[i + 1][ptr_child]--;
+                if (offset[i + 1][child] > 0) {
+                  counter[i + 1][ptr_child + 1]--;
+                }
+                pointer[i + 1][child] = pruned;
+              }
+            }
+          }
+        }
+        if (!stack.empty()) {
+          stack.back().marked_children |= stays(i, j, marked_children);
+        }
+      }
+    }
+  }
+  for (auto const &segment : unmarked) {
+    for (auto [i, j] : segment) {
+      (*marked_tree[i])[j] = 0;
+    }
+  }
+  return 0;
+}
+
+} // namespace pasta
+
+/******************************************************************************/
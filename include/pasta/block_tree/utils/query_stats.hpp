@@ -0,0 +1,296 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace pasta {
+
+enum class QueryType { ACCESS, RANK, SELECT };
+
+// Counters of all queries of one type.
+struct QueryTypeStats {
+  int64_t queries = 0;
+  // number of back pointers followed on each level
+  std::vector<int64_t> hops_per_level;
+  // hop_histogram[h] is the number of queries that followed h back pointers
+  std::vector<int64_t> hop_histogram;
+  // scan_histogram[k] is the number of queries that scanned between 2^k and
+  // 2^(k+1) - 1 leaf symbols (and scan_histogram[0] also counts 0 symbols)
+  std::vector<int64_t> scan_histogram;
+  // search_histogram[k] is the same for the steps of the block searches of
+  // select
+  std::vector<int64_t> search_histogram;
+};
+
+// One block visited by a query.
+struct QueryTraceStep {
+  int64_t level;
+  int64_t block;
+  // offset in the block, select records the occurrences still to be found
+  int64_t offset;
+  // whether a back pointer of the block was followed
+  bool hop;
+};
+
+// The path of a traced query through the tree.
+struct QueryTrace {
+  QueryType type;
+  int64_t nanoseconds;
+  std::vector<QueryTraceStep> path;
+};
+
+// Query counters of the calling thread. The queries only update them if
+// PASTA_BLOCK_TREE_QUERY_STATS is defined, otherwise the instrumentation in
+// the queries expands to nothing. If trace_ is set, the queries are timed and
+// the paths of the slowest 0.1% (at least one) are reported.
+class QueryStats {
+public:
+  std::array<QueryTypeStats, 3> types_;
+  bool trace_ = false;
+  int64_t traced_queries_ = 0;
+  // min-heap of the candidates for the slowest traced queries, see slowest()
+  std::vector<QueryTrace> candidates_;
+
+  // The candidates are the slowest max(MIN_CANDIDATES, traced_queries_ / 100)
+  // traced queries at any time. They contain the slowest 0.1% of all traced
+  // queries unless more than 1000 * MIN_CANDIDATES queries are traced and one
+  // of the slowest is among the first 10%.
+  static constexpr int64_t MIN_CANDIDATES = 1024;
+
+  static QueryStats &local() {
+    thread_local QueryStats stats;
+    return stats;
+  }
+
+  QueryTypeStats &operator[](QueryType type) {
+    return types_[static_cast<size_t>(type)];
+  }
+
+  void reset() {
+    types_ = {};
+    traced_queries_ = 0;
+    candidates_.clear();
+  }
+
+  // Adds the counters and traces of another thread.
+  void merge(QueryStats const &other) {
+    for (size_t t = 0; t < types_.size(); t++) {
+      auto &mine = types_[t];
+      auto const &theirs = other.types_[t];
+      mine.queries += theirs.queries;
+      add(mine.hops_per_level, theirs.hops_per_level);
+      add(mine.hop_histogram, theirs.hop_histogram);
+      add(mine.scan_histogram, theirs.scan_histogram);
+      add(mine.search_histogram, theirs.search_histogram);
+    }
+    traced_queries_ += other.traced_queries_;
+    for (auto const &trace : other.candidates_) {
+      keep_if_slow(QueryTrace(trace));
+    }
+  }
+
+  // Keeps the trace if it is among the candidates for the slowest queries.
+  // traced_queries_ must already count it.
+  void keep_if_slow(QueryTrace &&trace) {
+    size_t capacity = std::max(MIN_CANDIDATES, traced_queries_ / 100);
+    if (candidates_.size() < capacity) {
+      candidates_.push_back(std::move(trace));
+      std::push_heap(candidates_.begin(), candidates_.end(), faster);
+    } else if (candidates_.front().nanoseconds < trace.nanoseconds) {
+      std::pop_heap(candidates_.begin(), candidates_.end(), faster);
+      candidates_.back() = std::move(trace);
+      std::push_heap(candidates_.begin(), candidates_.end(), faster);
+    }
+  }
+
+  // The slowest 0.1% (at least one) of the traced queries, slowest first.
+  std::vector<QueryTrace> slowest() const {
+    int64_t queries = std::max<int64_t>(1, traced_queries_ / 1000);
+    size_t count = std::min<size_t>(queries, candidates_.size());
+    std::vector<QueryTrace> slowest(count);
+    std::partial_sort_copy(candidates_.begin(), candidates_.end(),
+                           slowest.begin(), slowest.end(), faster);
+    return slowest;
+  }
+
+  void write_json(std::ostream &out) const {
+    static constexpr char const *names[] = {"access", "rank", "select"};
+    auto list = [&](std::vector<int64_t> const &values) {
+      out << "[";
+      for (size_t i = 0; i < values.size(); i++) {
+        out << (i > 0 ? "," : "") << values[i];
+      }
+      out << "]";
+    };
+    out << "{";
+    for (size_t t = 0; t < types_.size(); t++) {
+      auto const &type = types_[t];
+      out << "\"" << names[t] << "\":{\"queries\":" << type.queries
+          << ",\"hops_per_level\":";
+      list(type.hops_per_level);
+      out << ",\"hop_histogram\":";
+      list(type.hop_histogram);
+      out << ",\"scan_histogram\":";
+      list(type.scan_histogram);
+      out << ",\"search_histogram\":";
+      list(type.search_histogram);
+      out << "},";
+    }
+    auto const slowest = this->slowest();
+    out << "\"slowest\":[";
+    for (size_t i = 0; i < slowest.size(); i++) {
+      out << (i > 0 ? "," : "") << "{\"type\":\""
+          << names[static_cast<size_t>(slowest[i].type)]
+          << "\",\"nanoseconds\":" << slowest[i].nanoseconds << ",\"path\":[";
+      auto const &path = slowest[i].path;
+      for (size_t j = 0; j < path.size(); j++) {
+        out << (j > 0 ? "," : "") << "[" << path[j].level << ","
+            << path[j].block << "," << path[j].offset << ","
+            << (path[j].hop ? 1 : 0) << "]";
+      }
+      out << "]}";
+    }
+    out << "]}";
+  }
+
+  std::string to_json() const {
+    std::ostringstream out;
+    write_json(out);
+    return out.str();
+  }
+
+  static void count(std::vector<int64_t> &histogram, size_t bucket) {
+    if (histogram.size() <= bucket) {
+      histogram.resize(bucket + 1, 0);
+    }
+    histogram[bucket]++;
+  }
+
+private:
+  static bool faster(QueryTrace const &a, QueryTrace const &b) {
+    return a.nanoseconds > b.nanoseconds;
+  }
+
+  static void add(std::vector<int64_t> &to,
+                  std::vector<int64_t> const &from) {
+    if (to.size() < from.size()) {
+      to.resize(from.size(), 0);
+    }
+    for (size_t i = 0; i < from.size(); i++) {
+      to[i] += from[i];
+    }
+  }
+};
+
+// Collects the counters of a single query and adds them to the thread's
+// QueryStats when it goes out of scope.
+class QueryProbe {
+public:
+  explicit QueryProbe(QueryType type)
+      : stats_(QueryStats::local()), type_(type) {
+    if (stats_.trace_) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~QueryProbe() {
+    auto &type = stats_[type_];
+    type.queries++;
+    QueryStats::count(type.hop_histogram, hops_);
+    QueryStats::count(type.scan_histogram, log_bucket(scanned_));
+    if (type_ == QueryType::SELECT) {
+      QueryStats::count(type.search_histogram, log_bucket(search_steps_));
+    }
+    if (stats_.trace_) {
+      std::chrono::nanoseconds time =
+          std::chrono::steady_clock::now() - start_;
+      stats_.traced_queries_++;
+      stats_.keep_if_slow(QueryTrace{type_, time.count(), std::move(path_)});
+    }
+  }
+
+  void visit(int64_t level, int64_t block, int64_t offset) {
+    if (stats_.trace_) {
+      path_.push_back(QueryTraceStep{level, block, offset, false});
+    }
+  }
+
+  void hop(int64_t level) {
+    auto &per_level = stats_[type_].hops_per_level;
+    if (per_level.size() <= static_cast<uint64_t>(level)) {
+      per_level.resize(level + 1, 0);
+    }
+    per_level[level]++;
+    hops_++;
+    if (stats_.trace_ && !path_.empty()) {
+      path_.back().hop = true;
+    }
+  }
+
+  void scan(uint64_t symbols) { scanned_ += symbols; }
+
+  void search_step() { search_steps_++; }
+
+private:
+  static size_t log_bucket(uint64_t value) {
+    return (value == 0) ? 0 : std::bit_width(value) - 1;
+  }
+
+  QueryStats &stats_;
+  QueryType type_;
+  uint64_t hops_ = 0;
+  uint64_t scanned_ = 0;
+  uint64_t search_steps_ = 0;
+  std::vector<QueryTraceStep> path_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace pasta
+
+// Instrumentation of the queries. It expands to nothing unless
+// PASTA_BLOCK_TREE_QUERY_STATS is defined.
+#ifdef PASTA_BLOCK_TREE_QUERY_STATS
+#define PASTA_BLOCK_TREE_QUERY(type)                                           \
+  ::pasta::QueryProbe pasta_query_probe_(::pasta::QueryType::type)
+#define PASTA_BLOCK_TREE_VISIT(level, block, offset)                           \
+  pasta_query_probe_.visit(level, block, offset)
+#define PASTA_BLOCK_TREE_HOP(level) pasta_query_probe_.hop(level)
+#define PASTA_BLOCK_TREE_SCAN(symbols) pasta_query_probe_.scan(symbols)
+#define PASTA_BLOCK_TREE_SEARCH_STEP() pasta_query_probe_.search_step()
+#else
+#define PASTA_BLOCK_TREE_QUERY(type)
+#define PASTA_BLOCK_TREE_VISIT(level, block, offset)
+#define PASTA_BLOCK_TREE_HOP(level)
+#define PASTA_BLOCK_TREE_SCAN(symbols)
+#define PASTA_BLOCK_TREE_SEARCH_STEP()
+#endif
+
+/******************************************************************************/
@@ -20,118 +20,110 @@
 
 #pragma once
 
-#include <math.h>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
 #include <omp.h>
 #include <vector>
 
 namespace pasta {
 
+// Range minimum queries on an array using a sparse table over the minima of
+// blocks of BSIZE entries. The table contains one row of m = n / BSIZE
+// entries for each power of two up to m, i.e., it uses m log m words instead
+// of n log m words. Queries look up at most two table entries and scan the
+// at most two partially covered blocks.
 template <typename size_type> class RangeMinimum {
 public:
+  static constexpr size_type BSIZE = 16;
   std::vector<size_type> const &array;
   size_type m;
   size_type n;
-  size_type **table;
   size_type depth;
-  size_type BSIZE = 16;
   size_type threads = 1;
+  // row k contains the position of the minimum of blocks [i, i + 2^k)
+  std::vector<size_type> table;
 
   explicit RangeMinimum(std::vector<size_type> const &_array, size_type _n,
                         size_type _threads)
       : array(_array), n(_n), threads(_threads) {
-    m = 1 + (array.size() - 1) / BSIZE;
+    m = (n == 0) ? 0 : 1 + (n - 1) / BSIZE;
     precompute();
   };
   void precompute() {
-    depth = log2(m) + 1;
-    table = new size_type *[depth];
+    depth = (m == 0) ? 0 : std::bit_width(static_cast<uint64_t>(m));
+    table.resize(static_cast<uint64_t>(depth) * m);
     omp_set_num_threads(threads);
-#pragma omp parallel for default(none)
-    for (size_type i = 0; i < depth; i++) {
-      table[i] = new size_type[n];
-    }
-
 #pragma omp parallel for default(none)
     for (size_type i = 0; i < m; i++) {
       size_type start = i * BSIZE;
-      size_type end = std::min(start + BSIZE, n);
-      size_type k = i * BSIZE;
-      for (size_type j = start + 1; j < end; j++)
-        if (array[j] < array[k])
-          k = j;
-      table[0][i] = k;
+      table[i] = min_position(start, std::min(start + BSIZE, n));
     }
 
-    size_type dist = 1;
     for (size_type j = 1; j < depth; j++) {
-
-#pragma omp parallel for default(none) shared(dist, j)
-      for (size_type i = 0; i < m - dist; i++) {
-        if (array[table[j - 1][i]] <= array[table[j - 1][i + dist]])
-          table[j][i] = table[j - 1][i];
-        else
-          table[j][i] = table[j - 1][i + dist];
+      size_type dist = size_type(1) << (j - 1);
+      size_type const *prev = table.data() + (j - 1) * m;
+      size_type *row = table.data() + j * m;
+#pragma omp parallel for default(none) shared(dist, prev, row)
+      for (size_type i = 0; i < m; i++) {
+        if (i + dist < m && array[prev[i + dist]] < array[prev[i]]) {
+          row[i] = prev[i + dist];
+        } else {
+          row[i] = prev[i];
+        }
       }
-
-#pragma omp parallel for default(none) shared(dist, j)
-      for (size_type i = m - dist; i < m; i++) {
-        table[j][i] = table[j - 1][i];
-      }
-
-      dist *= 2;
     }
   };
-  size_type query(size_type i, size_type j) {
-    // same block
-    if (j - i < BSIZE) {
-      size_type r = i;
-      for (size_type k = i + 1; k <= j; k++)
-        if (array[k] < array[r])
-          r = k;
-      return r;
-    }
+  // Position of a minimum in array[i..j] (both inclusive).
+  size_type query(size_type i, size_type j) const {
     size_type block_i = i / BSIZE;
     size_type block_j = j / BSIZE;
-    size_type min = i;
-    for (size_type k = i + 1; k < (block_i + 1) * BSIZE; k++) {
-      if (array[k] < array[min])
-        min = k;
+    if (block_j <= block_i + 1) {
+      return min_position(i, j + 1);
     }
-    for (size_type k = j; k >= (block_j)*BSIZE; k--) {
-      if (array[k] < array[min])
-        min = k;
+    size_type min = min_position(i, (block_i + 1) * BSIZE);
+    size_type right = min_position(block_j * BSIZE, j + 1);
+    if (array[right] < array[min]) {
+      min = right;
     }
-    if (block_j == block_i + 1)
-      return min;
-    size_type outOfBlockMin;
-    // not same or adjacent blocks
-    if (block_j > block_i + 1) {
-      block_i++;
-      block_j--;
-      if (block_j == block_i)
-        outOfBlockMin = table[0][block_i];
-      else if (block_j == block_i + 1)
-        outOfBlockMin = table[1][block_i];
-      else {
-        size_type k = log2(block_j - block_i);
-        size_type p = 1 << k; // 2^k
-        outOfBlockMin =
-            array[table[k][block_i]] <= array[table[k][block_j + 1 - p]]
-                ? table[k][block_i]
-                : table[k][block_j + 1 - p];
-      }
+    // blocks (block_i, block_j) are covered completely
+    block_i++;
+    size_type k = std::bit_width(static_cast<uint64_t>(block_j - block_i)) - 1;
+    size_type const *row = table.data() + k * m;
+    size_type left_half = row[block_i];
+    size_type right_half = row[block_j - (size_type(1) << k)];
+    if (array[left_half] < array[min]) {
+      min = left_half;
+    }
+    if (array[right_half] < array[min]) {
+      min = right_half;
     }
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
-    return array[min] < array[outOfBlockMin] ? min : outOfBlockMin;
-#pragma GCC diagnostic pop
+    return min;
   }
-  ~RangeMinimum() {
-    for (size_type i = 0; i < depth; i++) {
-      delete[] table[i];
+  // Number of bytes used by the lookup table.
+  int64_t space_usage() const { return sizeof(size_type) * table.capacity(); }
+  // Number of bytes used by the lookup table for an array of length n.
+  static int64_t predict_space_usage(int64_t n) {
+    int64_t blocks = (n == 0) ? 0 : 1 + (n - 1) / BSIZE;
+    return sizeof(size_type) * blocks *
+           std::bit_width(static_cast<uint64_t>(blocks));
+  }
+
+private:
+  // Position of the first minimum in array[begin..end). The minimum itself is
+  // computed with a vectorizable reduction.
+  size_type min_position(size_type begin, size_type end) const {
+    size_type const *data = array.data();
+    size_type value = data[begin];
+#pragma omp simd reduction(min : value)
+    for (size_type k = begin + 1; k < end; k++) {
+      value = std::min(value, data[k]);
     }
-    delete[] table;
-  };
+    while (data[begin] != value) {
+      begin++;
+    }
+    return begin;
+  }
 };
 
 } // namespace pasta
@@ -0,0 +1,68 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+
+namespace pasta {
+
+// Iterator over a text that only provides operator[], e.g., a packed text.
+// Characters are returned by value.
+template <typename text_type, typename char_type> class TextIterator {
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = char_type;
+  using difference_type = int64_t;
+  using pointer = char_type const *;
+  using reference = char_type;
+
+  TextIterator() = default;
+  TextIterator(text_type const *text, int64_t index)
+      : text_(text), index_(index){};
+  char_type operator*() const { return (*text_)[index_]; }
+  TextIterator &operator++() {
+    ++index_;
+    return *this;
+  }
+  TextIterator operator++(int) {
+    TextIterator old = *this;
+    ++index_;
+    return old;
+  }
+  TextIterator operator+(int64_t offset) const {
+    return TextIterator(text_, index_ + offset);
+  }
+  bool operator==(TextIterator const &other) const {
+    return index_ == other.index_;
+  }
+  bool operator!=(TextIterator const &other) const {
+    return index_ != other.index_;
+  }
+
+private:
+  text_type const *text_ = nullptr;
+  int64_t index_ = 0;
+};
+
+} // namespace pasta
+
+/******************************************************************************/
@@ -0,0 +1,167 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <pasta/bit_vector/bit_vector.hpp>
+#include <pasta/bit_vector/support/optimized_for.hpp>
+#include <pasta/bit_vector/support/rank_select.hpp>
+#include <utility>
+#include <vector>
+
+namespace pasta {
+
+// Level of a wavelet matrix stored as a plain bit vector with pasta's rank and
+// select support. rank1(index) and rank0(index) count in [0, index), select1
+// and select0 take 1-based ranks.
+class PlainWaveletLevel {
+public:
+  explicit PlainWaveletLevel(pasta::BitVector &&bits)
+      : bits_(std::move(bits)), rs_(bits_){};
+  PlainWaveletLevel(PlainWaveletLevel const &) = delete;
+  PlainWaveletLevel &operator=(PlainWaveletLevel const &) = delete;
+
+  bool access(uint64_t index) const { return bits_[index]; }
+  uint64_t rank1(uint64_t index) const { return rs_.rank1(index); }
+  uint64_t rank0(uint64_t index) const { return rs_.rank0(index); }
+  uint64_t select1(uint64_t rank) const { return rs_.select1(rank); }
+  uint64_t select0(uint64_t rank) const { return rs_.select0(rank); }
+
+  int64_t space_usage() const {
+    return (bits_.size() + 63) / 64 * sizeof(uint64_t) + rs_.space_usage();
+  }
+
+private:
+  pasta::BitVector bits_;
+  pasta::RankSelect<pasta::OptimizedFor::DONT_CARE> rs_;
+};
+
+// Wavelet matrix of a sequence of integers with bits bits each. Level l holds
+// bit bits - 1 - l of the integers, ordered stably by their bits on the levels
+// above, i.e., integers with a 0 first. A wavelet matrix of zero bits stores
+// only the length of a sequence of zeros. The levels are PlainWaveletLevels by
+// default, any type with the same queries can be used instead, e.g., a block
+// tree of the bits for repetitive sequences.
+template <typename Level = PlainWaveletLevel> class WaveletMatrix {
+public:
+  WaveletMatrix() = default;
+
+  WaveletMatrix(std::vector<uint64_t> values, uint64_t bits)
+      : WaveletMatrix(std::move(values), bits, [](pasta::BitVector &&level) {
+          return std::make_unique<Level>(std::move(level));
+        }) {}
+
+  // make_level(level) returns the given bits of a level as a
+  // std::unique_ptr<Level>.
+  template <typename MakeLevel>
+  WaveletMatrix(std::vector<uint64_t> values, uint64_t bits,
+                MakeLevel make_level)
+      : size_(values.size()), bits_(bits) {
+    std::vector<uint64_t> next(size_);
+    for (uint64_t l = 0; l < bits_; l++) {
+      uint64_t shift = bits_ - 1 - l;
+      pasta::BitVector bv(size_, false);
+      uint64_t zeros = 0;
+      for (uint64_t i = 0; i < size_; i++) {
+        bool bit = (values[i] >> shift) & 1ULL;
+        bv[i] = bit;
+        zeros += !bit;
+      }
+      uint64_t z = 0;
+      uint64_t o = zeros;
+      for (uint64_t i = 0; i < size_; i++) {
+        next[((values[i] >> shift) & 1ULL) ? o++ : z++] = values[i];
+      }
+      values.swap(next);
+      zeros_.push_back(zeros);
+      levels_.push_back(make_level(std::move(bv)));
+    }
+  }
+
+  uint64_t access(uint64_t index) const {
+    uint64_t value = 0;
+    for (uint64_t l = 0; l < bits_; l++) {
+      bool bit = levels_[l]->access(index);
+      index = bit ? zeros_[l] + levels_[l]->rank1(index)
+                  : levels_[l]->rank0(index);
+      value = (value << 1) | bit;
+    }
+    return value;
+  }
+
+  // Number of occurrences of value in [0, index).
+  uint64_t rank(uint64_t value, uint64_t index) const {
+    uint64_t begin = 0;
+    for (uint64_t l = 0; l < bits_; l++) {
+      if ((value >> (bits_ - 1 - l)) & 1ULL) {
+        begin = zeros_[l] + levels_[l]->rank1(begin);
+        index = zeros_[l] + levels_[l]->rank1(index);
+      } else {
+        begin = levels_[l]->rank0(begin);
+        index = levels_[l]->rank0(index);
+      }
+    }
+    return index - begin;
+  }
+
+  // Position of the j-th occurrence of value, which must exist.
+  uint64_t select(uint64_t value, uint64_t j) const {
+    std::array<uint64_t, 65> begin = {0};
+    for (uint64_t l = 0; l < bits_; l++) {
+      begin[l + 1] = ((value >> (bits_ - 1 - l)) & 1ULL)
+                         ? zeros_[l] + levels_[l]->rank1(begin[l])
+                         : levels_[l]->rank0(begin[l]);
+    }
+    uint64_t position = begin[bits_] + j - 1;
+    for (uint64_t l = bits_; l-- > 0;) {
+      position = ((value >> (bits_ - 1 - l)) & 1ULL)
+                     ? levels_[l]->select1(position - zeros_[l] + 1)
+                     : levels_[l]->select0(position + 1);
+    }
+    return position;
+  }
+
+  uint64_t size() const { return size_; }
+
+  int64_t space_usage() const {
+    int64_t bytes = sizeof(*this) + sizeof(uint64_t) * zeros_.capacity();
+    for (auto const &level : levels_) {
+      if constexpr (requires { level->print_space_usage(); }) {
+        bytes += level->print_space_usage();
+      } else {
+        bytes += level->space_usage();
+      }
+    }
+    return bytes;
+  }
+
+private:
+  uint64_t size_ = 0;
+  uint64_t bits_ = 0;
+  std::vector<uint64_t> zeros_;
+  std::vector<std::unique_ptr<Level>> levels_;
+};
+
+} // namespace pasta
+
+/******************************************************************************/
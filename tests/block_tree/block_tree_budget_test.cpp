@@ -0,0 +1,178 @@
+/*******************************************************************************
+ * This file is part of pasta::block_tree
+ *
+ * Copyright (C) 2022 Daniel Meyer
+ * Copyright (C) 2023 Florian Kurpicz <florian@kurpicz.org>
+ *
+ * pasta::block_tree is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pasta::block_tree is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pasta::block_tree.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include <random>
+#include <variant>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <pasta/block_tree/construction/block_tree_dispatch.hpp>
+
+class BlockTreeBudgetTest : public ::testing::Test {
+
+protected:
+
+  std::vector<uint8_t> text;
+
+  void SetUp() override {
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<uint8_t> dist(0, 15);
+
+    size_t const string_length = 100000;
+    text.resize(string_length);
+    for (size_t i = 0; i < text.size(); ++i) {
+      text[i] = dist(gen);
+    }
+  }
+
+  void check_access(pasta::AnyBlockTree<uint8_t> const& any) {
+    std::visit([&](auto const& bt) {
+      for (size_t i = 0; i < text.size(); ++i) {
+        ASSERT_EQ(bt->access(i), text[i]);
+      }
+    }, any);
+  }
+};
+
+TEST_F(BlockTreeBudgetTest, unlimited_budget) {
+  pasta::ConstructionReport report;
+  auto bt = pasta::make_block_tree<uint8_t>(text, 2, 1, false, 4, 0, &report);
+  ASSERT_EQ(report.strategy, pasta::ConstructionStrategy::LPF_PARALLEL);
+  ASSERT_EQ(report.lpf_entry_bytes, 4);
+  ASSERT_FALSE(report.packed_temporaries);
+  ASSERT_TRUE(report.fits);
+  ASSERT_GT(report.observed_peak, 0);
+  ASSERT_LE(report.observed_peak, report.predicted_peak);
+  check_access(bt);
+}
+
+TEST_F(BlockTreeBudgetTest, limited_budget) {
+  pasta::ConstructionReport fastest;
+  pasta::make_block_tree<uint8_t>(text, 2, 1, false, 4, 0, &fastest);
+
+  pasta::ConstructionReport report;
+  int64_t const budget = fastest.predicted_peak - 1;
+  auto bt =
+      pasta::make_block_tree<uint8_t>(text, 2, 1, false, 4, budget, &report);
+  ASSERT_TRUE(report.fits);
+  ASSERT_LE(report.predicted_peak, budget);
+  ASSERT_GT(report.observed_peak, 0);
+  ASSERT_LE(report.observed_peak, report.predicted_peak);
+  check_access(bt);
+
+  bt = pasta::make_block_tree<uint8_t>(text, 2, 1, false, 4, 1, &report);
+  ASSERT_FALSE(report.fits);
+  ASSERT_TRUE(report.packed_temporaries);
+  ASSERT_GT(report.observed_peak, 0);
+  ASSERT_LE(report.observed_peak, report.predicted_peak);
+  check_access(bt);
+}
+
+TEST_F(BlockTreeBudgetTest, sequential_construction) {
+  pasta::ConstructionReport report;
+  auto bt = pasta::make_block_tree<uint8_t>(text, 2, 1, false, 1, 0, &report);
+  ASSERT_EQ(report.strategy, pasta::ConstructionStrategy::LPF);
+  ASSERT_FALSE(report.packed_temporaries);
+  ASSERT_GT(report.observed_peak, 0);
+  ASSERT_LE(report.observed_peak, report.predicted_peak);
+  check_access(bt);
+
+  // the sequential LPF array needs at most as much memory as the parallel one
+  auto parallel =
+      pasta::plan_block_tree_construction<uint8_t>(text.size(), 2, 1, 0, 4);
+  ASSERT_EQ(parallel.strategy, pasta::ConstructionStrategy::LPF_PARALLEL);
+  ASSERT_LE(report.predicted_peak, parallel.predicted_peak);
+  int64_t const budget = report.predicted_peak;
+  bt = pasta::make_block_tree<uint8_t>(text, 2, 1, false, 1, budget, &report);
+  ASSERT_EQ(report.strategy, pasta::ConstructionStrategy::LPF);
+  ASSERT_TRUE(report.fits);
+  check_access(bt);
+
+  // and is only planned with one thread
+  auto plan = pasta::plan_block_tree_construction<uint8_t>(text.size(), 2, 1,
+                                                           budget, 4);
+  ASSERT_NE(plan.strategy, pasta::ConstructionStrategy::LPF);
+}
+
+TEST_F(BlockTreeBudgetTest, factories_pack_temporaries) {
+  // the peaks are measured from the buffers, so packing has to reduce them
+  auto* plain = pasta::make_block_tree_lpf_parallel<uint8_t, int32_t>(
+      text, 2, 1, false, 4);
+  auto* packed = pasta::make_block_tree_lpf_parallel<uint8_t, int32_t>(
+      text, 2, 1, false, 4, 1);
+  ASSERT_LT(packed->level_memory_, plain->level_memory_);
+  for (size_t i = 0; i < text.size(); ++i) {
+    ASSERT_EQ(packed->access(i), text[i]);
+  }
+  delete plain;
+  delete packed;
+
+  auto* fp_plain = pasta::make_block_tree_fp<uint8_t, int32_t>(text, 2, 1);
+  auto* fp_packed = pasta::make_block_tree_fp<uint8_t, int32_t>(
+      text, 2, 1, pasta::FingerprintMode::VERIFY, 1);
+  ASSERT_FALSE(fp_plain->packed_temporaries_);
+  ASSERT_TRUE(fp_packed->packed_temporaries_);
+  ASSERT_LT(fp_packed->peak_memory(), fp_plain->peak_memory());
+  for (size_t i = 0; i < text.size(); ++i) {
+    ASSERT_EQ(fp_packed->access(i), text[i]);
+  }
+  delete fp_plain;
+  delete fp_packed;
+}
+
+// A text of characters that are computed from their positions, the first
+// 2^32 characters are 0 and the others 1.
+struct LargeText {
+  size_t size() const { return size_t{5} << 30; }
+  uint8_t operator[](size_t i) const { return i >> 32; }
+};
+
+TEST_F(BlockTreeBudgetTest, large_texts) {
+  // the FP construction is planned for texts of 4 GiB and more
+  int64_t const n = int64_t{5} << 30;
+  auto plan = pasta::plan_block_tree_construction<uint8_t>(n, 2, 16, 1);
+  ASSERT_EQ(plan.strategy, pasta::ConstructionStrategy::FP);
+  ASSERT_TRUE(plan.packed_temporaries);
+  ASSERT_FALSE(plan.fits);
+  plan = pasta::plan_block_tree_construction<uint8_t>(n, 2, 16);
+  ASSERT_EQ(plan.lpf_entry_bytes, 5);
+  // whose LPF arrays are computed with 64-bit temporaries
+  ASSERT_GE(plan.predicted_peak,
+            pasta::predict_lpf_array_ansv_memory(n, 8).peak());
+
+  // which compares substrings beyond 2^32 correctly
+  LargeText large;
+  uint64_t const high = (uint64_t{1} << 32) + 5;
+  pasta::MersenneHash<uint8_t, LargeText> low_hash(large, 0, 5, 4);
+  pasta::MersenneHash<uint8_t, LargeText> high_hash(large, 0, high, 4);
+  ASSERT_EQ(high_hash.start_, high);
+  ASSERT_FALSE(low_hash == high_hash);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+/******************************************************************************/
@@ -19,11 +19,20 @@
  *
  ******************************************************************************/
 
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
 #include <random>
+#include <sstream>
 #include <vector>
 
 #include <gtest/gtest.h>
 
+#include <pasta/block_tree/block_tree_view.hpp>
+#include <pasta/block_tree/construction/block_tree_bits.hpp>
+#include <pasta/block_tree/construction/block_tree_dna.hpp>
 #include <pasta/block_tree/construction/block_tree_fp.hpp>
 #include <pasta/block_tree/utils/lpf_array.hpp>
 
@@ -95,6 +104,338 @@ TEST_F(BlockTreeFPTest, select) {
   }
 }
 
+TEST_F(BlockTreeFPTest, simple_pruning_cut_levels) {
+  // a unary text has back blocks on every level, a text without repeats on
+  // none, both cut the top level
+  std::vector<uint8_t> unary(967, 'a');
+  std::vector<uint8_t> no_repeats(251);
+  for (size_t i = 0; i < no_repeats.size(); ++i) {
+    no_repeats[i] = i;
+  }
+  for (auto const* t : {&unary, &no_repeats}) {
+    for (int32_t tau : {2, 3, 4}) {
+      for (int32_t leaf : {1, 4, 5}) {
+        for (bool cut : {true, false}) {
+          pasta::BlockTreeFP<uint8_t, int32_t> simple_bt(*t, tau, leaf, 1, 256,
+                                                         cut, false);
+          simple_bt.add_rank_support();
+          for (size_t i = 0; i < t->size(); ++i) {
+            ASSERT_EQ(simple_bt.access(i), (*t)[i]);
+          }
+          ASSERT_EQ(simple_bt.rank((*t)[0], t->size() - 1),
+                    (t == &unary) ? t->size() : 1);
+        }
+      }
+    }
+  }
+}
+
+// Trusts fingerprints modulo 7, so that they collide.
+class CollidingBlockTreeFP : public pasta::BlockTreeFP<uint8_t, int32_t> {
+public:
+  CollidingBlockTreeFP(std::vector<uint8_t> const& text,
+                       pasta::FingerprintMode mode)
+      : pasta::BlockTreeFP<uint8_t, int32_t>(text, 2, 1, 1, 256, true, true,
+                                             mode, false, 7) {}
+};
+
+TEST_F(BlockTreeFPTest, trusted_fingerprints) {
+  for (auto mode : {pasta::FingerprintMode::TRUST,
+                    pasta::FingerprintMode::TRUST_DOUBLE}) {
+    auto* trusted_bt =
+        pasta::make_block_tree_fp<uint8_t, int32_t>(text, 2, 1, mode);
+    int64_t checked = 0;
+    ASSERT_EQ(trusted_bt->verify_pointers(text, checked), 0);
+    ASSERT_EQ(checked, trusted_bt->fingerprint_stats_.checked_pointers);
+    for (size_t i = 0; i < text.size(); ++i) {
+      ASSERT_EQ(trusted_bt->access(i), text[i]);
+    }
+    delete trusted_bt;
+  }
+
+  // fingerprints modulo 7 collide, the tree is rebuilt once with verification
+  // and only the rebuilt tree is accounted for
+  pasta::BlockTreeFP<uint8_t, int32_t> verified_bt(text, 2, 1, 1, 256, true,
+                                                   true);
+  for (auto mode : {pasta::FingerprintMode::TRUST,
+                    pasta::FingerprintMode::TRUST_DOUBLE}) {
+    CollidingBlockTreeFP colliding_bt(text, mode);
+    ASSERT_GT(colliding_bt.fingerprint_stats_.collisions, 0);
+    ASSERT_EQ(colliding_bt.fingerprint_stats_.rebuilds, 1);
+    ASSERT_EQ(colliding_bt.fingerprint_mode_, pasta::FingerprintMode::VERIFY);
+    ASSERT_EQ(colliding_bt.level_memory_, verified_bt.level_memory_);
+    ASSERT_EQ(colliding_bt.const_size, verified_bt.const_size);
+    ASSERT_EQ(colliding_bt.print_space_usage(),
+              verified_bt.print_space_usage());
+    colliding_bt.add_rank_support();
+    int64_t checked = 0;
+    ASSERT_EQ(colliding_bt.verify_pointers(text, checked), 0);
+    std::array<size_t, 256> hist = {0};
+    for (size_t i = 0; i < text.size(); ++i) {
+      ++hist[text[i]];
+      ASSERT_EQ(colliding_bt.access(i), text[i]);
+      ASSERT_EQ(colliding_bt.rank(text[i], i), hist[text[i]]);
+      ASSERT_EQ(colliding_bt.select(text[i], hist[text[i]]), i);
+    }
+  }
+}
+
+TEST_F(BlockTreeFPTest, packed_temporaries) {
+  auto* unpacked_bt = pasta::make_block_tree_fp<uint8_t, int32_t>(text, 2, 1);
+  auto* packed_bt = new pasta::BlockTreeFP<uint8_t, int32_t>(
+      text, 2, 1, 1, 256, true, true, pasta::FingerprintMode::VERIFY, true);
+  ASSERT_EQ(packed_bt->print_space_usage(), unpacked_bt->print_space_usage());
+  for (size_t i = 0; i < text.size(); ++i) {
+    ASSERT_EQ(packed_bt->access(i), text[i]);
+  }
+  delete unpacked_bt;
+  delete packed_bt;
+}
+
+TEST_F(BlockTreeFPTest, stats) {
+  auto stats = bt->stats();
+  ASSERT_EQ(stats.levels.size(), bt->block_tree_types_.size());
+  ASSERT_GE(stats.total_bytes, bt->print_space_usage());
+  int64_t back_blocks = 0;
+  for (size_t i = 0; i < stats.levels.size(); ++i) {
+    auto const& lvl = stats.levels[i];
+    ASSERT_EQ(lvl.blocks, bt->block_tree_types_[i]->size());
+    ASSERT_EQ(lvl.back_blocks, bt->block_tree_pointers_[i]->size());
+    ASSERT_EQ(lvl.marked + lvl.back_blocks, lvl.blocks);
+    ASSERT_GT(lvl.c_rank_bytes, 0);
+    int64_t histogram = 0;
+    for (auto count : lvl.distance_histogram) {
+      histogram += count;
+    }
+    ASSERT_EQ(histogram, lvl.back_blocks);
+    // sources lie in front of their back blocks
+    ASSERT_LE(lvl.distance_histogram.size(), std::bit_width(text.size()));
+    back_blocks += lvl.back_blocks;
+  }
+  int64_t histogram = 0;
+  for (auto count : stats.distance_histogram) {
+    histogram += count;
+  }
+  ASSERT_EQ(histogram, back_blocks);
+  ASSERT_EQ(stats.leaves, bt->amount_of_leaves);
+}
+
+TEST_F(BlockTreeFPTest, view) {
+  std::string path = ::testing::TempDir() + "block_tree_fp_test.view";
+  {
+    std::ofstream out(path, std::ios::binary);
+    ASSERT_EQ(pasta::write_block_tree_view(*gappy_alphabet_bt, out), 0);
+  }
+  pasta::BlockTreeView<uint8_t> view;
+  ASSERT_EQ(view.open(path), 0);
+  ASSERT_TRUE(view.rank_support());
+  std::array<size_t, 256> hist = {0};
+  for (size_t i = 0; i < gappy_alphabet_text.size() - 1; ++i) {
+    uint8_t c = gappy_alphabet_text[i];
+    ++hist[c];
+    ASSERT_EQ(view.access(i), c);
+    ASSERT_EQ(view.rank(c, i), hist[c]);
+    ASSERT_EQ(view.select(c, hist[c]), i);
+  }
+  ASSERT_EQ(view.rank(1, text.size() / 2), 0);
+  view.close();
+  std::remove(path.c_str());
+
+  // a buffer that is not a view is rejected
+  std::vector<uint64_t> buffer(64, 0);
+  ASSERT_EQ(view.attach(buffer.data(), buffer.size() * 8), -1);
+
+  // so are truncated views and views with corrupt directories or sections
+  std::stringstream stream;
+  ASSERT_EQ(pasta::write_block_tree_view(*gappy_alphabet_bt, stream), 0);
+  std::string bytes = stream.str();
+  std::vector<uint64_t> valid(bytes.size() / 8);
+  std::memcpy(valid.data(), bytes.data(), valid.size() * 8);
+  ASSERT_EQ(view.attach(valid.data(), valid.size() * 8), 0);
+  ASSERT_EQ(view.access(0), gappy_alphabet_text[0]);
+  auto rejects = [&](auto &&corrupt) {
+    std::vector<uint64_t> words = valid;
+    corrupt(words);
+    return view.attach(words.data(), words.size() * 8) == -1;
+  };
+  // the header holds the file size at word 7, the directory starts at word 8
+  // with the block sizes, the maps and the bits of the first level
+  uint64_t const bits = valid[8 + 2] / 8;
+  uint64_t const pointers = valid[8 + 3] / 8;
+  ASSERT_TRUE(rejects([](auto &words) {
+    words[7] -= 64;
+    words.resize(words.size() - 8);
+  }));
+  ASSERT_TRUE(rejects([](auto &words) { words[8] = uint64_t{1} << 62; }));
+  ASSERT_TRUE(rejects([](auto &words) { words[8 + 3] = words.size() * 8; }));
+  ASSERT_TRUE(rejects([&](auto &words) { words[bits + 1] = 1ULL << 60; }));
+  ASSERT_TRUE(rejects([&](auto &words) { words[pointers] = 1ULL << 60; }));
+  ASSERT_TRUE(rejects([&](auto &words) { words[pointers + 1] = 65; }));
+}
+
+TEST_F(BlockTreeFPTest, view_placement) {
+  std::string path = ::testing::TempDir() + "block_tree_fp_test.placed";
+  {
+    std::ofstream out(path, std::ios::binary);
+    ASSERT_EQ(pasta::write_block_tree_view(*bt, out), 0);
+  }
+  // huge page pools are usually empty, hence the loads may fall back
+  for (auto pages : {pasta::PageMode::SMALL,
+                     pasta::PageMode::TRANSPARENT_HUGE,
+                     pasta::PageMode::HUGETLB_2M}) {
+    for (auto numa : {pasta::NumaMode::INTERLEAVE,
+                      pasta::NumaMode::REPLICATE}) {
+      pasta::BlockTreeViewReplicas<uint8_t> replicas;
+      ASSERT_EQ(replicas.load(path, pages, numa), 0);
+      ASSERT_EQ(replicas.size(), (numa == pasta::NumaMode::REPLICATE)
+                                     ? pasta::numa_nodes().size()
+                                     : 1);
+      auto const& view = replicas.local();
+      std::array<size_t, 256> hist = {0};
+      for (size_t i = 0; i < text.size() - 1; ++i) {
+        ++hist[text[i]];
+        ASSERT_EQ(view.access(i), text[i]);
+        ASSERT_EQ(view.rank(text[i], i), hist[text[i]]);
+      }
+    }
+  }
+  std::remove(path.c_str());
+
+  pasta::BlockTreeView<uint8_t> view;
+  ASSERT_EQ(view.load(path), -1);
+}
+
+TEST_F(BlockTreeFPTest, wide_alphabet) {
+  std::vector<uint16_t> wide_text(text.size());
+  for (size_t i = 0; i < text.size(); ++i) {
+    // symbols that differ by multiples of sigma
+    wide_text[i] = text[i % 5000] * 256 + text[(i / 5000) % 3];
+  }
+  for (auto mode : {pasta::FingerprintMode::VERIFY,
+                    pasta::FingerprintMode::TRUST_DOUBLE}) {
+    auto* wide_bt =
+        pasta::make_block_tree_fp<uint16_t, int32_t>(wide_text, 2, 4, mode);
+    wide_bt->add_rank_support();
+    std::map<uint16_t, int64_t> hist;
+    for (size_t i = 0; i < wide_text.size(); ++i) {
+      uint16_t c = wide_text[i];
+      ++hist[c];
+      ASSERT_EQ(wide_bt->access(i), c);
+      ASSERT_EQ(wide_bt->rank(c, i), hist[c]);
+      ASSERT_EQ(wide_bt->select(c, hist[c]), i);
+    }
+    delete wide_bt;
+  }
+}
+
+TEST_F(BlockTreeFPTest, dna) {
+  std::vector<uint8_t> dna_text(text.size());
+  for (size_t i = 0; i < text.size(); ++i) {
+    dna_text[i] = "ACGT"[text[i % 7000] % 4];
+  }
+  // runs of N and a single other character
+  std::fill(dna_text.begin(), dna_text.begin() + 100, 'N');
+  std::fill(dna_text.begin() + 5000, dna_text.begin() + 5300, 'N');
+  dna_text[60000] = 'R';
+  std::fill(dna_text.end() - 17, dna_text.end(), 'N');
+
+  pasta::PackedDnaText packed(dna_text);
+  ASSERT_EQ(packed.size(), dna_text.size());
+  ASSERT_EQ(packed.runs().runs().size(), 4);
+  ASSERT_LT(packed.space_usage(), dna_text.size() / 3);
+  for (auto mode : {pasta::FingerprintMode::VERIFY,
+                    pasta::FingerprintMode::TRUST_DOUBLE}) {
+    auto* dna_bt = pasta::make_block_tree_dna<int32_t>(packed, 2, 8, mode);
+    dna_bt->add_rank_support();
+    ASSERT_EQ(dna_bt->tree().compressed_leaves_.width(), 2);
+    std::array<size_t, 256> hist = {0};
+    for (size_t i = 0; i < dna_text.size(); ++i) {
+      uint8_t c = dna_text[i];
+      ++hist[c];
+      ASSERT_EQ(packed.at(i), c);
+      ASSERT_EQ(dna_bt->access(i), c);
+      ASSERT_EQ(dna_bt->rank(c, i), hist[c]);
+      ASSERT_EQ(dna_bt->select(c, hist[c]), i);
+    }
+    for (uint8_t c : {'A', 'C', 'G', 'T', 'N', 'R'}) {
+      ASSERT_EQ(dna_bt->rank(c, dna_text.size() - 1), hist[c]);
+    }
+    delete dna_bt;
+  }
+
+  // many short runs of two characters, which are searched by their counts
+  for (size_t i = 0; i < dna_text.size(); i += 37) {
+    std::fill_n(dna_text.begin() + i, 1 + i % 3, (i % 2 == 0) ? 'N' : 'R');
+  }
+  pasta::PackedDnaText many_runs(dna_text);
+  ASSERT_GT(many_runs.runs().runs().size(), dna_text.size() / 40);
+  auto* runs_bt = pasta::make_block_tree_dna<int32_t>(many_runs, 2, 8);
+  runs_bt->add_rank_support();
+  std::array<size_t, 256> hist = {0};
+  for (size_t i = 0; i < dna_text.size(); ++i) {
+    uint8_t c = dna_text[i];
+    ++hist[c];
+    ASSERT_EQ(runs_bt->rank(c, i), hist[c]);
+    ASSERT_EQ(runs_bt->select(c, hist[c]), i);
+  }
+  ASSERT_EQ(many_runs.runs().select('N', hist['N'] + 1), -1);
+  ASSERT_EQ(many_runs.runs().select('G', 1), -1);
+  ASSERT_EQ(many_runs.runs().rank('G', dna_text.size()), 0);
+  delete runs_bt;
+}
+
+TEST_F(BlockTreeFPTest, bits) {
+  // versions of a bitmap with a few changed bits each
+  pasta::BitVector bits(text.size(), false);
+  for (size_t i = 0; i < bits.size(); ++i) {
+    bits[i] = (text[i % 9000] < 5) != (text[i] == 0 && text[i / 2] == 0);
+  }
+  for (auto mode : {pasta::FingerprintMode::VERIFY,
+                    pasta::FingerprintMode::TRUST_DOUBLE}) {
+    auto* bits_bt = pasta::make_block_tree_bits<int32_t>(bits, 2, 16, mode);
+    auto& tree = bits_bt->tree();
+    ASSERT_EQ(tree.compressed_leaves_.width(), 1);
+    // there is only a rank directory for the ones
+    ASSERT_TRUE(tree.c_ranks_[tree.chars_index_[0]].empty());
+    ASSERT_EQ(bits_bt->size(), bits.size());
+    size_t ones = 0;
+    for (size_t i = 0; i < bits.size(); ++i) {
+      ASSERT_EQ(bits_bt->rank1(i), ones);
+      ASSERT_EQ(bits_bt->rank0(i), i - ones);
+      ASSERT_EQ(bits_bt->access(i), bits[i]);
+      if (bits[i]) {
+        ++ones;
+        ASSERT_EQ(bits_bt->select1(ones), i);
+      } else {
+        ASSERT_EQ(bits_bt->select0(i + 1 - ones), i);
+      }
+    }
+    ASSERT_EQ(bits_bt->rank1(bits.size()), ones);
+    // only the ones have rank directories
+    auto stats = tree.stats();
+    ASSERT_EQ(stats.levels.size(), tree.block_tree_types_.size());
+    for (size_t i = 0; i < stats.levels.size(); ++i) {
+      ASSERT_EQ(stats.levels[i].c_rank_bytes,
+                sdsl::size_in_bytes(tree.c_ranks_[tree.chars_index_[1]][i]));
+    }
+    delete bits_bt;
+  }
+
+  // all zeros
+  pasta::BitVector zeros(1000, false);
+  pasta::BlockTreeBits<int32_t> zeros_bt(zeros, 2, 16);
+  ASSERT_EQ(zeros_bt.rank1(1000), 0);
+  ASSERT_EQ(zeros_bt.select0(500), 499);
+  ASSERT_EQ(zeros_bt.select1(1), zeros.size());
+  ASSERT_EQ(zeros_bt.tree().stats().levels.size(),
+            zeros_bt.tree().block_tree_types_.size());
+  // characters that do not occur are rejected and not added to the alphabet
+  auto& zeros_tree = zeros_bt.tree();
+  ASSERT_EQ(zeros_tree.add_rank_support(std::vector<uint8_t>{0, 1}), -1);
+  ASSERT_FALSE(zeros_tree.chars_index_.contains(1));
+  ASSERT_EQ(zeros_tree.chars_index_.size(), zeros_tree.chars_.size());
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -24,6 +24,7 @@
 
 #include <gtest/gtest.h>
 
+#include <pasta/block_tree/construction/block_tree_dispatch.hpp>
 #include <pasta/block_tree/construction/block_tree_lpf.hpp>
 #include <pasta/block_tree/utils/lpf_array.hpp>
 
@@ -94,6 +95,109 @@ TEST_F(BlockTreeLPFParallelTest, select) {
   }
 }
 
+TEST_F(BlockTreeLPFParallelTest, packed_lpf_array) {
+  std::vector<int64_t> lpf(text.size());
+  std::vector<int64_t> prev_occ(text.size());
+  pasta::Int40Vector packed_lpf;
+  pasta::Int40Vector packed_prev_occ;
+  pasta::LpfMemoryUsage memory;
+  pasta::lpf_array_ansv(text, lpf, prev_occ, 4);
+  pasta::lpf_array_ansv(text, packed_lpf, packed_prev_occ, 4, &memory);
+  ASSERT_EQ(packed_lpf.size(), text.size());
+  for (size_t i = 0; i < text.size(); ++i) {
+    ASSERT_EQ(packed_lpf[i], lpf[i]);
+    ASSERT_EQ(packed_prev_occ[i], prev_occ[i]);
+  }
+  ASSERT_GT(memory.peak(), 0);
+  // the measured phases stay within the prediction and the 64-bit temporaries
+  // of the RMQ phase, not the 40-bit results, determine the peak
+  auto predicted = pasta::predict_lpf_array_ansv_memory(text.size(), 5);
+  ASSERT_LE(memory.suffix_array, predicted.suffix_array);
+  ASSERT_LE(memory.ansv, predicted.ansv);
+  ASSERT_LE(memory.rmq, predicted.rmq);
+  ASSERT_LE(memory.lpf, predicted.lpf);
+  ASSERT_EQ(memory.peak(), memory.rmq);
+
+  auto* packed_bt =
+      pasta::make_block_tree_lpf_parallel_packed<uint8_t>(text, 2, 1, true, 4);
+  for (size_t i = 0; i < text.size(); ++i) {
+    ASSERT_EQ(packed_bt->access(i), text[i]);
+  }
+  // 40-bit block starts result in the same levels
+  auto* wide_bt =
+      pasta::make_block_tree_lpf_parallel<uint8_t, int64_t>(text, 2, 1, true, 4);
+  // and the LPF arrays are computed with the same 64-bit temporaries
+  ASSERT_EQ(packed_bt->lpf_memory_.peak(), wide_bt->lpf_memory_.peak());
+  ASSERT_EQ(packed_bt->block_tree_types_.size(),
+            wide_bt->block_tree_types_.size());
+  for (size_t i = 0; i < wide_bt->block_tree_types_.size(); ++i) {
+    ASSERT_EQ(packed_bt->block_tree_types_[i]->size(),
+              wide_bt->block_tree_types_[i]->size());
+    auto const& pointers = *wide_bt->block_tree_pointers_[i];
+    auto const& offsets = *wide_bt->block_tree_offsets_[i];
+    ASSERT_EQ(packed_bt->block_tree_pointers_[i]->size(), pointers.size());
+    for (size_t j = 0; j < pointers.size(); ++j) {
+      ASSERT_EQ((*packed_bt->block_tree_pointers_[i])[j], pointers[j]);
+      ASSERT_EQ((*packed_bt->block_tree_offsets_[i])[j], offsets[j]);
+    }
+  }
+  delete wide_bt;
+  delete packed_bt;
+}
+
+TEST_F(BlockTreeLPFParallelTest, dispatch) {
+  auto tree = pasta::make_block_tree(text, 2, 1, true, 4);
+  // the text fits 32-bit positions
+  ASSERT_EQ(tree.index(), 0);
+  std::visit(
+      [&](auto& bt) {
+        bt->add_rank_support_omp(4);
+        std::array<size_t, 256> hist = {0};
+        for (size_t i = 0; i < text.size() - 1; ++i) {
+          ++hist[text[i]];
+          ASSERT_EQ(bt->access(i), text[i]);
+          ASSERT_EQ(bt->rank(text[i], i), hist[text[i]]);
+        }
+      },
+      tree);
+}
+
+TEST_F(BlockTreeLPFParallelTest, profiler) {
+  pasta::BuildProfiler profiler;
+  // a peak above everything the construction allocates, which profiling must
+  // not reset
+  {
+    std::vector<uint8_t> large(64 << 20, 1);
+    ASSERT_EQ(large[large.size() / 2], 1);
+  }
+  [[maybe_unused]] int64_t peak = pasta::peak_rss();
+  {
+    pasta::ProfilingScope scope(profiler);
+    delete pasta::make_block_tree_lpf_parallel<uint8_t, int32_t>(text, 2, 1,
+                                                                 true, 4);
+  }
+  std::string json = profiler.to_json();
+  ASSERT_EQ(json.rfind("{\"phases\":[", 0), 0);
+#ifdef PASTA_BLOCK_TREE_PROFILE
+  ASSERT_EQ(profiler.phases_.front().name, "suffix_array");
+  ASSERT_EQ(profiler.phases_.back().name, "compress_leaves");
+  int64_t levels = 0;
+  for (auto const& phase : profiler.phases_) {
+    ASSERT_GE(phase.seconds, 0);
+    ASSERT_EQ(phase.threads, 4);
+    ASSERT_GE(phase.estimated_bytes, 0);
+    if (peak >= 0) {
+      ASSERT_EQ(phase.peak_rss_increase, 0);
+    }
+    levels += phase.name == "level";
+  }
+  ASSERT_GT(levels, 0);
+  ASSERT_GE(pasta::peak_rss(), peak);
+#else
+  ASSERT_TRUE(profiler.phases_.empty());
+#endif
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
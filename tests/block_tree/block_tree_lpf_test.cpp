@@ -19,12 +19,18 @@
  *
  ******************************************************************************/
 
+#include <bit>
+#include <cstring>
+#include <map>
 #include <random>
+#include <sstream>
+#include <type_traits>
 #include <vector>
 
 #include <gtest/gtest.h>
 
 #include <pasta/block_tree/construction/block_tree_lpf.hpp>
+#include <pasta/block_tree/construction/block_tree_partitioned.hpp>
 #include <pasta/block_tree/utils/lpf_array.hpp>
 
 class BlockTreeLPFTest : public ::testing::Test {
@@ -94,6 +100,233 @@ TEST_F(BlockTreeLPFTest, select) {
   }
 }
 
+TEST_F(BlockTreeLPFTest, serialize) {
+  std::stringstream stream;
+  ASSERT_EQ(bt->serialize(stream), 0);
+  std::string bytes = stream.str();
+  pasta::BlockTree<uint8_t, int32_t> loaded;
+  ASSERT_EQ(loaded.load(stream, 4), 0);
+  ASSERT_EQ(loaded.print_space_usage(), bt->print_space_usage());
+  std::array<size_t, 256> hist = {0};
+  for (size_t i = 0; i < text.size() - 1; ++i) {
+    ++hist[text[i]];
+    ASSERT_EQ(loaded.access(i), text[i]);
+    ASSERT_EQ(loaded.rank(text[i], i), hist[text[i]]);
+    ASSERT_EQ(loaded.select(text[i], hist[text[i]]), i);
+  }
+
+  // truncated streams and trees of other types are rejected
+  std::stringstream truncated(bytes.substr(0, bytes.size() / 2));
+  ASSERT_EQ(loaded.load(truncated), -1);
+  ASSERT_TRUE(loaded.block_tree_types_.empty());
+  ASSERT_TRUE(loaded.chars_.empty());
+  ASSERT_TRUE(loaded.top_level_c_ranks_.empty());
+  ASSERT_TRUE(loaded.c_ranks_.empty());
+
+  // lengths larger than the stream are rejected before they are allocated
+  size_t const header = 2 * sizeof(uint64_t) + 3 * sizeof(uint32_t) +
+                        5 * sizeof(int32_t) + 2 * sizeof(bool);
+  for (uint64_t length : {uint64_t{1} << 61, uint64_t{1} << 20}) {
+    std::string corrupt = bytes;
+    std::memcpy(corrupt.data() + header - sizeof(uint64_t), &length,
+                sizeof(length));
+    std::stringstream corrupt_stream(corrupt);
+    ASSERT_EQ(loaded.load(corrupt_stream), -1);
+    ASSERT_TRUE(loaded.block_tree_types_.empty());
+    ASSERT_TRUE(loaded.chars_.empty());
+  }
+  std::stringstream other_type(bytes);
+  pasta::BlockTree<uint8_t, int64_t> wide;
+  ASSERT_EQ(wide.load(other_type), -1);
+}
+
+TEST_F(BlockTreeLPFTest, move) {
+  using Tree = pasta::BlockTree<uint8_t, int32_t>;
+  static_assert(!std::is_copy_constructible_v<Tree>);
+  static_assert(!std::is_copy_assignable_v<Tree>);
+  static_assert(std::is_nothrow_move_constructible_v<Tree>);
+
+  auto* built = pasta::make_block_tree_lpf<uint8_t, int32_t>(text, 2, 1, true);
+  built->add_rank_support();
+  int64_t space = built->print_space_usage();
+  Tree moved(std::move(*built));
+  ASSERT_TRUE(built->block_tree_types_.empty());
+  delete built;
+  Tree assigned;
+  assigned = std::move(moved);
+  ASSERT_TRUE(moved.block_tree_types_.empty());
+  ASSERT_EQ(assigned.print_space_usage(), space);
+  std::array<size_t, 256> hist = {0};
+  for (size_t i = 0; i < text.size() - 1; ++i) {
+    ++hist[text[i]];
+    ASSERT_EQ(assigned.access(i), text[i]);
+    ASSERT_EQ(assigned.rank(text[i], i), hist[text[i]]);
+  }
+}
+
+TEST_F(BlockTreeLPFTest, no_back_blocks) {
+  // random text has no back blocks with these parameters, all levels but the
+  // last one are cut
+  auto* flat_bt = pasta::make_block_tree_lpf<uint8_t, int32_t>(text, 4, 4,
+                                                               false);
+  flat_bt->add_rank_support();
+  ASSERT_EQ(flat_bt->block_tree_types_.size(), 1);
+  std::array<size_t, 256> hist = {0};
+  for (size_t i = 0; i < text.size() - 1; ++i) {
+    ++hist[text[i]];
+    ASSERT_EQ(flat_bt->access(i), text[i]);
+    ASSERT_EQ(flat_bt->rank(text[i], i), hist[text[i]]);
+    ASSERT_EQ(flat_bt->select(text[i], hist[text[i]]), i);
+  }
+  delete flat_bt;
+}
+
+TEST_F(BlockTreeLPFTest, wide_alphabet) {
+  // repetitive text over sparse 32-bit symbols
+  std::mt19937 gen(7);
+  std::uniform_int_distribution<uint32_t> dist(0, 999);
+  std::vector<uint32_t> base(5000);
+  for (auto& c : base) {
+    c = dist(gen) * 4000037 + 11;
+  }
+  std::vector<uint32_t> wide_text;
+  while (wide_text.size() < text.size()) {
+    base[gen() % base.size()] = dist(gen) * 4000037 + 11;
+    wide_text.insert(wide_text.end(), base.begin(), base.end());
+  }
+  auto* sequential_bt =
+      pasta::make_block_tree_lpf<uint32_t, int32_t>(wide_text, 2, 4, true);
+  auto* parallel_bt = pasta::make_block_tree_lpf_parallel<uint32_t, int64_t>(
+      wide_text, 4, 8, true, 4);
+  sequential_bt->add_rank_support();
+  parallel_bt->add_rank_support_omp(4);
+  std::map<uint32_t, int64_t> hist;
+  for (size_t i = 0; i < wide_text.size(); ++i) {
+    uint32_t c = wide_text[i];
+    ++hist[c];
+    ASSERT_EQ(sequential_bt->access(i), c);
+    ASSERT_EQ(parallel_bt->access(i), c);
+    ASSERT_EQ(sequential_bt->rank(c, i), hist[c]);
+    ASSERT_EQ(parallel_bt->rank(c, i), hist[c]);
+    ASSERT_EQ(sequential_bt->select(c, hist[c]), i);
+    ASSERT_EQ(parallel_bt->select(c, hist[c]), i);
+  }
+  // codes of the leaves only need as many bits as there are symbols
+  ASSERT_LE(sequential_bt->compressed_leaves_.width(), 10);
+  delete sequential_bt;
+  delete parallel_bt;
+}
+
+TEST_F(BlockTreeLPFTest, partitioned_alphabet) {
+  // repetitive text over many 32-bit symbols with skewed frequencies
+  std::mt19937 gen(11);
+  std::geometric_distribution<uint32_t> dist(0.002);
+  std::vector<uint32_t> base(5000);
+  for (auto& c : base) {
+    c = dist(gen) * 7919 + 3;
+  }
+  std::vector<uint32_t> wide_text;
+  while (wide_text.size() < text.size()) {
+    base[gen() % base.size()] = dist(gen) * 7919 + 3;
+    wide_text.insert(wide_text.end(), base.begin(), base.end());
+  }
+  auto* bt = pasta::make_block_tree_partitioned<uint32_t, int32_t>(
+      wide_text, 2, 8, true, 4);
+  // one rank directory per class instead of per character
+  std::map<uint32_t, int64_t> hist;
+  for (auto c : wide_text) {
+    ++hist[c];
+  }
+  ASSERT_GT(hist.size(), 1000);
+  ASSERT_LE(bt->classes().c_ranks_.size(), std::bit_width(hist.size()));
+  hist.clear();
+  for (size_t i = 0; i < wide_text.size(); ++i) {
+    uint32_t c = wide_text[i];
+    ++hist[c];
+    ASSERT_EQ(bt->access(i), c);
+    ASSERT_EQ(bt->rank(c, i), hist[c]);
+    if (i % 97 == 0) {
+      ASSERT_EQ(bt->select(c, hist[c]), i);
+    }
+  }
+  ASSERT_EQ(bt->rank(1, wide_text.size() - 1), 0);
+  // the offsets take less than the n log sigma bits of a plain wavelet matrix
+  // and the whole tree less than a plain tree with rank support
+  int64_t offset_bytes =
+      bt->print_space_usage() - bt->classes().print_space_usage();
+  ASSERT_LT(offset_bytes,
+            wide_text.size() * std::bit_width(hist.size()) / 8);
+  auto* plain = pasta::make_block_tree_lpf_parallel<uint32_t, int32_t>(
+      wide_text, 2, 8, true, 4);
+  plain->add_rank_support_omp(4);
+  ASSERT_LT(bt->print_space_usage(), plain->print_space_usage());
+  delete plain;
+  delete bt;
+}
+
+TEST_F(BlockTreeLPFTest, query_stats) {
+  auto& stats = pasta::QueryStats::local();
+  stats.reset();
+  stats.trace_ = true;
+  std::array<size_t, 256> hist = {0};
+  for (size_t i = 0; i < text.size() - 1; ++i) {
+    ++hist[text[i]];
+    ASSERT_EQ(bt->access(i), text[i]);
+    ASSERT_EQ(bt->rank(text[i], i), hist[text[i]]);
+    ASSERT_EQ(bt->select(text[i], hist[text[i]]), i);
+  }
+  stats.trace_ = false;
+  std::string json = stats.to_json();
+  ASSERT_EQ(json.rfind("{\"access\":{", 0), 0);
+#ifdef PASTA_BLOCK_TREE_QUERY_STATS
+  for (auto type : {pasta::QueryType::ACCESS, pasta::QueryType::RANK,
+                    pasta::QueryType::SELECT}) {
+    auto const& type_stats = stats[type];
+    ASSERT_EQ(type_stats.queries, text.size() - 1);
+    int64_t queries = 0;
+    int64_t hops = 0;
+    for (size_t h = 0; h < type_stats.hop_histogram.size(); ++h) {
+      queries += type_stats.hop_histogram[h];
+      hops += h * type_stats.hop_histogram[h];
+    }
+    ASSERT_EQ(queries, type_stats.queries);
+    int64_t level_hops = 0;
+    for (auto count : type_stats.hops_per_level) {
+      level_hops += count;
+    }
+    ASSERT_EQ(level_hops, hops);
+    ASSERT_LE(type_stats.hops_per_level.size(), bt->block_tree_types_.size());
+  }
+  ASSERT_EQ(stats.traced_queries_, 3 * (text.size() - 1));
+  auto const slowest = stats.slowest();
+  ASSERT_EQ(slowest.size(), stats.traced_queries_ / 1000);
+  for (size_t i = 0; i < slowest.size(); ++i) {
+    ASSERT_FALSE(slowest[i].path.empty());
+    if (i > 0) {
+      ASSERT_GE(slowest[i - 1].nanoseconds, slowest[i].nanoseconds);
+    }
+  }
+#else
+  ASSERT_EQ(stats[pasta::QueryType::ACCESS].queries, 0);
+  ASSERT_TRUE(stats.slowest().empty());
+#endif
+  stats.reset();
+
+  // the slowest queries are kept even if they come first
+  int64_t const queries = 20 * pasta::QueryStats::MIN_CANDIDATES;
+  for (int64_t i = 0; i < queries; ++i) {
+    stats.traced_queries_++;
+    stats.keep_if_slow(pasta::QueryTrace{pasta::QueryType::ACCESS,
+                                         queries - i, {}});
+  }
+  auto const first = stats.slowest();
+  ASSERT_EQ(first.size(), queries / 1000);
+  for (size_t i = 0; i < first.size(); ++i) {
+    ASSERT_EQ(first[i].nanoseconds, queries - static_cast<int64_t>(i));
+  }
+  stats.reset();
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();